@@ -11,6 +11,7 @@
 #include "pico/binary_info.h"
 #include "hardware/timer.h"
 #include "OneWire.h"
+#include "OneWireDrivers.h"
 #include "../../Display/sh1107/blink.h"
 #include "../../Display/sh1107/Display_all.h"
 
@@ -20,11 +21,25 @@ typedef struct DS18B20dev {
   uint16_t rom_crc;
   uint64_t serial_num;
   uint16_t temperature;
+  // shadow of the scratchpad config.  Once shadow_valid is set these are taken as
+  // right and only checked against the device by a verify read.
   uint8_t alarm_th;
   uint8_t alarm_tl;
   uint8_t config;
+  bool shadow_valid;
+  uint16_t reads_since_verify;
+  uint16_t config_resets;     // times a verify found the config back at power up values
 } DS18B20dev_t;
 
+// temperature only reads between verify reads of the full scratchpad
+#define DS18_VERIFY_INTERVAL 60
+
+// the temperature register at power on, which is also a real reading of 85 C
+#define DS18_POWER_ON_TEMP 0x0550
+
+// when convert_DS18_temp() last started a conversion
+static absolute_time_t convert_started;
+
 #define DEBUG
 #ifdef DEBUG
 //set up a text screen region
@@ -98,10 +113,18 @@ int search_DS18_rom(DS18B20dev_t *devs[]) {
     devs[i]->family_code = roms[i] & 0xFF;
     devs[i]->serial_num = roms[i] >> 8 & 0xFFFFFFFFFFFF;
     devs[i]->rom_crc = roms[i] >> 56 & 0xFF;
+    devs[i]->shadow_valid = false;
+    devs[i]->reads_since_verify = 0;
+    devs[i]->config_resets = 0;
   }
   return num_roms;
 }
 
+// puts the family code, serial number and CRC back together into the 64 bit rom
+uint64_t get_DS18_rom_code(DS18B20dev_t *dev) {
+  return ((uint64_t)dev->rom_crc << 56) | (dev->serial_num << 8) | dev->family_code;
+}
+
 bool get_DS18_scratch(DS18B20dev_t *dev) {
 
   // send match rom to identify device
@@ -113,8 +136,8 @@ bool get_DS18_scratch(DS18B20dev_t *dev) {
   // send the read scratch command
   oneWire_write_byte(0xBE, true);
  
-  // read back 9 bytes
-  oneWire_status stat = oneWire_read_bytes(u.a, 9);
+  // read back 9 bytes straight into the word aligned buffer
+  oneWire_status stat = oneWire_read_words(u.l, 9);
   if (stat != ONE_WIRE_NO_ERROR) return false;
 
   // store the scratch data in the dev struct
@@ -126,6 +149,112 @@ bool get_DS18_scratch(DS18B20dev_t *dev) {
   return true;
 }
 
+// writes the shadow TH, TL and config back to the device scratchpad
+void set_DS18_config(DS18B20dev_t *dev) {
+  oneWire_reset(true);
+  send_DS18_match_rom(dev);
+  oneWire_write_byte(0x4E, true);
+  oneWire_write_uint(((uint16_t)dev->alarm_tl << 8) | dev->alarm_th, true);
+  oneWire_write_byte(dev->config, true);
+  oneWire_flush();
+}
+
+// Reads the whole scratchpad with its CRC and checks TH, TL and config against the
+// shadow.  If the device lost power it comes back with the values in its EEPROM, so
+// a difference is counted and the shadow is written back.  The first verify of a 
+// device fills the shadow.  The bus must be reset before calling.
+// returns false if the read failed.
+bool verify_DS18_config(DS18B20dev_t *dev) {
+  uint8_t th = dev->alarm_th;
+  uint8_t tl = dev->alarm_tl;
+  uint8_t config = dev->config;
+  if (!get_DS18_scratch(dev)) return false;
+  dev->reads_since_verify = 0;
+  if (!dev->shadow_valid) {
+    dev->shadow_valid = true;
+    return true;
+  }
+  if (dev->alarm_th != th || dev->alarm_tl != tl || dev->config != config) {
+    dev->config_resets++;
+    dev->alarm_th = th;
+    dev->alarm_tl = tl;
+    dev->config = config;
+    set_DS18_config(dev);
+  }
+  return true;
+}
+
+// true if the last conversion has had time to finish at the resolution in the shadow
+// config, 93.75ms at 9 bits up to 750ms at 12 bits
+static bool DS18_convert_done(DS18B20dev_t *dev) {
+  uint32_t ms = 750 >> (3 - ((dev->config >> 5) & 3));
+  return absolute_time_diff_us(convert_started, get_absolute_time()) >= (int64_t)ms * 1000;
+}
+
+// Does a verify read and takes its temperature.  85 C is only taken as the power on
+// value, and the read as failed, if the last convert can't have finished yet or the
+// verify found the config back at its power up values, so the device was reset 
+// after the convert.  Otherwise it is a real reading of 85 C.
+// returns false if the read failed.
+static bool verify_DS18_temp(DS18B20dev_t *dev) {
+  uint16_t last = dev->temperature;
+  uint16_t resets = dev->config_resets;
+  if (!verify_DS18_config(dev)) return false;
+  if (dev->temperature == DS18_POWER_ON_TEMP && 
+      (!DS18_convert_done(dev) || dev->config_resets != resets)) {
+    dev->temperature = last;
+    return false;
+  }
+  return true;
+}
+
+// Reads just the 2 temperature bytes and TH of the scratchpad, 3 bytes on the wire 
+// instead of 9.  The rest is never clocked out, the next reset ends the read.  There
+// is no CRC on a short read so it is taken as failed, and the device is made due for
+// a verify, if the value is outside the -55 to 125 C range of the device, is 0xFFFF
+// (nobody drove the bus) or TH is not the shadow TH.  85 C can be a real reading or 
+// the power on value of a device that was reset, so it is read again with a verify
+// read that tells the two apart by the conversion time and the config.  Does a 
+// verify read instead when the shadow is not valid yet or verify is true.  The bus 
+// must be reset before calling.
+// returns false if the read failed.
+bool get_DS18_temp(DS18B20dev_t *dev, bool verify) {
+  if (verify || !dev->shadow_valid) return verify_DS18_temp(dev);
+  send_DS18_match_rom(dev);
+  oneWire_write_byte(0xBE, true);
+  oneWire_push_read_cmd(24);
+  uint32_t d = oneWire_pull_read_data(24);
+  int16_t t = (int16_t)(d & 0xFFFF);
+  uint8_t th = d >> 16;
+  if (t < -55 * 16 || t > 125 * 16 || t == (int16_t)0xFFFF || th != dev->alarm_th) {
+    dev->reads_since_verify = DS18_VERIFY_INTERVAL;
+    return false;
+  }
+  if (t == DS18_POWER_ON_TEMP) {
+    // the short read is over, a reset starts the full one
+    oneWire_reset(true);
+    return verify_DS18_temp(dev);
+  }
+  dev->temperature = t;
+  dev->reads_since_verify++;
+  return true;
+}
+
+// Picks the one device that is most overdue for a verify so a sweep never has more 
+// than one full scratchpad read in it.
+// returns the index of the device or -1 if none is due.
+int next_DS18_verify(DS18B20dev_t *devs[], int num) {
+  int due = -1;
+  for (int i = 0;  i < num; i++) {
+    if (devs[i]->family_code != 0x28) continue;
+    if (devs[i]->reads_since_verify >= DS18_VERIFY_INTERVAL &&
+        (due < 0 || devs[i]->reads_since_verify > devs[due]->reads_since_verify)) {
+      due = i;
+    }
+  }
+  return due;
+}
+
 /*
 // checks to see if the device is done with whatever
 static inline bool are_all_DS18_done() {
@@ -142,6 +271,9 @@ bool convert_DS18_temp(bool wait) {
   send_DS18_skip_rom();
   // send the convert temp command
   oneWire_write_byte(0x44, true);
+  // make sure the convert command is not held back while we wait
+  oneWire_flush();
+  convert_started = get_absolute_time();
   // wait a few microseconds to see if convertions started
   busy_wait_us_32(100);
   oneWire_wait_for_idle(true);
@@ -212,25 +344,42 @@ int main() {
   int p = 0;
   int f = 0;
 
+  // the driver registry decodes each family so mixed buses need no special code
+  uint64_t roms[10];
+  oneWire_reading_t readings[10];
+  memset(readings, 0, sizeof(readings));
+  for (int i = 0;  i < num_devs; i++) roms[i] = get_DS18_rom_code(devs[i]);
+
 while (1) {
-    // issue command to convert temprature to all devices
+    // one conversion for all devices.  0x44 is the convert command of every
+    // temperature family
     oneWire_reset(true);
     if (!convert_DS18_temp(true)) {
       srn_print(&csr1, "\nConvert temp failed");
     }
-
-    // for each device on the bus, read scratch and print temperature
+    // DS18B20s use the shadow config and read only the temperature, with at most
+    // one full verify per sweep.  Other families are decoded by their driver.
+    int verify = next_DS18_verify(devs, num_devs);
     for (int i = 0;  i < num_devs; i++) {
-      oneWire_reset(true);
-      if (get_DS18_scratch(devs[i])) {
+      bool present = oneWire_reset_presence();
+      if (devs[i]->family_code == 0x28) {
+        // a failed read keeps the last good value
+        if (present && get_DS18_temp(devs[i], i == verify)) {
+          readings[i].status = ONE_WIRE_NO_ERROR;
+          readings[i].value[0] = (float)(int16_t)devs[i]->temperature / 16.0;
+        } else {
+          readings[i].status = ONE_WIRE_READ_CRC_FAILURE;
+        }
+      } else {
+        oneWire_driver_read(roms[i], &readings[i]);
+      }
+      if (readings[i].status == ONE_WIRE_NO_ERROR) {
         p++;
       } else {
         print_d("\nScratch Read Failed");
-        sprintf(txt, "\%d n%x",devs[i]->temperature);
-        print_d(txt);
         f++;
       }
-      float temp = (float)devs[i]->temperature / 16.0;
+      float temp = readings[i].value[0];
       draw_next_as_bar(&gsras,temp);
       sprintf(txt,"\n%d:%5.1f", i, temp);
       srn_print(&csr1, txt);
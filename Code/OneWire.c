@@ -10,17 +10,119 @@
 #include "hardware/pio.h"
 #include "hardware/clocks.h"
 #include "hardware/gpio.h"
+#include "hardware/timer.h"
+#include "hardware/irq.h"
+#include "pico/mutex.h"
 #include "OneWire.h"
+#include "OneWireSearch.h"
 #include "OneWire.pio.h"
 
 #define ONE_WIRE_FIFODEPTH 4
 
+// Defining ONE_WIRE_RAM_HOT_PATH puts the functions that feed and empty the FIFOs,
+// the helpers they call, the bus lock and the CRC table in SRAM so a cold XIP 
+// cache can't stall them.  The SDK mutex the bus lock uses is not moved by this
+// option.  oneWire_transaction() takes it before the first push and gives it back
+// after the last pull so it can't add a gap on the wire, but a caller that takes
+// the lock between pushes of its own sequence can be stalled by it.  The map file
+// shows what the option costs in RAM.
+#ifdef ONE_WIRE_RAM_HOT_PATH
+#define ONE_WIRE_HOT(func) __not_in_flash_func(func)
+#define ONE_WIRE_HOT_DATA __not_in_flash("OneWire")
+#else
+#define ONE_WIRE_HOT(func) func
+#define ONE_WIRE_HOT_DATA
+#endif
+
 struct OneWirePIO {
   PIO pio;
   uint offset;
   uint sm;
+  uint num_recoveries;
+  oneWire_recovery_t last_recovery;
+  recursive_mutex_t lock;
+  bool push_timing;     // measuring gaps in a transaction
+  bool push_gap_armed;  // last_push_us is valid
+  uint32_t last_push_us;
+  uint32_t max_push_gap_us;
+  uint32_t write_data;  // write bits not pushed yet, first bit in bit 0
+  uint write_bits;      // number of bits in write_data, always < 16
+  uint32_t coalesced;   // write calls that did not need a push of their own
+  bool overdrive;       // OneWire_overdrive is loaded in place of OneWire
 } owp;
 
+// counts the searches started so anything kept per rom can tell the bus was 
+// enumerated again.  Not in owp since searches run before init_OneWire().
+static uint32_t search_generation;
+
+// the rom of the device a resume rom (0xA5) would reach, 0 if not known.  Not in owp 
+// since the searches change it too.
+static uint64_t selected_rom;
+
+// every push to the Tx FIFO goes through here.  If ONE_WIRE_PUSH_TIMING is defined
+// the time the CPU takes between pushes inside a transaction is measured. Time 
+// spent blocked on a full FIFO or waiting on read data is not counted.
+static inline void ONE_WIRE_HOT(oneWire_push)(uint32_t cmd) {
+#ifdef ONE_WIRE_PUSH_TIMING
+  if (owp.push_timing) {
+    uint32_t now = time_us_32();
+    if (owp.push_gap_armed && now - owp.last_push_us > owp.max_push_gap_us) {
+      owp.max_push_gap_us = now - owp.last_push_us;
+    }
+    pio_sm_put_blocking(owp.pio, owp.sm, cmd);
+    owp.last_push_us = time_us_32();
+    owp.push_gap_armed = true;
+    return;
+  }
+  pio_sm_put_blocking(owp.pio, owp.sm, cmd);
+#else
+  pio_sm_put_blocking(owp.pio, owp.sm, cmd);
+#endif
+}
+
+// pushes any write bits held back by the coalescer as one write command.  Held back 
+// bits keep one level of the bus lock until they are pushed, so only the context that
+// wrote them can get past the enter.  Anyone else waits here until they are out.
+static inline void ONE_WIRE_HOT(oneWire_push_pending_writes)() {
+  if (owp.write_bits > 0) {
+    recursive_mutex_enter_blocking(&owp.lock);
+    if (owp.write_bits > 0) {
+      oneWire_push((owp.write_data << 6) + ((owp.write_bits - 1) << 2) + 0x03);
+      owp.write_data = 0;
+      owp.write_bits = 0;
+      recursive_mutex_exit(&owp.lock);   // the level the held back bits had
+    }
+    recursive_mutex_exit(&owp.lock);
+  }
+}
+
+// every command that is not a coalesced write goes through here so held back 
+// writes always reach the bus before it, in order.
+static inline void ONE_WIRE_HOT(oneWire_put)(uint32_t cmd) {
+  oneWire_push_pending_writes();
+  oneWire_push(cmd);
+}
+
+// adds num_bits (at most 16) of data to the held back writes.  A full 16 bit write 
+// command is pushed as soon as there are 16 bits, the rest waits for the next write
+// or anything else that needs the bus.  The bus lock must be held.
+static inline void ONE_WIRE_HOT(oneWire_coalesce_write)(uint32_t data, uint num_bits) {
+  owp.write_data |= data << owp.write_bits;
+  owp.write_bits += num_bits;
+  if (owp.write_bits >= 16) {
+    oneWire_push(((owp.write_data & 0xFFFF) << 6) + (15<<2) + 0x03);
+    owp.write_data >>= 16;
+    owp.write_bits -= 16;
+  } else {
+    owp.coalesced++;
+  }
+}
+
+// true if a write of num_bits would have to push with the Tx FIFO full
+static inline bool ONE_WIRE_HOT(oneWire_write_would_block)(uint num_bits) {
+  return owp.write_bits + num_bits >= 16 && pio_sm_is_tx_fifo_full(owp.pio, owp.sm);
+}
+
 // init_OneWire inits the PIO0 state machine to implement a OneWire interface the pin
 // define in ONE_WIRE_GPIO.  Call this fuction after oneWire_Search_Rom().
 void init_OneWire(){
@@ -29,54 +131,263 @@ void init_OneWire(){
     owp.offset = pio_add_program(owp.pio, &OneWire_program);
     owp.sm = pio_claim_unused_sm(owp.pio, true);
     OneWire_program_init(owp.pio, owp.sm, owp.offset, ONE_WIRE_GPIO);
+    owp.num_recoveries = 0;
+    owp.overdrive = false;
+    recursive_mutex_init(&owp.lock);
+}
+
+// oneWire_wait_for_sm_idle waits until the state machine has run every command pushed
+// to it and is waiting at the top of the program for the next one.
+void oneWire_wait_for_sm_idle() {
+  oneWire_push_pending_writes();
+  while (!pio_sm_is_tx_fifo_empty(owp.pio, owp.sm) || 
+         pio_sm_get_pc(owp.pio, owp.sm) != owp.offset) {
+    tight_loop_contents();
+  }
+}
+
+// puts the standard or the overdrive program in place of the one at owp.offset and 
+// starts the state machine at the top of it with the clock that program is timed 
+// for.  The pin directions are left alone so the bus stays released.  Only call 
+// with the state machine idle.
+static void oneWire_load_program(bool overdrive) {
+  const pio_program_t *loaded = owp.overdrive ? &OneWire_overdrive_program : &OneWire_program;
+  pio_sm_config c;
+  uint32_t hz;
+  if (overdrive) {
+    c = OneWire_overdrive_program_get_default_config(owp.offset);
+    hz = ONE_WIRE_OVERDRIVE_HZ;
+  } else {
+    c = OneWire_program_get_default_config(owp.offset);
+    hz = 5 * 100000;
+  }
+  pio_sm_set_enabled(owp.pio, owp.sm, false);
+  pio_remove_program(owp.pio, loaded, owp.offset);
+  pio_add_program_at_offset(owp.pio, overdrive ? &OneWire_overdrive_program : &OneWire_program,
+                            owp.offset);
+  sm_config_set_out_pins(&c, ONE_WIRE_GPIO, 1);
+  sm_config_set_set_pins(&c, ONE_WIRE_GPIO, 1);
+  sm_config_set_in_pins(&c, ONE_WIRE_GPIO);
+  sm_config_set_jmp_pin(&c, ONE_WIRE_GPIO);
+  sm_config_set_clkdiv(&c, (float)clock_get_hz(clk_sys) / hz);
+  pio_sm_init(owp.pio, owp.sm, owp.offset, &c);
+  pio_sm_set_enabled(owp.pio, owp.sm, true);
+  owp.overdrive = overdrive;
+}
+
+// oneWire_set_overdrive switches the state machine between standard and overdrive 
+// speed.  Overdrive swaps in the OneWire_overdrive program, which has its own slot
+// timing, in place of OneWire.  Both fill the instruction memory so only one is 
+// loaded at a time.
+// Send overdrive skip rom (0x3C) or overdrive match rom (0x69) at standard speed first.
+// Going back to standard speed, the next reset puts the devices back at standard speed.
+// Waits for any commands already pushed to finish before changing the program.
+void oneWire_set_overdrive(bool on) {
+  oneWire_bus_lock();
+  oneWire_wait_for_sm_idle();
+  if (on != owp.overdrive) oneWire_load_program(on);
+  oneWire_bus_unlock();
+}
+
+// oneWire_bus_lock takes ownership of the bus so a sequence of calls can't be 
+// interleaved with calls from another context.  oneWire_transaction() takes
+// the lock by itself.  The lock can be nested.
+void ONE_WIRE_HOT(oneWire_bus_lock)() {
+  recursive_mutex_enter_blocking(&owp.lock);
+}
+
+// oneWire_bus_unlock releases the bus taken with oneWire_bus_lock().  Any writes held
+// back by the coalescer are pushed first so they can't end up in someone else's 
+// sequence.
+void ONE_WIRE_HOT(oneWire_bus_unlock)() {
+  oneWire_push_pending_writes();
+  recursive_mutex_exit(&owp.lock);
+}
+
+// oneWire_recover gets the state machine back to a known state without a reboot when
+// a push and a pull did not pair up.  Both FIFOs are drained, the state machine is 
+// restarted at the start of the program and the bus is released.  A bus left in 
+// overdrive is put back at standard speed.  If info is not NULL
+// what was discarded is reported there.  Any transaction in flight is lost so the 
+// caller should start over with a reset.
+// returns 0.
+oneWire_status oneWire_recover(oneWire_recovery_t *info) {
+  uint32_t start = time_us_32();
+  pio_sm_set_enabled(owp.pio, owp.sm, false);
+  // count what is about to be thrown away
+  owp.last_recovery.tx_discarded = pio_sm_get_tx_fifo_level(owp.pio, owp.sm);
+  owp.last_recovery.rx_discarded = pio_sm_get_rx_fifo_level(owp.pio, owp.sm);
+  recursive_mutex_enter_blocking(&owp.lock);
+  if (owp.write_bits > 0) {
+    owp.last_recovery.tx_discarded++;
+    owp.write_data = 0;
+    owp.write_bits = 0;
+    recursive_mutex_exit(&owp.lock);   // the level the held back bits had
+  }
+  recursive_mutex_exit(&owp.lock);
+  pio_sm_clear_fifos(owp.pio, owp.sm);
+  // clear the shift counters and any stall then release the bus and 
+  // start again at the top of the program where it waits for a pull
+  pio_sm_restart(owp.pio, owp.sm);
+  pio_sm_exec(owp.pio, owp.sm, pio_encode_set(pio_pindirs, 0));
+  pio_sm_exec(owp.pio, owp.sm, pio_encode_jmp(owp.offset));
+  pio_sm_set_enabled(owp.pio, owp.sm, true);
+  if (owp.overdrive) oneWire_load_program(false);
+  selected_rom = 0;
+  owp.last_recovery.time_us = time_us_32() - start;
+  owp.num_recoveries++;
+  if (info != NULL) *info = owp.last_recovery;
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_get_last_recovery returns the report from the last oneWire_recover() call
+// including the ones made by the timed pull functions.  
+// returns the number of recoveries done since init_OneWire().
+uint oneWire_get_last_recovery(oneWire_recovery_t *info) {
+  if (info != NULL) *info = owp.last_recovery;
+  return owp.num_recoveries;
+}
+
+// oneWire_get_max_push_gap returns the longest time in microseconds the CPU took between
+// two Tx FIFO pushes inside oneWire_transaction() since the last clear.  Build once with
+// and once without ONE_WIRE_RAM_HOT_PATH to see what XIP cache misses cost.  Only 
+// measured when built with ONE_WIRE_PUSH_TIMING, otherwise always returns 0.
+// If clear = true the maximum is reset after it is read.
+uint32_t oneWire_get_max_push_gap(bool clear) {
+  uint32_t gap = owp.max_push_gap_us;
+  if (clear) owp.max_push_gap_us = 0;
+  return gap;
+}
+
+// oneWire_tx_stalled returns true if the state machine has waited on an empty Tx FIFO
+// since the last clear, which means the bus sat idle waiting for the processor.  Uses
+// the TXSTALL bit of the PIO FDEBUG register.
+// If clear = true the bit is cleared after it is read.
+bool oneWire_tx_stalled(bool clear) {
+  uint32_t mask = 1u << (PIO_FDEBUG_TXSTALL_LSB + owp.sm);
+  bool stalled = (owp.pio->fdebug & mask) != 0;
+  if (clear) owp.pio->fdebug = mask;  // write 1 to clear
+  return stalled;
+}
+
+// waits for at least num_words in the Rx FIFO.  
+// returns false if timeout_us expired first.
+static bool oneWire_wait_rx_level(uint num_words, uint32_t timeout_us) {
+  absolute_time_t timeout = make_timeout_time_us(timeout_us);
+  while (pio_sm_get_rx_fifo_level(owp.pio, owp.sm) < num_words) {
+    if (time_reached(timeout)) return false;
+  }
+  return true;
 }
 
 // oneWire_reset issues a reset command to the devices on the OneWire bus.
 // If wait = true, the function will not return until the command is written to the Tx FIFO.
 // returms 0 if successful.
 // returns error code it not wait=false and no room in Tx fifo.
-oneWire_status oneWire_reset(bool wait) {
+oneWire_status ONE_WIRE_HOT(oneWire_reset)(bool wait) {
   if (!wait && pio_sm_is_tx_fifo_full(owp.pio, owp.sm)) {
     return ONE_WIRE_NOT_ENOUGH_TX_FIFO_SPACE;
   }
-  pio_sm_put_blocking(owp.pio, owp.sm, 0x00000002); // issye reset
+  oneWire_put(0x00000002); // issye reset
+  // whatever rom command follows is not seen here
+  selected_rom = 0;
   return ONE_WIRE_NO_ERROR;
 }
 
+// how long the reset pulse and the release may take, and how long after the release
+// a presence pulse is looked for (tPDH is at most 60us)
+#define ONE_WIRE_RESET_TIMEOUT_US 1000
+#define ONE_WIRE_PRESENCE_WINDOW_US 70
+
+// oneWire_reset_presence issues a reset and watches the pin while the state machine 
+// runs it, the same as oneWire_reset() but the caller learns if anyone answered.
+// Commands already pushed are finished first.  Only works at standard speed.
+// returns true if a presence pulse was seen.
+bool oneWire_reset_presence() {
+  bool present = false;
+  oneWire_bus_lock();
+  oneWire_wait_for_sm_idle();
+  oneWire_reset(true);
+  absolute_time_t timeout = make_timeout_time_us(ONE_WIRE_RESET_TIMEOUT_US);
+  // the reset pulse, then the release
+  while (gpio_get(ONE_WIRE_GPIO) && !time_reached(timeout)) tight_loop_contents();
+  while (!gpio_get(ONE_WIRE_GPIO) && !time_reached(timeout)) tight_loop_contents();
+  if (!time_reached(timeout)) {
+    uint32_t released = time_us_32();
+    while (!present && time_us_32() - released < ONE_WIRE_PRESENCE_WINDOW_US) {
+      present = !gpio_get(ONE_WIRE_GPIO);
+    }
+  }
+  oneWire_bus_unlock();
+  return present;
+}
+
 // oneWire_wait_for_idle issues a woit for idle bus command
 // If wait = true, the function will not return until the data is written to the Tx FIFO.
 // returms 0 if successful.
 // returns error code it not wait=false and no room in Tx fifo.
-oneWire_status oneWire_wait_for_idle(bool wait){
+oneWire_status ONE_WIRE_HOT(oneWire_wait_for_idle)(bool wait){
   if (!wait && pio_sm_is_tx_fifo_full(owp.pio, owp.sm)) {
     return ONE_WIRE_NOT_ENOUGH_TX_FIFO_SPACE;
   }
-  pio_sm_put_blocking(owp.pio, owp.sm, 0x00000000);  // issue wait_for_1
+  oneWire_put(0x00000000);  // issue wait_for_1
   return ONE_WIRE_NO_ERROR;
 }
 
-// oneWire_write_byte writes a single byte to the OneWire bus.
-// If wait = true, the function will not return until the data is written to the Tx FIFO.
-// returms 0 if successful.
-// returns error code it not wait=false and no room in Tx fifo.
-oneWire_status oneWire_write_byte(uint8_t data, bool wait) {
-  if (!wait && pio_sm_is_tx_fifo_full(owp.pio, owp.sm)) {
+// adds num_bits of data to the held back writes under the bus lock.  When bits are 
+// left held back the level of the lock taken here is kept, so no other context can 
+// use the bus until they are pushed by the next read, reset, wait, flush or unlock.
+static oneWire_status ONE_WIRE_HOT(oneWire_write_bits)(uint32_t data, uint num_bits, bool wait) {
+  recursive_mutex_enter_blocking(&owp.lock);
+  bool held = owp.write_bits > 0;
+  if (!wait && oneWire_write_would_block(num_bits)) {
+    recursive_mutex_exit(&owp.lock);
     return ONE_WIRE_NOT_ENOUGH_TX_FIFO_SPACE;
   }
-  pio_sm_put_blocking(owp.pio, owp.sm, (data << 6) + (7<<2) +0x03);
+  oneWire_coalesce_write(data, num_bits);
+  // keep this level if bits are newly held back, give back the held level if none are
+  if (held || owp.write_bits == 0) recursive_mutex_exit(&owp.lock);
+  if (held && owp.write_bits == 0) recursive_mutex_exit(&owp.lock);
   return ONE_WIRE_NO_ERROR;
 }
 
-// oneWire_write_uint writes a single unsigned int to the OneWire bus.
-// If wait = true, the function will not return until the data is written to the Tx FIFO.
+// oneWire_write_byte writes a single byte to the OneWire bus.
+// Consecutive writes are packed 16 bits to a Tx FIFO word, so the byte may be held 
+// back until the next write, read, reset or wait, a bus unlock or a call to 
+// oneWire_flush().  While a byte is held back the caller keeps the bus lock.
+// If wait = true, the function will not return until the data is written to the Tx FIFO
+// or held back.
+// returms 0 if successful.
+// returns error code it not wait=false and no room in Tx fifo.
+oneWire_status ONE_WIRE_HOT(oneWire_write_byte)(uint8_t data, bool wait) {
+  return oneWire_write_bits(data, 8, wait);
+}
+
+// oneWire_write_uint writes a single unsigned int to the OneWire bus, low byte first.
+// It is packed with any held back write the same as oneWire_write_byte().
+// If wait = true, the function will not return until the data is written to the Tx FIFO
+// or held back.
 // returms 0 if successful
 // returns error code it not wait=false and no room in Tx fifo.
-oneWire_status oneWire_write_uint(uint16_t data, bool wait) {
-  if (!wait && pio_sm_is_tx_fifo_full(owp.pio, owp.sm)) {
-    return ONE_WIRE_NOT_ENOUGH_TX_FIFO_SPACE;
-  }
-  pio_sm_put_blocking(owp.pio, owp.sm, (data << 6) + (15<<2) +0x03);
-  return ONE_WIRE_NO_ERROR;
+oneWire_status ONE_WIRE_HOT(oneWire_write_uint)(uint16_t data, bool wait) {
+  return oneWire_write_bits(data, 16, wait);
+}
+
+// oneWire_flush pushes any writes held back by oneWire_write_byte() or 
+// oneWire_write_uint() to the Tx FIFO and gives back the bus lock they kept.  Only 
+// needed when nothing else is going to be sent for a while, e.g. after a convert 
+// command, since every read, reset, wait, transaction and bus unlock flushes first.
+void ONE_WIRE_HOT(oneWire_flush)() {
+  oneWire_push_pending_writes();
+}
+
+// oneWire_get_coalesced_writes returns the number of write calls since the last clear 
+// that were packed into another write instead of taking a Tx FIFO word of their own.
+// If clear = true the count is reset after it is read.
+uint32_t oneWire_get_coalesced_writes(bool clear) {
+  uint32_t n = owp.coalesced;
+  if (clear) owp.coalesced = 0;
+  return n;
 }
 
 // oneWire_push_read_cmd issues a command to read a certain number of bits.  
@@ -84,9 +395,9 @@ oneWire_status oneWire_write_uint(uint16_t data, bool wait) {
 // oneWire_pull_read_data. 
 // returns 0 if successful.
 // returns error code if number of bits is > 32 or < 1
-oneWire_status oneWire_push_read_cmd(uint num_bits) {
+oneWire_status ONE_WIRE_HOT(oneWire_push_read_cmd)(uint num_bits) {
   if (num_bits > 32 || num_bits < 1) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
-  pio_sm_put_blocking(owp.pio, owp.sm, (num_bits-1 << 2) + 1);  // issue read of num_bits bits
+  oneWire_put(((num_bits-1) << 2) + 1);  // issue read of num_bits bits
   return ONE_WIRE_NO_ERROR;
 }
 
@@ -96,11 +407,38 @@ oneWire_status oneWire_push_read_cmd(uint num_bits) {
 // So if not preceded by a call to oneWire_push_read_cmd, a hang will result. 
 // No CRC check is done.
 // returns the data in the fifo.
-uint32_t oneWire_pull_read_data(uint num_bits) {
-  oneWire_status r = pio_sm_get_blocking(owp.pio, owp.sm);
+uint32_t ONE_WIRE_HOT(oneWire_pull_read_data)(uint num_bits) {
+  uint32_t r = pio_sm_get_blocking(owp.pio, owp.sm);
   return r >> (32-num_bits);
 }
 
+// oneWire_pull_read_data_timeout is the same as oneWire_pull_read_data but gives up if no 
+// data shows up in the Rx FIFO within timeout_us microseconds.  On a timeout the 
+// FIFOs are out of sync so oneWire_recover() is called before returning.
+// returns 0 if successful and the data is placed in *data.
+// returns error code if the timeout expired.
+oneWire_status oneWire_pull_read_data_timeout(uint num_bits, uint32_t *data, uint32_t timeout_us) {
+  if (!oneWire_wait_rx_level(1, timeout_us)) {
+    oneWire_recover(NULL);
+    return ONE_WIRE_FIFO_TIMEOUT;
+  }
+  *data = pio_sm_get(owp.pio, owp.sm) >> (32-num_bits);
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_pull_read_word pulls one 32 bit read from the Rx FIFO with no shift.  It
+// should be paired with a 32 bit read such as oneWire_push_read_words_cmd(4, wait).
+// If wait = true, the function will not return until there is data in the RX fifo.
+// returns 0 if successful and the data is placed in *data.
+// returns error code if wait = false and the Rx FIFO is empty.
+oneWire_status ONE_WIRE_HOT(oneWire_pull_read_word)(uint32_t *data, bool wait) {
+  if (!wait && pio_sm_is_rx_fifo_empty(owp.pio, owp.sm)) {
+    return ONE_WIRE_NOT_ENOUGH_DATA_IN_RX_FIFO;
+  }
+  *data = pio_sm_get_blocking(owp.pio, owp.sm);
+  return ONE_WIRE_NO_ERROR;
+}
+
 // oneWire_read_byte reads one byte of data  No CRC check is performend.
 // If wait = true, the function will not return until the data is written to the Tx FIFO.
 // returms 0 if successful.
@@ -140,25 +478,64 @@ oneWire_status oneWire_read_ulong (uint32_t *data, bool wait){
   *data = oneWire_pull_read_data(32);
 }
 
+// CRC8 (x^8 + x^5 + x^4 + 1) of every byte value so the CRC can be done
+// a byte at a time.
+static const uint8_t ONE_WIRE_HOT_DATA oneWire_crc8_table[256] = {
+  0x00, 0x5E, 0xBC, 0xE2, 0x61, 0x3F, 0xDD, 0x83, 0xC2, 0x9C, 0x7E, 0x20, 0xA3, 0xFD, 0x1F, 0x41,
+  0x9D, 0xC3, 0x21, 0x7F, 0xFC, 0xA2, 0x40, 0x1E, 0x5F, 0x01, 0xE3, 0xBD, 0x3E, 0x60, 0x82, 0xDC,
+  0x23, 0x7D, 0x9F, 0xC1, 0x42, 0x1C, 0xFE, 0xA0, 0xE1, 0xBF, 0x5D, 0x03, 0x80, 0xDE, 0x3C, 0x62,
+  0xBE, 0xE0, 0x02, 0x5C, 0xDF, 0x81, 0x63, 0x3D, 0x7C, 0x22, 0xC0, 0x9E, 0x1D, 0x43, 0xA1, 0xFF,
+  0x46, 0x18, 0xFA, 0xA4, 0x27, 0x79, 0x9B, 0xC5, 0x84, 0xDA, 0x38, 0x66, 0xE5, 0xBB, 0x59, 0x07,
+  0xDB, 0x85, 0x67, 0x39, 0xBA, 0xE4, 0x06, 0x58, 0x19, 0x47, 0xA5, 0xFB, 0x78, 0x26, 0xC4, 0x9A,
+  0x65, 0x3B, 0xD9, 0x87, 0x04, 0x5A, 0xB8, 0xE6, 0xA7, 0xF9, 0x1B, 0x45, 0xC6, 0x98, 0x7A, 0x24,
+  0xF8, 0xA6, 0x44, 0x1A, 0x99, 0xC7, 0x25, 0x7B, 0x3A, 0x64, 0x86, 0xD8, 0x5B, 0x05, 0xE7, 0xB9,
+  0x8C, 0xD2, 0x30, 0x6E, 0xED, 0xB3, 0x51, 0x0F, 0x4E, 0x10, 0xF2, 0xAC, 0x2F, 0x71, 0x93, 0xCD,
+  0x11, 0x4F, 0xAD, 0xF3, 0x70, 0x2E, 0xCC, 0x92, 0xD3, 0x8D, 0x6F, 0x31, 0xB2, 0xEC, 0x0E, 0x50,
+  0xAF, 0xF1, 0x13, 0x4D, 0xCE, 0x90, 0x72, 0x2C, 0x6D, 0x33, 0xD1, 0x8F, 0x0C, 0x52, 0xB0, 0xEE,
+  0x32, 0x6C, 0x8E, 0xD0, 0x53, 0x0D, 0xEF, 0xB1, 0xF0, 0xAE, 0x4C, 0x12, 0x91, 0xCF, 0x2D, 0x73,
+  0xCA, 0x94, 0x76, 0x28, 0xAB, 0xF5, 0x17, 0x49, 0x08, 0x56, 0xB4, 0xEA, 0x69, 0x37, 0xD5, 0x8B,
+  0x57, 0x09, 0xEB, 0xB5, 0x36, 0x68, 0x8A, 0xD4, 0x95, 0xCB, 0x29, 0x77, 0xF4, 0xAA, 0x48, 0x16,
+  0xE9, 0xB7, 0x55, 0x0B, 0x88, 0xD6, 0x34, 0x6A, 0x2B, 0x75, 0x97, 0xC9, 0x4A, 0x14, 0xF6, 0xA8,
+  0x74, 0x2A, 0xC8, 0x96, 0x15, 0x4B, 0xA9, 0xF7, 0xB6, 0xE8, 0x0A, 0x54, 0xD7, 0x89, 0x6B, 0x35,
+};
+
 // Performs the CRC check assuming last byte it the CRC
 // return 0 if CRC check is OK
 // return error code if check fails.
-oneWire_status oneWire_CRC(uint8_t a[], int len) {
+oneWire_status ONE_WIRE_HOT(oneWire_CRC)(uint8_t a[], int len) {
   uint8_t crc = 0;
   for (int i = 0;  i < len; i++) {
-    uint8_t t = a[i];
-    for (int j = 0; j < 8; j++){
-      crc ^= t & 1;
-      uint8_t pxor = ((crc & 1) != 0) ? 0x18 : 0;
-      crc ^= pxor;
-      crc = crc >> 1 | crc << 7;
-      t >>=  1;
-    }
+    crc = oneWire_crc8_table[crc ^ a[i]];
   }
   if (crc != 0) return ONE_WIRE_READ_CRC_FAILURE;
   else return ONE_WIRE_NO_ERROR;
 }
 
+// oneWire_CRC16 continues a CRC16 (x^16 + x^15 + x^2 + 1) calculation over len bytes 
+// starting from crc.  Start a new calculation with crc = 0.
+// returns the updated CRC.
+uint16_t ONE_WIRE_HOT(oneWire_CRC16)(uint16_t crc, const uint8_t a[], int len) {
+  for (int i = 0;  i < len; i++) {
+    crc ^= a[i];
+    for (int j = 0; j < 8; j++){
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+// Performs the CRC16 check assuming the last two bytes are the inverted CRC16 sent 
+// by the device LSB first.  crc is the CRC of any bytes the device included in the 
+// CRC that are not in a[], usually the command bytes, or 0 if none.
+// return 0 if CRC check is OK
+// return error code if check fails.
+oneWire_status ONE_WIRE_HOT(oneWire_CRC16_check)(uint16_t crc, const uint8_t a[], int len) {
+  if (len < 2) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  crc = oneWire_CRC16(crc, a, len - 2);
+  uint16_t sent = ~(a[len-2] | (a[len-1] << 8));
+  if (crc != sent) return ONE_WIRE_READ_CRC_FAILURE;
+  else return ONE_WIRE_NO_ERROR;
+}
 
 // The OneWire PIO state machine takes read requests from 1 to 32 bits.  The read_bytes fuctions
 // below convert the requested number of bytes to be read into individual PIO read requests
@@ -169,24 +546,44 @@ oneWire_status oneWire_CRC(uint8_t a[], int len) {
 // returns 0 if successful.
 // returns error code if requesting > 16 bytes.
 // returns error code if wait = false and there is not enough room in the fifo.
-oneWire_status oneWire_push_read_bytes_cmd(int num, bool wait) {
+oneWire_status ONE_WIRE_HOT(oneWire_push_read_bytes_cmd)(int num, bool wait) {
   if (num > 16) return ONE_WIRE_POSSIBLE_FIFO_OVERFLOW;  // a read request of mor than 32 bytes could overflow the fifo
   int num_pushes =num+3;
   if (!wait && num_pushes > 
-      (ONE_WIRE_FIFODEPTH - pio_sm_get_tx_fifo_level(owp.pio, owp.sm) * 4)) {
+      (ONE_WIRE_FIFODEPTH - (int)pio_sm_get_tx_fifo_level(owp.pio, owp.sm) * 4)) {
       return ONE_WIRE_NOT_ENOUGH_TX_FIFO_SPACE;  //If not wait andinsufficion fifo space, return error;
   }
   int i;
   for (i = 0;  i <= num-4; i +=  4) {
-    pio_sm_put_blocking(owp.pio, owp.sm, (31 << 2) + 1);  // issue read of 32 bits
+    oneWire_put((31 << 2) + 1);  // issue read of 32 bits
   }
   int remainder = num - i;
   if (remainder > 0) {
-    pio_sm_put_blocking(owp.pio, owp.sm, ((remainder*8-1) << 2) + 1);  // issue read of remainder * 8 bits
+    oneWire_put(((remainder*8-1) << 2) + 1);  // issue read of remainder * 8 bits
   }
   return ONE_WIRE_NO_ERROR;
 }
 
+// pulls num bytes from the Rx FIFO with no checks.  The reads must already have 
+// been pushed by oneWire_push_read_bytes_cmd().
+static void ONE_WIRE_HOT(oneWire_pull_bytes_raw)(uint8_t data[], int num) {
+  union {  // easy conversion from long to bytes
+    uint8_t  a[4];
+    uint32_t l;
+  } u;
+  int i;
+  for (i = 0;  i <= num-4; i +=  4) {
+      u.l = pio_sm_get_blocking(owp.pio, owp.sm);
+      for (int k = 0;  k < 4; k++) data[i+k] = u.a[k];
+  }
+  int remainder = (num - i);
+  if (remainder > 0) {
+      u.l = pio_sm_get_blocking(owp.pio, owp.sm);
+      u.l >>= (32-(remainder*8));
+      for (int k = 0;  k < remainder; k++) data[i+k] = u.a[k];
+  }
+}
+
 // oneWire_pull_read_bytes pulls num bytes from the rx fifo of the PIO state machine and places them in data[]
 // returns 0 if succesfull  It should be paired with a call to oneWire_push_read_cmd() with the same
 // number of bytes.
@@ -196,40 +593,278 @@ oneWire_status oneWire_push_read_bytes_cmd(int num, bool wait) {
 // returns error code if requesting > 16 bytes. No data is read.
 // returns error code if wait = false and the data is not already in the RX fifo.  No data is read.
 // returns error code if there is a CRC failure on the data that is read.
-oneWire_status oneWire_pull_read_bytes(uint8_t data[], int num, bool wait) {
-  union {  // easy conversion from long to bytes
-    uint8_t  a[4];
-    uint32_t l;
-  } u;
+oneWire_status ONE_WIRE_HOT(oneWire_pull_read_bytes)(uint8_t data[], int num, bool wait) {
   if (num > 16) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ; // read requests limited to 16 bytes
   int num_pullsx4 =((num+3));
-  if (!wait && num_pullsx4 > pio_sm_get_rx_fifo_level(owp.pio, owp.sm) * 4) { // is the data there?
+  if (!wait && num_pullsx4 > (int)pio_sm_get_rx_fifo_level(owp.pio, owp.sm) * 4) { // is the data there?
       return ONE_WIRE_NOT_ENOUGH_DATA_IN_RX_FIFO; 
   }
+  oneWire_pull_bytes_raw(data, num);
+  return oneWire_CRC(data, num);
+}
+
+// oneWire_pull_read_bytes_timeout is the same as oneWire_pull_read_bytes with wait = true
+// but gives up if the data does not show up in the Rx FIFO within timeout_us microseconds.
+// On a timeout oneWire_recover() is called before returning.
+// returns 0 if succesfull.
+// returns error code if requesting > 16 bytes. No data is read.
+// returns error code if the timeout expired.
+// returns error code if there is a CRC failure on the data that is read.
+oneWire_status oneWire_pull_read_bytes_timeout(uint8_t data[], int num, uint32_t timeout_us) {
+  if (num > 16) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ; // read requests limited to 16 bytes
+  if (!oneWire_wait_rx_level((num+3)/4, timeout_us)) {
+    oneWire_recover(NULL);
+    return ONE_WIRE_FIFO_TIMEOUT;
+  }
+  return oneWire_pull_read_bytes(data, num, true);
+}
+
+// The aligned read functions below use the pad count of the PIO read command so every 
+// word in the Rx FIFO arrives with the data in the low bits.  Whole words can then be 
+// stored straight into a word aligned buffer with the CRC worked out as they are stored.
+
+// oneWire_push_read_words_cmd issues right aligned read requests to the PIO state machine 
+// to get num bytes.  It should be paired with oneWire_pull_read_words().
+// If wait = true, the function will not return until the data is written to the Tx FIFO.
+// returns 0 if successful.
+// returns error code if requesting > 16 bytes.
+// returns error code if wait = false and there is not enough room in the fifo.
+oneWire_status ONE_WIRE_HOT(oneWire_push_read_words_cmd)(int num, bool wait) {
+  if (num > 16) return ONE_WIRE_POSSIBLE_FIFO_OVERFLOW;
+  if (!wait && (num+3)/4 > 
+      (ONE_WIRE_FIFODEPTH - (int)pio_sm_get_tx_fifo_level(owp.pio, owp.sm))) {
+      return ONE_WIRE_NOT_ENOUGH_TX_FIFO_SPACE;
+  }
   int i;
   for (i = 0;  i <= num-4; i +=  4) {
-      u.l = pio_sm_get_blocking(owp.pio, owp.sm);
-      for (int k = 0;  k < 4; k++) data[i+k] = u.a[k];
+    oneWire_put((31 << 2) + 1);  // issue read of 32 bits
   }
-  int remainder = (num - i);
+  int remainder = num - i;
   if (remainder > 0) {
-      u.l = pio_sm_get_blocking(owp.pio, owp.sm);
-      u.l >>= (32-(remainder*8));
-      for (int k = 0;  k < remainder; k++) data[i+k] = u.a[k];
+    // read remainder * 8 bits then pad the rest of the word with zeros
+    oneWire_put(((32-remainder*8) << 7) + ((remainder*8-1) << 2) + 1);
   }
-  return oneWire_CRC(data, num);
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_pull_read_words pulls num bytes from the Rx FIFO into the word aligned buffer
+// words[] which must hold at least (num+3)/4 words.  Each FIFO word is stored as is
+// so byte k of the read is byte k of the buffer.  The CRC is checked as the words are
+// stored assuming the last byte is the CRC.
+// If wait = true, the function will not return until the data is read from the Rx FIFO.  
+// So if not preceeded with oneWire_push_read_words_cmd, a hang will occure.
+// returns 0 if succesfull.
+// returns error code if requesting > 16 bytes. No data is read.
+// returns error code if wait = false and the data is not already in the RX fifo.  No data is read.
+// returns error code if there is a CRC failure on the data that is read.
+oneWire_status ONE_WIRE_HOT(oneWire_pull_read_words)(uint32_t words[], int num, bool wait) {
+  if (num > 16) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  int num_words = (num+3)/4;
+  if (!wait && num_words > (int)pio_sm_get_rx_fifo_level(owp.pio, owp.sm)) {
+      return ONE_WIRE_NOT_ENOUGH_DATA_IN_RX_FIFO; 
+  }
+  uint8_t crc = 0;
+  for (int i = 0;  i < num_words; i++) {
+    uint32_t w = pio_sm_get_blocking(owp.pio, owp.sm);
+    words[i] = w;
+    int n = (num - i*4) < 4 ? (num - i*4) : 4;
+    for (int k = 0;  k < n; k++, w >>= 8) {
+      crc = oneWire_crc8_table[crc ^ (w & 0xFF)];
+    }
+  }
+  if (crc != 0) return ONE_WIRE_READ_CRC_FAILURE;
+  else return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_read_words() reads num bytes from the device into the word aligned buffer words[].
+// returns 0 if successful;
+// returns error code if request size is > 16 bytes.
+// returns error code if there was a CRC error.
+oneWire_status ONE_WIRE_HOT(oneWire_read_words)(uint32_t words[], int num) {
+  oneWire_status r = oneWire_push_read_words_cmd(num, true);
+  if (r != ONE_WIRE_NO_ERROR) return r;
+  return oneWire_pull_read_words(words, num, true);
 }
 
 // one_wire_read_bytes() reads num bytes from the device and places them in data[].
 // returns 0 if successful;
 // returns error code if request size is > 16 bytes.
 // returns error code if there was a CRC error.
-oneWire_status oneWire_read_bytes(uint8_t data[], int num) {
+oneWire_status ONE_WIRE_HOT(oneWire_read_bytes)(uint8_t data[], int num) {
   oneWire_status r = oneWire_push_read_bytes_cmd(num, true);
   if (r != ONE_WIRE_NO_ERROR) return r;
   return oneWire_pull_read_bytes(data, num, true);
 }
 
+// The detector runs the OneWire_detect program on the other PIO while the OneWire 
+// state machine is paused.  The pin is handed between the two PIOs.
+
+static struct OneWireDetect {
+  PIO pio;
+  uint offset;
+  uint sm;
+  bool loaded;
+  volatile bool running;
+  bool (*callback)(uint64_t rom, oneWire_status stat);
+} owd;
+
+// the detector raised irq 0 so the rom is in the Rx FIFO
+static void oneWire_detect_irq() {
+  union {
+    uint8_t a[8];
+    uint32_t l[2];
+    uint64_t d;
+  } u;
+  pio_interrupt_clear(owd.pio, 0);
+  u.l[0] = pio_sm_get(owd.pio, owd.sm);
+  u.l[1] = pio_sm_get(owd.pio, owd.sm);
+  oneWire_status stat = oneWire_CRC(u.a, 8);
+  if (owd.callback(u.d, stat)) {
+    pio_sm_put(owd.pio, owd.sm, ~0x33u);  // arm again
+  } else {
+    oneWire_detect_stop();
+  }
+}
+
+// oneWire_detect_start pauses the OneWire state machine and starts the detector that
+// sends reset pulses until something touches the bus.  The CPU is not used until 
+// a presence pulse is seen and the rom has been read with read rom.  Then callback is
+// called from the interrupt with the rom and the result of its CRC check.  If the 
+// callback returns true the detector is armed again, otherwise it is stopped.  Don't
+// use any other OneWire function until the detector is stopped.
+// returns 0 if successful.
+// returns error code if there is no room in the other PIO.
+oneWire_status oneWire_detect_start(bool (*callback)(uint64_t rom, oneWire_status stat)) {
+  if (owd.running) return ONE_WIRE_NO_ERROR;
+  if (!owd.loaded) {
+    owd.pio = pio1;
+    if (!pio_can_add_program(owd.pio, &OneWire_detect_program)) return ONE_WIRE_NO_PIO_RESOURCES;
+    int sm = pio_claim_unused_sm(owd.pio, false);
+    if (sm < 0) return ONE_WIRE_NO_PIO_RESOURCES;
+    owd.sm = sm;
+    owd.offset = pio_add_program(owd.pio, &OneWire_detect_program);
+    irq_set_exclusive_handler(PIO1_IRQ_0, oneWire_detect_irq);
+    owd.loaded = true;
+  }
+  owd.callback = callback;
+  oneWire_wait_for_sm_idle();
+  pio_sm_set_enabled(owp.pio, owp.sm, false);
+  OneWire_detect_program_init(owd.pio, owd.sm, owd.offset, ONE_WIRE_GPIO);
+  pio_interrupt_clear(owd.pio, 0);
+  pio_set_irq0_source_enabled(owd.pio, pis_interrupt0, true);
+  irq_set_enabled(PIO1_IRQ_0, true);
+  owd.running = true;
+  pio_sm_put(owd.pio, owd.sm, ~0x33u);  // arm with the inverted read rom command
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_detect_stop stops the detector and gives the pin back to the OneWire 
+// state machine.  A reset or read rom in progress is finished first.  May be 
+// called from the callback.
+void oneWire_detect_stop() {
+  if (!owd.running) return;
+  // don't cut a reset pulse or a slot short.  The detector is waiting to be armed
+  // or in the delay between resets with the bus released.
+  uint pc;
+  do {
+    pc = pio_sm_get_pc(owd.pio, owd.sm) - owd.offset;
+  } while (pc != 0 && pc < OneWire_detect_offset_detect_idle);
+  pio_sm_set_enabled(owd.pio, owd.sm, false);
+  pio_set_irq0_source_enabled(owd.pio, pis_interrupt0, false);
+  pio_sm_clear_fifos(owd.pio, owd.sm);
+  pio_interrupt_clear(owd.pio, 0);
+  pio_gpio_init(owp.pio, ONE_WIRE_GPIO);
+  pio_sm_set_enabled(owp.pio, owp.sm, true);
+  owd.running = false;
+}
+
+// pushes num bytes to the Tx FIFO as write commands.  The write command can carry 
+// up to 16 bits so bytes are sent in pairs.
+static void ONE_WIRE_HOT(oneWire_push_write_bytes)(const uint8_t cmd[], int num) {
+  int i;
+  for (i = 0;  i <= num-2; i += 2) {
+    uint32_t d = cmd[i] | (cmd[i+1] << 8);
+    oneWire_put((d << 6) + (15<<2) + 0x03);
+  }
+  if (i < num) {
+    oneWire_put((cmd[i] << 6) + (7<<2) + 0x03);
+  }
+}
+
+// returns how many bytes at the start of cmd[] are the rom command and the rom that
+// goes with it.  The CRC16 a device sends back only covers what comes after them.
+static int oneWire_rom_cmd_len(const uint8_t cmd[], int cmd_len) {
+  if (cmd_len < 1) return 0;
+  switch (cmd[0]) {
+  case 0x55:  // match rom
+  case 0x69:  // overdrive match rom
+    return (cmd_len < 9) ? cmd_len : 9;
+  case 0xCC:  // skip rom
+  case 0x3C:  // overdrive skip rom
+  case 0xA5:  // resume
+    return 1;
+  }
+  return 0;
+}
+
+// returns the rom of the device left selected by the rom command at the start of
+// cmd[] sent after a reset.  A match rom selects its device and a resume keeps the 
+// one selected before.  Anything else leaves none that is known.
+static uint64_t oneWire_rom_cmd_selects(const uint8_t cmd[], int cmd_len) {
+  if (cmd_len >= 1 && cmd[0] == 0xA5) return selected_rom;
+  if (cmd_len < 9 || cmd[0] != 0x55) return 0;
+  uint64_t rom = 0;
+  for (int i = 8;  i >= 1; i--) rom = (rom << 8) | cmd[i];
+  return rom;
+}
+
+// oneWire_get_selected_rom returns the rom of the device a resume rom (0xA5) would
+// reach.  It is set by a match rom sent with oneWire_transaction() or by the last
+// pass of a search on ONE_WIRE_GPIO, kept by a resume and cleared by any other rom
+// command, by oneWire_reset() and by oneWire_recover().
+// returns 0 if no device is known to be selected.
+uint64_t oneWire_get_selected_rom() {
+  return selected_rom;
+}
+
+// oneWire_transaction() sends the cmd_len bytes in cmd[], optionally preceded by a reset, 
+// then reads read_len bytes into data[] as one uninterrupted sequence on the bus. The bus is 
+// locked for the whole transaction and the commands are pushed to the Tx FIFO back to back
+// so no other caller can get in between the command and the response.  Reads longer than 
+// 16 bytes are pulled in 16 byte pieces as they arrive to keep the FIFOs from overflowing.
+// crc selects how the response is checked.  ONE_WIRE_CRC8 assumes the last byte is a CRC8.
+// ONE_WIRE_CRC16 assumes the last 2 bytes are the inverted CRC16 of the command bytes and 
+// the rest of the data, the way memory and I/O devices send it.  When reset is true the 
+// leading rom command, and the rom after a match rom, are not part of the CRC.
+// returns 0 if successful.
+// returns error code if there is a CRC failure on the data that is read.
+oneWire_status ONE_WIRE_HOT(oneWire_transaction)(bool reset, const uint8_t cmd[], int cmd_len,
+                                   uint8_t data[], int read_len, oneWire_crc_type crc) {
+  oneWire_bus_lock();
+  owp.push_timing = true;
+  owp.push_gap_armed = false;
+  if (reset) {
+    oneWire_put(0x00000002); // issue reset
+    selected_rom = oneWire_rom_cmd_selects(cmd, cmd_len);
+  }
+  oneWire_push_write_bytes(cmd, cmd_len);
+  for (int i = 0;  i < read_len; i += 16) {
+    int num = (read_len - i) < 16 ? (read_len - i) : 16;
+    oneWire_push_read_bytes_cmd(num, true);
+    oneWire_pull_bytes_raw(&data[i], num);
+    owp.push_gap_armed = false;
+  }
+  owp.push_timing = false;
+  oneWire_bus_unlock();
+  if (crc == ONE_WIRE_CRC8) return oneWire_CRC(data, read_len);
+  if (crc == ONE_WIRE_CRC16) {
+    int skip = reset ? oneWire_rom_cmd_len(cmd, cmd_len) : 0;
+    uint16_t seed = (cmd_len > skip) ? oneWire_CRC16(0, &cmd[skip], cmd_len - skip) : 0;
+    return oneWire_CRC16_check(seed, data, read_len);
+  }
+  return ONE_WIRE_NO_ERROR;
+}
+
 // The next set of functions control oneWire interface by
 // direct manipulation of the GPIO pins and so cannot beu sed after 
 // the PIO has been initialized.  There spacific use if for 
@@ -332,6 +967,45 @@ static void oneWire_write_bitBB(bool bit) {
     }
 }
 
+// oneWire_search_direction works out which way the search rom goes at bit given the
+// bit and complement bit read from the bus and updates current and discrepancy.
+// returns the bit to write back or -1 if no device answered.
+static int oneWire_search_direction(uint64_t *current, uint64_t *discrepancy, int bit,
+                                    bool wo1, bool wo2) {
+    if (wo1 ^ wo2) { //no discrepancy
+        if (wo1) *current |= 1ULL << bit;
+        else *current &= ~(1ULL << bit);
+        *discrepancy &= ~(1ULL << bit);
+        return wo1;
+    } else if (wo1 == false && wo2 == false) {
+        if ((*discrepancy & (1ULL << bit)) != 0) {  // was a discrepancy last pass
+            return (*current & (1ULL << bit)) != 0;
+        } else {
+            *current |= 1ULL << bit;
+            *discrepancy |= (1ULL << bit);
+            return 1;
+        }
+    }
+    return -1;  // some kind of error happened.
+}
+
+// oneWire_search_next sets up current for the next search rom pass after
+// a rom has been found.
+// returns false if there are no more discrepancies to follow.
+static bool oneWire_search_next(uint64_t *current, uint64_t *discrepancy) {
+    for (int bit = 63; bit >= 0; bit--) {  
+        if ((*discrepancy & (1ULL << bit)) != 0) {  // if is a discrepancy
+            if ((*current & (1ULL << bit)) != 0) { // if current is 1
+                *current &= ~(1ULL << bit); // set to 0 for next pass
+                return true; // done dealing with descrepancies
+            } else {
+                *discrepancy &= ~(1ULL << bit); // clear the descrepancy
+            }
+        }
+    }
+    return false;
+}
+
 // oneWire_search_rom searches all the devices on the one wire bus and collects
 // the roms for for all the devices.  The roms will be put in the devs array.
 // The pointer to array passed in must be to one that is big enough to handle 
@@ -340,6 +1014,8 @@ static void oneWire_write_bitBB(bool bit) {
 // returns the number of devices it wrote to the devs array if successful.
 // returns error code if a failure occured.
 int oneWire_search_rom(uint64_t devs[]) {
+    search_generation++;
+    selected_rom = 0;
     init_OneWireBB();
     int nextdev = 0;
     uint64_t current = 0;
@@ -349,43 +1025,442 @@ int oneWire_search_rom(uint64_t devs[]) {
         int bit;
         if (!oneWire_resetBB()) return 0; // no devices on the bus.
         oneWire_write_byteBB(0xF0); // search rom command
+        selected_rom = 0;
         for (bit = 0; bit < 64; bit++) {
             bool wo1 = oneWire_read_bitBB();
             bool wo2 = oneWire_read_bitBB();
-            if (wo1 ^ wo2) { //no discrepancy
-                if (wo1) current |= 1ULL << bit;
-                else current &= ~(1ULL << bit);
-                discrepancy &= ~(1ULL << bit);
-                oneWire_write_bitBB(wo1);
-            } else if (wo1 == false && wo2 == false) {
-                if ((discrepancy & (1ULL << bit)) != 0) {  // was a discrepancy last pass
-                    oneWire_write_bitBB((current & (1ULL << bit)) != 0);
-                } else {
-                    current |= 1ULL << bit;
-                    oneWire_write_bitBB(true);
-                    discrepancy |= (1ULL << bit);
-                }
-            } else {
-                return ONE_WIRE_SEARCH_ROM_FAILURE;  // some kind of error happened.
-            }
+            int dir = oneWire_search_direction(&current, &discrepancy, bit, wo1, wo2);
+            if (dir < 0) return ONE_WIRE_SEARCH_ROM_FAILURE;  // some kind of error happened.
+            oneWire_write_bitBB(dir);
         }
         // save off the current rom
         devs[nextdev] = current;
         nextdev++;
+        selected_rom = current;  // the device that finished the pass is selected
         //deal with discrepancy
-        for (bit = 63; bit >= 0; bit--) {  
-            if ((discrepancy & (1ULL << bit)) != 0) {  // if is a discrepancy
-                if ((current & (1ULL << bit)) != 0) { // if current is 1
-                    current &= ~(1ULL << bit); // set to 0 for next pass
-                    break; // done dealing with descrepancies
-                } else {
-                    discrepancy &= ~(1ULL << bit); // clear the descrepancy
+        if (!oneWire_search_next(&current, &discrepancy)) { // all descrpancies cleared so we're done
+            done = true;
+        }
+    }
+    return nextdev;
+}
+
+// oneWire_tripletBB does one bit of a search rom: reads the bit and its complement,
+// lets oneWire_search_branch() pick the direction and writes it back.
+// returns the direction written or -1 if the search failed, in which case nothing 
+// is written.
+static int oneWire_tripletBB(oneWire_search_t *s) {
+    bool id = oneWire_read_bitBB();
+    bool cmp = oneWire_read_bitBB();
+    int dir = oneWire_search_branch(s, id, cmp);
+    if (dir >= 0) oneWire_write_bitBB(dir);
+    return dir;
+}
+
+// oneWire_search_rom_fast finds the same devices as oneWire_search_rom() but keeps 
+// only the position of the last discrepancy between passes.  Each pass follows the 
+// last rom found up to that position, takes the 1 branch there and the 0 branch at any
+// new discrepancy after it so no mask has to be walked at the end of a pass.  The
+// branch logic is in OneWireSearch.c.
+// At most max_devs roms are put in devs[].  If stats is not NULL the passes and slots
+// issued are put there.
+// If a call to this function is needed it must be done before init_OneWire(). 
+// returns the number of devices it wrote to the devs array if successful.
+// returns error code if a failure occured or max_devs is less than 1.  A bus that 
+// stops answering the reset part way through the search is a failure.
+int oneWire_search_rom_fast(uint64_t devs[], int max_devs, oneWire_search_stats_t *stats) {
+    search_generation++;
+    selected_rom = 0;
+    if (max_devs < 1) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+    init_OneWireBB();
+    busy_wait_us_32(100);
+    int nextdev = 0;
+    int result = 0;
+    oneWire_search_t s;
+    oneWire_search_init(&s);
+    bool more = true;
+    while (more && nextdev < max_devs) {
+        if (!oneWire_resetBB()) { // no devices on the bus.
+            if (nextdev > 0) result = ONE_WIRE_SEARCH_ROM_FAILURE;  // they left mid search
+            break;
+        }
+        oneWire_search_start_pass(&s);
+        oneWire_write_byteBB(0xF0); // search rom command
+        selected_rom = 0;
+        for (int bit = 0; bit < 64 && result == 0; bit++) {
+            if (oneWire_tripletBB(&s) < 0) result = ONE_WIRE_SEARCH_ROM_FAILURE;
+        }
+        if (result != 0) break;
+        devs[nextdev++] = s.rom;
+        selected_rom = s.rom;  // the device that finished the pass is selected
+        more = oneWire_search_end_pass(&s);
+    }
+    if (stats != NULL) {
+        stats->passes = s.passes;
+        stats->slots = s.slots;
+    }
+    return result != 0 ? result : nextdev;
+}
+
+// The multi bus search below drives the slots on every bus at the same time using the
+// GPIO masks so all buses are searched in parallel.  Each bus keeps its own search
+// state and a bus that is finished or failed is just left idle.
+
+#define ONE_WIRE_MAX_BUSES 16
+#define ONE_WIRE_NUM_GPIOS 30
+
+// drives a read slot on every pin in mask and returns the state of all the pins
+static uint32_t oneWire_read_slot_maskBB(uint32_t mask) {
+    gpio_set_dir_out_masked(mask);
+    busy_wait_us_32(ONE_WIRE_READ_PULSE);
+    gpio_set_dir_in_masked(mask);
+    busy_wait_us_32(ONE_WIRE_READ_SAMPLE);
+    uint32_t bits = gpio_get_all();
+    busy_wait_us_32(ONE_WIRE_POST_READ);
+    return bits;
+}
+
+// drives a write slot on every pin in mask.  Pins also in ones get a 1 and the rest a 0.
+static void oneWire_write_slot_maskBB(uint32_t mask, uint32_t ones) {
+    gpio_set_dir_out_masked(mask);
+    busy_wait_us_32(ONE_WIRE_WRITE_1);
+    gpio_set_dir_in_masked(mask & ones);
+    busy_wait_us_32(ONE_WIRE_WRITE_0 - ONE_WIRE_WRITE_1);
+    gpio_set_dir_in_masked(mask);
+    busy_wait_us_32(ONE_WIRE_POST_WRITE_0);
+}
+
+// resets every bus in mask and returns the mask of buses that had a presence pulse
+static uint32_t oneWire_reset_maskBB(uint32_t mask) {
+    gpio_set_dir_out_masked(mask);
+    busy_wait_us_32(ONE_WIRE_RESET_PULSE);
+    gpio_set_dir_in_masked(mask);
+    busy_wait_us_32(70);
+    uint32_t present = ~gpio_get_all() & mask;
+    busy_wait_us_32(ONE_WIRE_PRESENCE_WAIT - 70);
+    return present;
+}
+
+// oneWire_search_rom_multi searches num_buses buses, one per pin in pins[], at the same 
+// time.  Every bus gets the same last discrepancy search as oneWire_search_rom_fast() 
+// but the slots for all buses run together so the total time is that of the bus with 
+// the most devices rather than the sum.  Up to max_devs roms for bus i are put in devs[i] 
+// and the number found, or an error code, is put in counts[i].  A bus that stops 
+// answering the reset part way through the search gets ONE_WIRE_SEARCH_ROM_FAILURE.
+// If a call to this function is needed it must be done before the PIO takes the pins.
+// returns the number of devices found on all buses.
+// returns error code if num_buses is out of range or max_devs is less than 1.
+// returns ONE_WIRE_BAD_PIN if a pin is not a GPIO or is in pins[] twice.
+int oneWire_search_rom_multi(const uint pins[], int num_buses, uint64_t *devs[], 
+                             int max_devs, int counts[]) {
+    search_generation++;
+    selected_rom = 0;
+    if (num_buses < 1 || num_buses > ONE_WIRE_MAX_BUSES) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+    if (max_devs < 1) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+    oneWire_search_t search[ONE_WIRE_MAX_BUSES];
+    uint32_t all = 0;
+    for (int b = 0;  b < num_buses; b++) {
+        if (pins[b] >= ONE_WIRE_NUM_GPIOS || (all & (1u << pins[b])) != 0) return ONE_WIRE_BAD_PIN;
+        all |= 1u << pins[b];
+    }
+    for (int b = 0;  b < num_buses; b++) {
+        oneWire_search_init(&search[b]);
+        counts[b] = 0;
+    }
+    // init GPIO pins to tristate out but output of 0
+    gpio_init_mask(all);
+    gpio_set_dir_in_masked(all);
+    gpio_clr_mask(all);
+    busy_wait_us_32(100);
+    uint32_t active = all;  // buses that still have devices to find
+    while (active != 0) {
+        uint32_t present = oneWire_reset_maskBB(active);
+        for (int b = 0;  b < num_buses; b++) {
+            uint32_t m = 1u << pins[b];
+            if ((present & m) != 0) {
+                oneWire_search_start_pass(&search[b]);
+            } else if ((active & m) != 0 && search[b].passes > 0) {
+                counts[b] = ONE_WIRE_SEARCH_ROM_FAILURE; // devices left mid search
+            }
+        }
+        active = present;   // buses with nothing on them are done
+        // search rom command
+        for (int i = 0;  i < 8; i++) {
+            oneWire_write_slot_maskBB(active, ((0xF0 >> i) & 1) ? active : 0);
+        }
+        for (int bit = 0;  bit < 64 && active != 0; bit++) {
+            uint32_t id = oneWire_read_slot_maskBB(active);
+            uint32_t cmp = oneWire_read_slot_maskBB(active);
+            uint32_t ones = 0;
+            for (int b = 0;  b < num_buses; b++) {
+                uint32_t m = 1u << pins[b];
+                if ((active & m) == 0) continue;
+                int dir = oneWire_search_branch(&search[b], (id & m) != 0, (cmp & m) != 0);
+                if (dir < 0) { // nobody answered so drop this bus
+                    counts[b] = ONE_WIRE_SEARCH_ROM_FAILURE;
+                    active &= ~m;
+                } else if (dir) {
+                    ones |= m;
                 }
             }
+            oneWire_write_slot_maskBB(active, ones);
         }
-        if (bit < 0) { // all descrpancies cleared so we're done
-            done = true;
+        // save the roms found this pass and retire the buses that are done
+        for (int b = 0;  b < num_buses; b++) {
+            uint32_t m = 1u << pins[b];
+            if ((active & m) == 0) continue;
+            devs[b][counts[b]++] = search[b].rom;
+            if (!oneWire_search_end_pass(&search[b]) || counts[b] >= max_devs) active &= ~m;
         }
     }
-    return nextdev;
+    int total = 0;
+    for (int b = 0;  b < num_buses; b++) {
+        if (counts[b] > 0) total += counts[b];
+    }
+    return total;
+}
+
+// The next set of functions run the same bit bang slots from a hardware timer 
+// alarm instead of busy waits.  Each edge on the wire is one alarm interrupt and
+// the CPU is free between edges.  This is for a pin that does not have a PIO
+// state machine.  Like the bit bang functions above they can't be used on a pin
+// the PIO state machine is driving.
+
+#define ONE_WIRE_PRESENCE_SAMPLE 70
+
+#define OW_TMR_RESET 0
+#define OW_TMR_WRITE 1
+#define OW_TMR_READ  2
+
+#define OW_TMR_SEARCH_RESET 0
+#define OW_TMR_SEARCH_CMD   1
+#define OW_TMR_SEARCH_ID    2
+#define OW_TMR_SEARCH_CMP   3
+#define OW_TMR_SEARCH_DIR   4
+
+static struct OneWireTimer {
+  uint pin;
+  uint alarm;
+  absolute_time_t target;  // when the current edge should have happened
+  // slot being run
+  uint8_t slot;
+  uint8_t phase;
+  bool bit;                // bit to write, bit read or presence found
+  // search rom state
+  uint8_t stage;
+  int bit_num;
+  bool id_bit;
+  uint64_t current;
+  uint64_t discrepancy;
+  uint64_t *devs;
+  int max_devs;
+  int num_devs;
+  volatile bool busy;
+  int result;
+  uint64_t start_us;
+  oneWire_timer_stats_t stats;
+} owt;
+
+static uint32_t oneWire_timer_edge();
+
+// starts the next slot of the search rom.  Called at the end of each slot.
+// returns false if the search is finished.
+static bool oneWire_timer_search_step() {
+  switch (owt.stage) {
+  case OW_TMR_SEARCH_RESET:
+    if (!owt.bit) { // no devices on the bus
+      owt.result = owt.num_devs > 0 ? ONE_WIRE_SEARCH_ROM_FAILURE : 0;  // or they left mid search
+      return false;
+    }
+    owt.stage = OW_TMR_SEARCH_CMD;
+    owt.bit_num = 0;
+    owt.slot = OW_TMR_WRITE;
+    owt.bit = 0xF0 & 1;  // search rom command
+    break;
+  case OW_TMR_SEARCH_CMD:
+    if (++owt.bit_num < 8) {
+      owt.slot = OW_TMR_WRITE;
+      owt.bit = (0xF0 >> owt.bit_num) & 1;
+      break;
+    }
+    owt.bit_num = 0;
+    owt.stage = OW_TMR_SEARCH_ID;
+    owt.slot = OW_TMR_READ;
+    break;
+  case OW_TMR_SEARCH_ID:
+    owt.id_bit = owt.bit;
+    owt.stage = OW_TMR_SEARCH_CMP;
+    owt.slot = OW_TMR_READ;
+    break;
+  case OW_TMR_SEARCH_CMP: {
+    int dir = oneWire_search_direction(&owt.current, &owt.discrepancy, owt.bit_num,
+                                       owt.id_bit, owt.bit);
+    if (dir < 0) {
+      owt.result = ONE_WIRE_SEARCH_ROM_FAILURE;
+      return false;
+    }
+    owt.stage = OW_TMR_SEARCH_DIR;
+    owt.slot = OW_TMR_WRITE;
+    owt.bit = dir;
+    break;
+  }
+  case OW_TMR_SEARCH_DIR:
+    if (++owt.bit_num < 64) {
+      owt.stage = OW_TMR_SEARCH_ID;
+      owt.slot = OW_TMR_READ;
+      break;
+    }
+    owt.devs[owt.num_devs++] = owt.current;
+    if (owt.num_devs >= owt.max_devs || 
+        !oneWire_search_next(&owt.current, &owt.discrepancy)) {
+      owt.result = owt.num_devs;
+      return false;
+    }
+    owt.stage = OW_TMR_SEARCH_RESET;
+    owt.slot = OW_TMR_RESET;
+    break;
+  }
+  owt.phase = 0;
+  return true;
+}
+
+// does the next edge of the current slot.  
+// returns the time in us to the following edge or 0 if the search is finished.
+static uint32_t oneWire_timer_edge() {
+  switch (owt.slot) {
+  case OW_TMR_RESET:
+    switch (owt.phase++) {
+    case 0:
+      gpio_set_dir(owt.pin, GPIO_OUT);
+      return ONE_WIRE_RESET_PULSE;
+    case 1:
+      gpio_set_dir(owt.pin, GPIO_IN);
+      return ONE_WIRE_PRESENCE_SAMPLE;
+    case 2:
+      owt.bit = !gpio_get(owt.pin);
+      return ONE_WIRE_PRESENCE_WAIT - ONE_WIRE_PRESENCE_SAMPLE;
+    }
+    break;
+  case OW_TMR_WRITE:
+    switch (owt.phase++) {
+    case 0:
+      gpio_set_dir(owt.pin, GPIO_OUT);
+      return owt.bit ? ONE_WIRE_WRITE_1 : ONE_WIRE_WRITE_0;
+    case 1:
+      gpio_set_dir(owt.pin, GPIO_IN);
+      return owt.bit ? ONE_WIRE_POST_WRITE_1 : ONE_WIRE_POST_WRITE_0;
+    }
+    break;
+  case OW_TMR_READ:
+    switch (owt.phase++) {
+    case 0:
+      gpio_set_dir(owt.pin, GPIO_OUT);
+      return ONE_WIRE_READ_PULSE;
+    case 1:
+      gpio_set_dir(owt.pin, GPIO_IN);
+      return ONE_WIRE_READ_SAMPLE;
+    case 2:
+      owt.bit = gpio_get(owt.pin);
+      return ONE_WIRE_POST_READ;
+    }
+    break;
+  }
+  // the slot is over so start the next one right away
+  if (!oneWire_timer_search_step()) return 0;
+  return oneWire_timer_edge();
+}
+
+// alarm interrupt.  Times are kept relative to when each edge should have happened
+// so interrupt latency shows up as jitter but does not build up over the search.
+static void oneWire_timer_callback(uint alarm) {
+  uint64_t entry = time_us_64();
+  uint32_t late = entry - to_us_since_boot(owt.target);
+  if (late > owt.stats.max_late_us) owt.stats.max_late_us = late;
+  owt.stats.late_us_total += late;
+  do {
+    owt.stats.edges++;
+    uint32_t delay = oneWire_timer_edge();
+    if (delay == 0) { // all done
+      owt.stats.total_us = time_us_64() - owt.start_us;
+      owt.busy = false;
+      __sev();  // wake oneWire_search_rom_timer() even if it was just about to sleep
+      break;
+    }
+    owt.target = delayed_by_us(owt.target, delay);
+  } while (hardware_alarm_set_target(alarm, owt.target)); // missed so do it now
+  owt.stats.isr_us += time_us_64() - entry;
+}
+
+// oneWire_timer_search_start starts a search rom on pin that is run from a hardware
+// timer alarm so the CPU is free between edges.  Up to max_devs roms are put in devs[] 
+// which must stay valid until the search is done.  Use oneWire_timer_search_done() to
+// find out when it is finished.  
+// returns 0 if the search was started.
+// returns error code if max_devs is less than 1 or no hardware alarm is free.
+oneWire_status oneWire_timer_search_start(uint pin, uint64_t devs[], int max_devs) {
+  if (max_devs < 1) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  search_generation++;
+  selected_rom = 0;
+  int alarm = hardware_alarm_claim_unused(false);
+  if (alarm < 0) return ONE_WIRE_SEARCH_ROM_FAILURE;
+  owt.pin = pin;
+  owt.alarm = alarm;
+  owt.devs = devs;
+  owt.max_devs = max_devs;
+  owt.num_devs = 0;
+  owt.current = 0;
+  owt.discrepancy = 0;
+  owt.stage = OW_TMR_SEARCH_RESET;
+  owt.slot = OW_TMR_RESET;
+  owt.phase = 0;
+  owt.stats = (oneWire_timer_stats_t){0};
+  owt.busy = true;
+  // init GPIO pin to tristate out but output of 0
+  gpio_init(pin);
+  gpio_set_dir(pin, GPIO_IN);
+  gpio_put(pin, 0);
+  hardware_alarm_set_callback(alarm, oneWire_timer_callback);
+  owt.start_us = time_us_64();
+  owt.target = make_timeout_time_us(100);
+  if (hardware_alarm_set_target(alarm, owt.target)) oneWire_timer_callback(alarm);
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_timer_search_done checks on a search started with oneWire_timer_search_start().
+// returns false if the search is still running.
+// returns true when it is done and sets *result to the number of roms found or an error code.
+bool oneWire_timer_search_done(int *result) {
+  if (owt.busy) return false;
+  hardware_alarm_set_callback(owt.alarm, NULL);
+  hardware_alarm_unclaim(owt.alarm);
+  *result = owt.result;
+  return true;
+}
+
+// oneWire_search_rom_timer does the same search as oneWire_search_rom() but on any pin
+// and from a timer alarm.  It sleeps between edges with __wfe() so other interrupts can
+// be serviced, the last edge sends an event so the end of the search can't be missed.
+// At most max_devs roms are put in devs[].
+// returns the number of devices it wrote to the devs array if successful.
+// returns error code if a failure occured or max_devs is less than 1.  A bus that 
+// stops answering the reset part way through the search is a failure.
+int oneWire_search_rom_timer(uint pin, uint64_t devs[], int max_devs) {
+  int result;
+  if (max_devs < 1) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  oneWire_status r = oneWire_timer_search_start(pin, devs, max_devs);
+  if (r != ONE_WIRE_NO_ERROR) return ONE_WIRE_SEARCH_ROM_FAILURE;
+  while (!oneWire_timer_search_done(&result)) __wfe();
+  return result;
+}
+
+// oneWire_get_search_generation returns a count that goes up every time a search rom
+// is started by any of the search functions.
+uint32_t oneWire_get_search_generation() {
+  return search_generation;
+}
+
+// oneWire_get_timer_stats returns the timing of the last timer driven search.  CPU 
+// occupancy is isr_us / total_us.  max_late_us is the worst jitter of an edge. 
+void oneWire_get_timer_stats(oneWire_timer_stats_t *stats) {
+  *stats = owt.stats;
 }
@@ -11,6 +11,44 @@
 
 typedef uint16_t oneWire_status;
 
+// oneWire_recovery_t reports what oneWire_recover() threw away to get the 
+// state machine back in sync.
+typedef struct oneWire_recovery {
+  uint tx_discarded;   // commands still waiting in the Tx FIFO
+  uint rx_discarded;   // read results nobody pulled from the Rx FIFO
+  uint32_t time_us;    // how long the recovery took
+} oneWire_recovery_t;
+
+// oneWire_crc_type selects how oneWire_transaction() checks the response.
+typedef enum oneWire_crc_type {
+  ONE_WIRE_CRC_NONE,
+  ONE_WIRE_CRC8,
+  ONE_WIRE_CRC16
+} oneWire_crc_type;
+
+// oneWire_timer_stats_t reports the timing of a search run by the timer alarm engine.
+typedef struct oneWire_timer_stats {
+  uint32_t total_us;       // start to finish
+  uint32_t isr_us;         // time spent in the alarm interrupt
+  uint32_t edges;          // number of edges driven or sampled
+  uint32_t max_late_us;    // worst lateness of an edge 
+  uint32_t late_us_total;  // sum of the lateness of every edge
+} oneWire_timer_stats_t;
+
+// oneWire_search_stats_t reports the bus use of oneWire_search_rom_fast().  Each pass
+// is one reset plus the slots it issued.  slots / devices found is the cost per device.
+typedef struct oneWire_search_stats {
+  uint32_t passes;
+  uint32_t slots;
+} oneWire_search_stats_t;
+
+// Default timeout for the timed pull functions.  A 16 byte read takes
+// about 8ms on the wire so this leaves plenty of margin.
+#define ONE_WIRE_PULL_TIMEOUT_US 20000
+
+// The state machine clock the OneWire_overdrive program is timed for, 0.25us a cycle.
+#define ONE_WIRE_OVERDRIVE_HZ 4000000
+
 // oneWire_search_rom searches all the devices on the one wire bus and collects
 // the roms for for all the devices.  The roms will be put in the devs array.
 // The pointer to array passed in must be to one that is big enough to handle 
@@ -20,16 +58,113 @@ typedef uint16_t oneWire_status;
 // returns error code if a failure occured.
 int oneWire_search_rom(uint64_t devs[]);
 
+// oneWire_search_rom_fast finds the same devices as oneWire_search_rom() but keeps 
+// only the position of the last discrepancy between passes.  Each pass follows the 
+// last rom found up to that position, takes the 1 branch there and the 0 branch at any
+// new discrepancy after it so no mask has to be walked at the end of a pass.  The
+// branch logic is in OneWireSearch.c.
+// At most max_devs roms are put in devs[].  If stats is not NULL the passes and slots
+// issued are put there.
+// If a call to this function is needed it must be done before init_OneWire(). 
+// returns the number of devices it wrote to the devs array if successful.
+// returns error code if a failure occured or max_devs is less than 1.  A bus that 
+// stops answering the reset part way through the search is a failure.
+int oneWire_search_rom_fast(uint64_t devs[], int max_devs, oneWire_search_stats_t *stats);
+
+// oneWire_search_rom_multi searches num_buses buses, one per pin in pins[], at the same 
+// time.  Every bus gets the same last discrepancy search as oneWire_search_rom_fast() 
+// but the slots for all buses run together so the total time is that of the bus with 
+// the most devices rather than the sum.  Up to max_devs roms for bus i are put in devs[i] 
+// and the number found, or an error code, is put in counts[i].  A bus that stops 
+// answering the reset part way through the search gets ONE_WIRE_SEARCH_ROM_FAILURE.
+// If a call to this function is needed it must be done before the PIO takes the pins.
+// returns the number of devices found on all buses.
+// returns error code if num_buses is out of range or max_devs is less than 1.
+// returns ONE_WIRE_BAD_PIN if a pin is not a GPIO or is in pins[] twice.
+int oneWire_search_rom_multi(const uint pins[], int num_buses, uint64_t *devs[], 
+                             int max_devs, int counts[]);
+
+// oneWire_search_rom_timer does the same search as oneWire_search_rom() but on any pin
+// and from a timer alarm.  It sleeps between edges with __wfe() so other interrupts can
+// be serviced, the last edge sends an event so the end of the search can't be missed.
+// At most max_devs roms are put in devs[].
+// returns the number of devices it wrote to the devs array if successful.
+// returns error code if a failure occured or max_devs is less than 1.  A bus that 
+// stops answering the reset part way through the search is a failure.
+int oneWire_search_rom_timer(uint pin, uint64_t devs[], int max_devs);
+
+// oneWire_timer_search_start starts a search rom on pin that is run from a hardware
+// timer alarm so the CPU is free between edges.  Up to max_devs roms are put in devs[] 
+// which must stay valid until the search is done.  Use oneWire_timer_search_done() to
+// find out when it is finished.  
+// returns 0 if the search was started.
+// returns error code if max_devs is less than 1 or no hardware alarm is free.
+oneWire_status oneWire_timer_search_start(uint pin, uint64_t devs[], int max_devs);
+
+// oneWire_timer_search_done checks on a search started with oneWire_timer_search_start().
+// returns false if the search is still running.
+// returns true when it is done and sets *result to the number of roms found or an error code.
+bool oneWire_timer_search_done(int *result);
+
+// oneWire_get_timer_stats returns the timing of the last timer driven search.  CPU 
+// occupancy is isr_us / total_us.  max_late_us is the worst jitter of an edge. 
+void oneWire_get_timer_stats(oneWire_timer_stats_t *stats);
+
+// oneWire_get_search_generation returns a count that goes up every time a search rom
+// is started by any of the search functions.
+uint32_t oneWire_get_search_generation();
+
 // init_OneWire inits the PIO0 state machine to implement a OneWire interface the pin
 // define in ONE_WIRE_GPIO.  Call this fuction after oneWire_Search_Rom().
 void init_OneWire();
 
+// oneWire_wait_for_sm_idle waits until the state machine has run every command pushed
+// to it and is waiting at the top of the program for the next one.
+void oneWire_wait_for_sm_idle();
+
+// oneWire_get_selected_rom returns the rom of the device a resume rom (0xA5) would
+// reach.  It is set by a match rom sent with oneWire_transaction() or by the last
+// pass of a search on ONE_WIRE_GPIO, kept by a resume and cleared by any other rom
+// command, by oneWire_reset() and by oneWire_recover().
+// returns 0 if no device is known to be selected.
+uint64_t oneWire_get_selected_rom();
+
+// oneWire_set_overdrive switches the state machine between standard and overdrive 
+// speed.  Overdrive swaps in the OneWire_overdrive program, which has its own slot
+// timing, in place of OneWire.  Both fill the instruction memory so only one is 
+// loaded at a time.
+// Send overdrive skip rom (0x3C) or overdrive match rom (0x69) at standard speed first.
+// Going back to standard speed, the next reset puts the devices back at standard speed.
+// Waits for any commands already pushed to finish before changing the program.
+void oneWire_set_overdrive(bool on);
+
+// oneWire_detect_start pauses the OneWire state machine and starts the detector that
+// sends reset pulses until something touches the bus.  The CPU is not used until 
+// a presence pulse is seen and the rom has been read with read rom.  Then callback is
+// called from the interrupt with the rom and the result of its CRC check.  If the 
+// callback returns true the detector is armed again, otherwise it is stopped.  Don't
+// use any other OneWire function until the detector is stopped.
+// returns 0 if successful.
+// returns error code if there is no room in the other PIO.
+oneWire_status oneWire_detect_start(bool (*callback)(uint64_t rom, oneWire_status stat));
+
+// oneWire_detect_stop stops the detector and gives the pin back to the OneWire 
+// state machine.  A reset or read rom in progress is finished first.  May be 
+// called from the callback.
+void oneWire_detect_stop();
+
 // oneWire_reset issues a reset command to the devices on the OneWire bus.
 // If wait = true, the function will not return until the command is written to the Tx FIFO.
 // returms 0 if successful.
 // returns error code it not wait=false and no room in Tx fifo.
 oneWire_status oneWire_reset(bool wait);
 
+// oneWire_reset_presence issues a reset and watches the pin while the state machine 
+// runs it, the same as oneWire_reset() but the caller learns if anyone answered.
+// Commands already pushed are finished first.  Only works at standard speed.
+// returns true if a presence pulse was seen.
+bool oneWire_reset_presence();
+
 // oneWire_wait_for_idle issues a woit for idle bus command
 // If wait = true, the function will not return until the data is written to the Tx FIFO.
 // returms 0 if successful.
@@ -37,17 +172,34 @@ oneWire_status oneWire_reset(bool wait);
 oneWire_status oneWire_wait_for_idle(bool wait);
 
 // oneWire_write_byte writes a single byte tp the onewire bus.
-// If wait = true, the function will not return until the data is written to the Tx FIFO.
+// Consecutive writes are packed 16 bits to a Tx FIFO word, so the byte may be held 
+// back until the next write, read, reset or wait, a bus unlock or a call to 
+// oneWire_flush().  While a byte is held back the caller keeps the bus lock.
+// If wait = true, the function will not return until the data is written to the Tx FIFO
+// or held back.
 // returms 0 if successful.
 // returns error code it not wait=false and no room in Tx fifo.
 oneWire_status oneWire_write_byte(uint8_t, bool wait);
 
-// oneWire_write_uint writes a single unsigned int to the OneWire bus.
-// If wait = true, the function will not return until the data is written to the Tx FIFO.
+// oneWire_write_uint writes a single unsigned int to the OneWire bus, low byte first.
+// It is packed with any held back write the same as oneWire_write_byte().
+// If wait = true, the function will not return until the data is written to the Tx FIFO
+// or held back.
 // returms 0 if successful
 // returns error code it not wait=false and no room in Tx fifo.
 oneWire_status oneWire_write_uint(uint16_t data, bool wait);
 
+// oneWire_flush pushes any writes held back by oneWire_write_byte() or 
+// oneWire_write_uint() to the Tx FIFO and gives back the bus lock they kept.  Only 
+// needed when nothing else is going to be sent for a while, e.g. after a convert 
+// command, since every read, reset, wait, transaction and bus unlock flushes first.
+void oneWire_flush();
+
+// oneWire_get_coalesced_writes returns the number of write calls since the last clear 
+// that were packed into another write instead of taking a Tx FIFO word of their own.
+// If clear = true the count is reset after it is read.
+uint32_t oneWire_get_coalesced_writes(bool clear);
+
 // oneWire_push_read_cmd issues a command to read a certain number of bits.  
 // The resulting data is placed int the Rx FIFO where it can be read with 
 // oneWire_pull_read_data. 
@@ -63,6 +215,57 @@ oneWire_status oneWire_push_read_cmd(uint num_bits);
 // returns the data in the fifo.
 uint32_t oneWire_pull_read_data(uint num_bits);
 
+// oneWire_pull_read_data_timeout is the same as oneWire_pull_read_data but gives up if no 
+// data shows up in the Rx FIFO within timeout_us microseconds.  On a timeout the 
+// FIFOs are out of sync so oneWire_recover() is called before returning.
+// returns 0 if successful and the data is placed in *data.
+// returns error code if the timeout expired.
+oneWire_status oneWire_pull_read_data_timeout(uint num_bits, uint32_t *data, uint32_t timeout_us);
+
+// oneWire_bus_lock takes ownership of the bus so a sequence of calls can't be 
+// interleaved with calls from another context.  oneWire_transaction() takes
+// the lock by itself.  The lock can be nested.
+void oneWire_bus_lock();
+
+// oneWire_bus_unlock releases the bus taken with oneWire_bus_lock().  Any writes held
+// back by the coalescer are pushed first so they can't end up in someone else's 
+// sequence.
+void oneWire_bus_unlock();
+
+// oneWire_recover gets the state machine back to a known state without a reboot when
+// a push and a pull did not pair up.  Both FIFOs are drained, the state machine is 
+// restarted at the start of the program and the bus is released.  A bus left in 
+// overdrive is put back at standard speed.  If info is not NULL
+// what was discarded is reported there.  Any transaction in flight is lost so the 
+// caller should start over with a reset.
+// returns 0.
+oneWire_status oneWire_recover(oneWire_recovery_t *info);
+
+// oneWire_get_last_recovery returns the report from the last oneWire_recover() call
+// including the ones made by the timed pull functions.  
+// returns the number of recoveries done since init_OneWire().
+uint oneWire_get_last_recovery(oneWire_recovery_t *info);
+
+// oneWire_get_max_push_gap returns the longest time in microseconds the CPU took between
+// two Tx FIFO pushes inside oneWire_transaction() since the last clear.  Build once with
+// and once without ONE_WIRE_RAM_HOT_PATH to see what XIP cache misses cost.  Only 
+// measured when built with ONE_WIRE_PUSH_TIMING, otherwise always returns 0.
+// If clear = true the maximum is reset after it is read.
+uint32_t oneWire_get_max_push_gap(bool clear);
+
+// oneWire_tx_stalled returns true if the state machine has waited on an empty Tx FIFO
+// since the last clear, which means the bus sat idle waiting for the processor.  Uses
+// the TXSTALL bit of the PIO FDEBUG register.
+// If clear = true the bit is cleared after it is read.
+bool oneWire_tx_stalled(bool clear);
+
+// oneWire_pull_read_word pulls one 32 bit read from the Rx FIFO with no shift.  It
+// should be paired with a 32 bit read such as oneWire_push_read_words_cmd(4, wait).
+// If wait = true, the function will not return until there is data in the RX fifo.
+// returns 0 if successful and the data is placed in *data.
+// returns error code if wait = false and the Rx FIFO is empty.
+oneWire_status oneWire_pull_read_word(uint32_t *data, bool wait);
+
 // oneWire_read_byte reads one byte of data  No CRC check is performend.
 // If wait = true, the function will not return until the data is written to the Tx FIFO.
 // returms 0 if successful.
@@ -86,6 +289,18 @@ oneWire_status oneWire_read_ulong (uint32_t *data, bool wait);
 // return error code if check fails.
 oneWire_status oneWire_CRC(uint8_t a[], int len);
 
+// oneWire_CRC16 continues a CRC16 (x^16 + x^15 + x^2 + 1) calculation over len bytes 
+// starting from crc.  Start a new calculation with crc = 0.
+// returns the updated CRC.
+uint16_t oneWire_CRC16(uint16_t crc, const uint8_t a[], int len);
+
+// Performs the CRC16 check assuming the last two bytes are the inverted CRC16 sent 
+// by the device LSB first.  crc is the CRC of any bytes the device included in the 
+// CRC that are not in a[], usually the command bytes, or 0 if none.
+// return 0 if CRC check is OK
+// return error code if check fails.
+oneWire_status oneWire_CRC16_check(uint16_t crc, const uint8_t a[], int len);
+
 // The OneWire PIO state machine takes read requests from 1 to 32 bits.  The read_bytes fuctions
 // below convert the requested number of bytes to be read into individual PIO read requests
 // minimizing the total number of requests and fifo depth need.
@@ -108,12 +323,64 @@ oneWire_status oneWire_push_read_bytes_cmd(int num, bool wait);
 // returns error code if there is a CRC failure on the data that is read.
 oneWire_status oneWire_pull_read_bytes(uint8_t data[], int num, bool wait);
 
+// oneWire_pull_read_bytes_timeout is the same as oneWire_pull_read_bytes with wait = true
+// but gives up if the data does not show up in the Rx FIFO within timeout_us microseconds.
+// On a timeout oneWire_recover() is called before returning.
+// returns 0 if succesfull.
+// returns error code if requesting > 16 bytes. No data is read.
+// returns error code if the timeout expired.
+// returns error code if there is a CRC failure on the data that is read.
+oneWire_status oneWire_pull_read_bytes_timeout(uint8_t data[], int num, uint32_t timeout_us);
+
 // one_wire_read_bytes() reads num bytes from the device and places them in data[].
 // returns 0 if successful;
 // returns error code if request size is > 16 bytes.
 // returns error code if there was a CRC error.
 oneWire_status oneWire_read_bytes(uint8_t data[], int num);
 
+// The aligned read functions below use the pad count of the PIO read command so every 
+// word in the Rx FIFO arrives with the data in the low bits.  Whole words can then be 
+// stored straight into a word aligned buffer with the CRC worked out as they are stored.
+
+// oneWire_push_read_words_cmd issues right aligned read requests to the PIO state machine 
+// to get num bytes.  It should be paired with oneWire_pull_read_words().
+// If wait = true, the function will not return until the data is written to the Tx FIFO.
+// returns 0 if successful.
+// returns error code if requesting > 16 bytes.
+// returns error code if wait = false and there is not enough room in the fifo.
+oneWire_status oneWire_push_read_words_cmd(int num, bool wait);
+
+// oneWire_pull_read_words pulls num bytes from the Rx FIFO into the word aligned buffer
+// words[] which must hold at least (num+3)/4 words.  Each FIFO word is stored as is
+// so byte k of the read is byte k of the buffer.  The CRC is checked as the words are
+// stored assuming the last byte is the CRC.
+// If wait = true, the function will not return until the data is read from the Rx FIFO.  
+// So if not preceeded with oneWire_push_read_words_cmd, a hang will occure.
+// returns 0 if succesfull.
+// returns error code if requesting > 16 bytes. No data is read.
+// returns error code if wait = false and the data is not already in the RX fifo.  No data is read.
+// returns error code if there is a CRC failure on the data that is read.
+oneWire_status oneWire_pull_read_words(uint32_t words[], int num, bool wait);
+
+// oneWire_read_words() reads num bytes from the device into the word aligned buffer words[].
+// returns 0 if successful;
+// returns error code if request size is > 16 bytes.
+// returns error code if there was a CRC error.
+oneWire_status oneWire_read_words(uint32_t words[], int num);
+
+// oneWire_transaction() sends the cmd_len bytes in cmd[], optionally preceded by a reset, 
+// then reads read_len bytes into data[] as one uninterrupted sequence on the bus. The bus is 
+// locked for the whole transaction and the commands are pushed to the Tx FIFO back to back
+// so no other caller can get in between the command and the response.  Reads longer than 
+// 16 bytes are pulled in 16 byte pieces as they arrive to keep the FIFOs from overflowing.
+// crc selects how the response is checked.  ONE_WIRE_CRC8 assumes the last byte is a CRC8.
+// ONE_WIRE_CRC16 assumes the last 2 bytes are the inverted CRC16 of the command bytes and 
+// the rest of the data, the way memory and I/O devices send it.  When reset is true the 
+// leading rom command, and the rom after a match rom, are not part of the CRC.
+// returns 0 if successful.
+// returns error code if there is a CRC failure on the data that is read.
+oneWire_status oneWire_transaction(bool reset, const uint8_t cmd[], int cmd_len,
+                                   uint8_t data[], int read_len, oneWire_crc_type crc);
 
 // error codes
 #define ONE_WIRE_NO_ERROR 0
@@ -123,5 +390,8 @@ oneWire_status oneWire_read_bytes(uint8_t data[], int num);
 #define ONE_WIRE_READ_CRC_FAILURE -4
 #define ONE_WIRE_SEARCH_ROM_FAILURE -5
 #define ONE_WIRE_ILLEGAL_DATA_SIZE_REQ -6
+#define ONE_WIRE_FIFO_TIMEOUT -7
+#define ONE_WIRE_NO_PIO_RESOURCES -13
+#define ONE_WIRE_BAD_PIN -16
 
 #endif //ONE_WIRE_H
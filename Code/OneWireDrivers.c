@@ -0,0 +1,527 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireDrivers.h"
+
+// DS18B20, DS1822, DS1825: values are temperature in C, TH, TL and the config register
+static bool decode_DS18B20(const uint8_t data[], oneWire_reading_t *r) {
+  r->value[0] = (float)(int16_t)((data[1] << 8) | data[0]) / 16.0;
+  r->value[1] = (int8_t)data[2];
+  r->value[2] = (int8_t)data[3];
+  r->value[3] = data[4];
+  r->num_values = 4;
+  return true;
+}
+
+// DS18S20: values are temperature in C, TH and TL.  The 1/2 C reading is extended 
+// to 1/16 C with COUNT_REMAIN and COUNT_PER_C.
+static bool decode_DS18S20(const uint8_t data[], oneWire_reading_t *r) {
+  int16_t raw = (int16_t)((data[1] << 8) | data[0]);
+  uint8_t count_remain = data[6];
+  uint8_t count_per_c = data[7];
+  if (count_per_c != 0) {
+    r->value[0] = (float)(raw >> 1) - 0.25 + 
+                  (float)(count_per_c - count_remain) / count_per_c;
+  } else {
+    r->value[0] = (float)raw / 2.0;
+  }
+  r->value[1] = (int8_t)data[2];
+  r->value[2] = (int8_t)data[3];
+  r->num_values = 3;
+  return true;
+}
+
+// MAX31850: values are thermocouple temperature in C, cold junction temperature 
+// in C and the fault bits (1 open, 2 short to GND, 4 short to VDD)
+static bool decode_MAX31850(const uint8_t data[], oneWire_reading_t *r) {
+  r->value[0] = (float)((int16_t)((data[1] << 8) | data[0]) >> 2) / 4.0;
+  r->value[1] = (float)((int16_t)((data[3] << 8) | data[2]) >> 4) / 16.0;
+  r->value[2] = (data[0] & 1) ? (data[2] & 0x07) : 0;
+  r->num_values = 3;
+  return true;
+}
+
+// DS1825 and MAX31850 share family code 0x3B.  The top bit of the config byte is
+// 0 on a DS1825, which reads like a DS18B20, and 1 on a MAX31850.
+static bool decode_family_3B(const uint8_t data[], oneWire_reading_t *r) {
+  if (data[4] & 0x80) return decode_MAX31850(data, r);
+  return decode_DS18B20(data, r);
+}
+
+// DS2438 page 0: values are temperature in C, voltage in V and the raw current register.
+// The voltage comes from the Convert V the sweep sends after the Convert T.
+static bool decode_DS2438(const uint8_t data[], oneWire_reading_t *r) {
+  r->value[0] = (float)((int16_t)((data[2] << 8) | data[1]) >> 3) / 32.0;
+  r->value[1] = (float)(((data[4] << 8) | data[3]) & 0x3FF) / 100.0;
+  r->value[2] = (int16_t)((data[6] << 8) | data[5]);
+  r->num_values = 3;
+  return true;
+}
+
+// DS2408: values are the PIO logic state, the output latch and the activity latch
+static bool decode_DS2408(const uint8_t data[], oneWire_reading_t *r) {
+  r->value[0] = data[0];
+  r->value[1] = data[1];
+  r->value[2] = data[2];
+  r->num_values = 3;
+  return true;
+}
+
+// DS2413: values are PIO A state, PIO A latch, PIO B state and PIO B latch.  
+// There is no CRC.  The top nibble is the complement of the bottom one instead.
+static bool decode_DS2413(const uint8_t data[], oneWire_reading_t *r) {
+  if ((data[0] >> 4) != (~data[0] & 0x0F)) return false;
+  for (int i = 0;  i < 4; i++) r->value[i] = (data[0] >> i) & 1;
+  r->num_values = 4;
+  return true;
+}
+
+// fields left out are 0: no prepare command, no second conversion and a CRC that 
+// covers only the data
+static const oneWire_driver_t builtin_drivers[] = {
+  { .family = 0x28, .name = "DS18B20", .convert_cmd = 0x44, .convert_time_ms = 750,
+    .read_cmd = {0xBE}, .read_cmd_len = 1, .read_len = 9, .crc = ONE_WIRE_CRC8,
+    .decode = decode_DS18B20 },
+  { .family = 0x22, .name = "DS1822", .convert_cmd = 0x44, .convert_time_ms = 750,
+    .read_cmd = {0xBE}, .read_cmd_len = 1, .read_len = 9, .crc = ONE_WIRE_CRC8,
+    .decode = decode_DS18B20 },
+  { .family = 0x10, .name = "DS18S20", .convert_cmd = 0x44, .convert_time_ms = 750,
+    .read_cmd = {0xBE}, .read_cmd_len = 1, .read_len = 9, .crc = ONE_WIRE_CRC8,
+    .decode = decode_DS18S20 },
+  { .family = 0x3B, .name = "DS1825/MAX31850", .convert_cmd = 0x44, .convert_time_ms = 750,
+    .read_cmd = {0xBE}, .read_cmd_len = 1, .read_len = 9, .crc = ONE_WIRE_CRC8,
+    .decode = decode_family_3B },
+  { .family = 0x26, .name = "DS2438", .convert_cmd = 0x44, .convert_time_ms = 10,
+    .prepare_cmd = {0xB8, 0x00}, .prepare_len = 2,
+    .read_cmd = {0xBE, 0x00}, .read_cmd_len = 2, .read_len = 9, .crc = ONE_WIRE_CRC8,
+    .decode = decode_DS2438, .convert2_cmd = 0xB4, .convert2_time_ms = 10 },
+  { .family = 0x29, .name = "DS2408",
+    .read_cmd = {0xF0, 0x88, 0x00}, .read_cmd_len = 3, .read_len = 10, 
+    .crc = ONE_WIRE_CRC16, .crc_includes_cmd = true, .decode = decode_DS2408 },
+  { .family = 0x3A, .name = "DS2413",
+    .read_cmd = {0xF5}, .read_cmd_len = 1, .read_len = 1, .crc = ONE_WIRE_CRC_NONE,
+    .decode = decode_DS2413 },
+  { .family = 0x2D, .name = "DS2431",
+    .read_cmd = {0xF0, 0x00, 0x00}, .read_cmd_len = 3, .read_len = 8, .crc = ONE_WIRE_CRC_NONE },
+};
+
+#define NUM_BUILTIN_DRIVERS (sizeof(builtin_drivers) / sizeof(builtin_drivers[0]))
+
+static const oneWire_driver_t *registered_drivers[ONE_WIRE_MAX_DRIVERS];
+static int num_registered_drivers = 0;
+
+// oneWire_find_driver looks up the driver for a family code.
+// returns NULL if no driver is registered for the family.
+const oneWire_driver_t *oneWire_find_driver(uint8_t family) {
+  // registered drivers come first so they can replace the built in ones
+  for (int i = 0;  i < num_registered_drivers; i++) {
+    if (registered_drivers[i]->family == family) return registered_drivers[i];
+  }
+  for (int i = 0;  i < (int)NUM_BUILTIN_DRIVERS; i++) {
+    if (builtin_drivers[i].family == family) return &builtin_drivers[i];
+  }
+  return NULL;
+}
+
+// oneWire_register_driver adds a driver to the registry.  The driver must stay valid
+// for as long as it is registered.  A driver for a family that is already there
+// replaces the old one.
+// returns 0 if successful.
+// returns error code if the registry is full.
+oneWire_status oneWire_register_driver(const oneWire_driver_t *drv) {
+  for (int i = 0;  i < num_registered_drivers; i++) {
+    if (registered_drivers[i]->family == drv->family) {
+      registered_drivers[i] = drv;
+      return ONE_WIRE_NO_ERROR;
+    }
+  }
+  if (num_registered_drivers >= ONE_WIRE_MAX_DRIVERS) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  registered_drivers[num_registered_drivers++] = drv;
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_match_rom_cmd puts the match rom command and the 8 rom bytes in cmd[] 
+// which must have room for 9 bytes.
+// returns the number of bytes put in cmd[].
+int oneWire_match_rom_cmd(uint64_t rom, uint8_t cmd[]) {
+  cmd[0] = 0x55;
+  for (int i = 0;  i < 8; i++) cmd[i+1] = (rom >> (i * 8)) & 0xFF;
+  return 9;
+}
+
+// pushes a reset, match rom and the len bytes of ds_cmd[] for rom to the Tx FIFO
+// without waiting for the bus.  The reset goes first so the bus is busy while the
+// rest is put together.
+static void push_select_cmd(uint64_t rom, const uint8_t ds_cmd[], int len) {
+  uint8_t cmd[12];
+  oneWire_reset(true);
+  int n = oneWire_match_rom_cmd(rom, cmd);
+  memcpy(&cmd[n], ds_cmd, len);
+  n += len;
+  int i;
+  for (i = 0;  i <= n-2; i += 2) {
+    oneWire_write_uint(((uint16_t)cmd[i+1] << 8) | cmd[i], true);
+  }
+  if (i < n) oneWire_write_byte(cmd[i], true);
+}
+
+// checks the CRC the driver asks for and decodes the data.  crc8 is the result of a
+// CRC8 check already done on the data.
+static oneWire_status driver_decode(const oneWire_driver_t *drv, const uint8_t data[],
+                                    oneWire_status crc8, oneWire_reading_t *r) {
+  oneWire_status stat = ONE_WIRE_NO_ERROR;
+  if (drv->crc == ONE_WIRE_CRC8) {
+    stat = crc8;
+  } else if (drv->crc == ONE_WIRE_CRC16) {
+    uint16_t seed = drv->crc_includes_cmd ? 
+                    oneWire_CRC16(0, drv->read_cmd, drv->read_cmd_len) : 0;
+    stat = oneWire_CRC16_check(seed, data, drv->read_len);
+  }
+  if (stat != ONE_WIRE_NO_ERROR) return r->status = stat;
+  if (drv->decode != NULL && !drv->decode(data, r)) return r->status = ONE_WIRE_DECODE_FAILURE;
+  return r->status = ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_driver_read reads and decodes the device with the given rom using the
+// driver for its family.  Does not start a conversion.
+// returns 0 if successful.
+// returns error code if there is no driver, a CRC failure or the decode failed.
+oneWire_status oneWire_driver_read(uint64_t rom, oneWire_reading_t *r) {
+  uint8_t cmd[12];
+  uint8_t data[32];
+  r->rom = rom;
+  r->num_values = 0;
+  const oneWire_driver_t *drv = oneWire_find_driver(rom & 0xFF);
+  if (drv == NULL) return r->status = ONE_WIRE_NO_DRIVER;
+  if (drv->read_len > sizeof(data)) return r->status = ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  int n;
+  if (drv->prepare_len > 0) {
+    n = oneWire_match_rom_cmd(rom, cmd);
+    memcpy(&cmd[n], drv->prepare_cmd, drv->prepare_len);
+    oneWire_transaction(true, cmd, n + drv->prepare_len, NULL, 0, ONE_WIRE_CRC_NONE);
+  }
+  n = oneWire_match_rom_cmd(rom, cmd);
+  memcpy(&cmd[n], drv->read_cmd, drv->read_cmd_len);
+  oneWire_transaction(true, cmd, n + drv->read_cmd_len, data, drv->read_len, 
+                      ONE_WIRE_CRC_NONE);
+  return driver_decode(drv, data, oneWire_CRC(data, drv->read_len), r);
+}
+
+static bool sweep_prefetch = true;
+static oneWire_sweep_stats_t sweep_stats;
+
+// true if a device can be read with its next neighbour pushed ahead of it
+static inline bool driver_can_prefetch(const oneWire_driver_t *drv) {
+  return drv != NULL && drv->prepare_len == 0 && drv->read_len <= 16;
+}
+
+// reads all num devices in roms[].  With prefetch on, device i is reset and addressed
+// before device i-1 is pulled, then the read of device i is pushed, so there are never
+// more than 4 Rx words outstanding and the Tx FIFO does not run dry between devices.
+// With it off, device i is only pushed once device i-1 is in.  Either way the time
+// the bus then sits waiting for the next push is added to the gap time.
+static int driver_read_all(const uint64_t roms[], int num, oneWire_reading_t readings[]) {
+  union {
+    uint8_t  a[16];
+    uint32_t l[4];
+  } u;
+  int good = 0;
+  int prev = -1;   // device whose read is in flight
+  const oneWire_driver_t *prev_drv = NULL;
+  uint32_t in_us = 0;  // when the data of the last device was in
+  memset(&sweep_stats, 0, sizeof(sweep_stats));
+  sweep_stats.devices = num;
+  uint32_t start = time_us_32();
+  oneWire_bus_lock();
+  for (int i = 0;  i <= num; i++) {
+    const oneWire_driver_t *drv = (i < num) ? oneWire_find_driver(roms[i] & 0xFF) : NULL;
+    bool fast = driver_can_prefetch(drv);
+    bool ahead = sweep_prefetch && fast;
+    if (ahead) push_select_cmd(roms[i], drv->read_cmd, drv->read_cmd_len);
+    if (prev >= 0) {
+      oneWire_status crc8 = oneWire_pull_read_words(u.l, prev_drv->read_len, true);
+      in_us = time_us_32();
+      oneWire_tx_stalled(true);
+      if (driver_decode(prev_drv, u.a, crc8, &readings[prev]) == ONE_WIRE_NO_ERROR) good++;
+      prev = -1;
+    }
+    if (i == num) break;
+    // the bus waited on the processor since the last device was in.  With the next
+    // device pushed ahead this is an upper bound since the bus had that to do first.
+    uint32_t now = time_us_32();
+    if (oneWire_tx_stalled(true) && i > 0) {
+      sweep_stats.stalls++;
+      sweep_stats.gap_us += now - in_us;
+    }
+    if (fast) {
+      if (!ahead) push_select_cmd(roms[i], drv->read_cmd, drv->read_cmd_len);
+      readings[i].rom = roms[i];
+      readings[i].num_values = 0;
+      oneWire_push_read_words_cmd(drv->read_len, true);
+      prev = i;
+      prev_drv = drv;
+      if (ahead) sweep_stats.prefetched++;
+    } else {
+      if (oneWire_driver_read(roms[i], &readings[i]) == ONE_WIRE_NO_ERROR) good++;
+      in_us = time_us_32();
+      oneWire_tx_stalled(true);
+    }
+  }
+  oneWire_bus_unlock();
+  sweep_stats.read_us = time_us_32() - start;
+  return good;
+}
+
+// one round of conversions for oneWire_driver_sweep(), the first or second command
+// of each driver
+typedef struct sweep_round {
+  uint8_t cmds[ONE_WIRE_MAX_CONVERT_CMDS];
+  int num_cmds;
+  uint32_t wait_ms;
+} sweep_round_t;
+
+// finds the different conversion commands of one round needed on this bus
+// returns false if there are more than ONE_WIRE_MAX_CONVERT_CMDS of them.
+static bool sweep_find_round(const uint64_t roms[], int num, bool second,
+                             sweep_round_t *round) {
+  round->num_cmds = 0;
+  round->wait_ms = 0;
+  for (int i = 0;  i < num; i++) {
+    const oneWire_driver_t *drv = oneWire_find_driver(roms[i] & 0xFF);
+    if (drv == NULL) continue;
+    uint8_t cmd = second ? drv->convert2_cmd : drv->convert_cmd;
+    uint16_t ms = second ? drv->convert2_time_ms : drv->convert_time_ms;
+    if (cmd == 0) continue;
+    int c;
+    for (c = 0;  c < round->num_cmds && round->cmds[c] != cmd; c++);
+    if (c == round->num_cmds) {
+      if (round->num_cmds == ONE_WIRE_MAX_CONVERT_CMDS) return false;
+      round->cmds[round->num_cmds++] = cmd;
+    }
+    if (ms > round->wait_ms) round->wait_ms = ms;
+  }
+  return true;
+}
+
+// sends one skip rom broadcast per conversion command of the round and waits for the
+// longest one.  The wait starts once the last command is out on the wire.
+static void sweep_convert(const sweep_round_t *round) {
+  for (int c = 0;  c < round->num_cmds; c++) {
+    uint8_t cmd[2] = {0xCC, round->cmds[c]};
+    oneWire_transaction(true, cmd, 2, NULL, 0, ONE_WIRE_CRC_NONE);
+  }
+  if (round->wait_ms > 0) {
+    oneWire_wait_for_sm_idle();
+    sleep_ms(round->wait_ms);
+  }
+}
+
+// oneWire_driver_sweep reads all num devices in roms[] with one conversion for the 
+// whole bus.  Each different conversion command used by the drivers is sent once with
+// skip rom, then after the longest conversion time every device is read and decoded
+// into readings[].  Drivers with a second conversion, like the DS2438 voltage, get a
+// second round of skip rom commands once the first round is done.
+// returns the number of devices read successfully.
+// returns error code if a round needs more than ONE_WIRE_MAX_CONVERT_CMDS different 
+// conversion commands.  Nothing is sent to the bus in that case.
+int oneWire_driver_sweep(const uint64_t roms[], int num, oneWire_reading_t readings[]) {
+  sweep_round_t first, second;
+  if (!sweep_find_round(roms, num, false, &first) || 
+      !sweep_find_round(roms, num, true, &second)) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  sweep_convert(&first);
+  sweep_convert(&second);
+  return driver_read_all(roms, num, readings);
+}
+
+// oneWire_set_sweep_prefetch turns read prefetch in oneWire_driver_sweep() on or off.
+// It is on by default.  Off is only useful to compare the two.
+void oneWire_set_sweep_prefetch(bool on) {
+  sweep_prefetch = on;
+}
+
+// oneWire_get_sweep_stats puts the read pass stats of the last sweep in stats.
+void oneWire_get_sweep_stats(oneWire_sweep_stats_t *stats) {
+  *stats = sweep_stats;
+}
+
+// bits on the wire to select a device with match rom and send a command
+#define MATCH_CMD_BITS ((9 + 1) * 8)
+// bits for a 9 byte scratchpad read
+#define SCRATCH_BITS (9 * 8)
+// bits for the write scratchpad command and its 3 data bytes
+#define WRITE_SCRATCH_BITS (4 * 8)
+
+// true for the families that have a DS18B20 style write scratchpad
+static inline bool temp_config_family(uint8_t family) {
+  return family == 0x28 || family == 0x22 || family == 0x3B || family == 0x10;
+}
+
+// checks the scratchpad read back from a device against the config written
+static oneWire_status temp_config_check(uint64_t rom, oneWire_status stat, const uint8_t a[],
+                                        uint8_t th, uint8_t tl, uint8_t cfg) {
+  if (stat != ONE_WIRE_NO_ERROR) return stat;
+  uint8_t family = rom & 0xFF;
+  if (family == 0x3B && (a[4] & 0x80)) return ONE_WIRE_NO_ERROR;  // MAX31850
+  if (a[2] != th || a[3] != tl) return ONE_WIRE_DECODE_FAILURE;
+  // the low 5 bits of the config register always read back as 1s
+  if (family != 0x10 && (a[4] | 0x1F) != (cfg | 0x1F)) return ONE_WIRE_DECODE_FAILURE;
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_temp_config_broadcast writes TH, TL and the config register of all the 
+// temperature sensors on the bus with one skip rom write scratchpad.  Then the 
+// scratchpad of each of the num devices in roms[] is read back to verify it.  The 
+// verify reads are pipelined, the next device is reset and addressed while the last 
+// one's data is pulled and checked.  Devices that did not take the write are written
+// again with match rom up to ONE_WIRE_CONFIG_RETRIES times.  DS18S20s only take TH
+// and TL.  MAX31850s have no config and are skipped.  The result of each device goes 
+// in status[].  The skip rom write reaches every device so all of them must be 
+// temperature sensors.  If stats is not NULL the bus cost is put there.
+// returns the number of devices verified.
+// returns error code if roms[] has a device that is not a temperature sensor.
+int oneWire_temp_config_broadcast(const uint64_t roms[], int num, uint8_t th, uint8_t tl,
+                                  uint8_t cfg, oneWire_status status[],
+                                  oneWire_config_stats_t *stats) {
+  oneWire_config_stats_t st = {0};
+  for (int i = 0;  i < num; i++) {
+    if (!temp_config_family(roms[i] & 0xFF)) return ONE_WIRE_NO_DRIVER;
+  }
+  uint32_t start = time_us_32();
+  oneWire_bus_lock();
+  // one write for the whole bus
+  uint8_t cmd[13] = {0xCC, 0x4E, th, tl, cfg};
+  oneWire_transaction(true, cmd, 5, NULL, 0, ONE_WIRE_CRC_NONE);
+  st.resets++;
+  st.bus_bits += 5 * 8;
+
+  // verify pass.  Device i is addressed before device i-1 is pulled so the wire 
+  // never waits on the processor.  At most 3 Rx words are outstanding.
+  union {
+    uint8_t  a[12];
+    uint32_t l[3];
+  } u;
+  const uint8_t read_scratch = 0xBE;
+  for (int i = 0;  i <= num; i++) {
+    if (i < num) push_select_cmd(roms[i], &read_scratch, 1);
+    if (i > 0) {
+      oneWire_status stat = oneWire_pull_read_words(u.l, 9, true);
+      status[i-1] = temp_config_check(roms[i-1], stat, u.a, th, tl, cfg);
+      if (status[i-1] != ONE_WIRE_NO_ERROR) st.mismatches++;
+    }
+    if (i < num) oneWire_push_read_words_cmd(9, true);
+  }
+  st.resets += num;
+  st.bus_bits += num * (MATCH_CMD_BITS + SCRATCH_BITS);
+
+  // only the devices that did not verify are written one at a time
+  int good = 0;
+  for (int i = 0;  i < num; i++) {
+    for (int r = 0;  r < ONE_WIRE_CONFIG_RETRIES && status[i] != ONE_WIRE_NO_ERROR; r++) {
+      int n = oneWire_match_rom_cmd(roms[i], cmd);
+      cmd[n] = 0x4E;
+      cmd[n+1] = th;
+      cmd[n+2] = tl;
+      cmd[n+3] = cfg;
+      oneWire_transaction(true, cmd, n + 4, NULL, 0, ONE_WIRE_CRC_NONE);
+      cmd[n] = 0xBE;
+      oneWire_status stat = oneWire_transaction(true, cmd, n + 1, u.a, 9, ONE_WIRE_CRC8);
+      status[i] = temp_config_check(roms[i], stat, u.a, th, tl, cfg);
+      st.retries++;
+      st.resets += 2;
+      st.bus_bits += 9 * 8 + WRITE_SCRATCH_BITS + MATCH_CMD_BITS + SCRATCH_BITS;
+    }
+    if (status[i] == ONE_WIRE_NO_ERROR) good++;
+  }
+  oneWire_bus_unlock();
+
+  if (stats != NULL) {
+    st.time_us = time_us_32() - start;
+    st.per_device_resets = 2 * num;
+    st.per_device_bits = num * (9 * 8 + WRITE_SCRATCH_BITS + MATCH_CMD_BITS + SCRATCH_BITS);
+    *stats = st;
+  }
+  return good;
+}
+
+// sends a match rom and the conversion command of drv to rom
+static void stagger_convert(oneWire_stagger_t *s, int i, const oneWire_driver_t *drv) {
+  uint8_t cmd[10];
+  int n = oneWire_match_rom_cmd(s->roms[i], cmd);
+  cmd[n++] = drv->convert_cmd;
+  oneWire_bus_lock();
+  oneWire_transaction(true, cmd, n, NULL, 0, ONE_WIRE_CRC_NONE);
+  // the conversion starts when the command is out on the wire, not when it is pushed
+  oneWire_wait_for_sm_idle();
+  s->due_us[i] = time_us_32() + s->convert_us;
+  oneWire_bus_unlock();
+  s->converting[i] = true;
+}
+
+// oneWire_stagger_start sets up staggered conversions for the num devices in roms[], 
+// which must stay valid until the stagger is no longer polled.  Each device gets its
+// own match rom convert so the devices must have external power.  If convert_ms is 0 
+// the worst case time of the driver is used, a lower resolution can use less.
+// returns 0 if successful.
+// returns error code if a device has no driver with a conversion or a device on the 
+// bus is parasite powered.
+oneWire_status oneWire_stagger_start(oneWire_stagger_t *s, const uint64_t roms[], int num,
+                                     uint16_t convert_ms) {
+  if (num > ONE_WIRE_STAGGER_MAX) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  memset(s, 0, sizeof(oneWire_stagger_t));
+  s->roms = roms;
+  s->num = num;
+  uint16_t worst_ms = 0;
+  for (int i = 0;  i < num; i++) {
+    const oneWire_driver_t *drv = oneWire_find_driver(roms[i] & 0xFF);
+    if (drv == NULL || drv->convert_cmd == 0) return ONE_WIRE_NO_DRIVER;
+    if (drv->convert_time_ms > worst_ms) worst_ms = drv->convert_time_ms;
+  }
+  s->convert_us = (convert_ms ? convert_ms : worst_ms) * 1000;
+  // read power supply, a parasite powered device pulls the first slot low
+  uint8_t cmd[2] = {0xCC, 0xB4};
+  uint8_t power;
+  oneWire_transaction(true, cmd, 2, &power, 1, ONE_WIRE_CRC_NONE);
+  if ((power & 0x01) == 0) return ONE_WIRE_PARASITE_POWER;
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_stagger_poll does one bus step.  If a device is done converting the one that
+// has waited longest is read into r and its next conversion started, and true is 
+// returned.  Otherwise the next device not yet started gets its convert command.
+// Never waits for a conversion so it should be called in a loop.  When every device 
+// is busy the poll does nothing, so with enough devices the bus time is all reads.
+// returns true if a reading was put in r, its status says if it worked.
+bool oneWire_stagger_poll(oneWire_stagger_t *s, oneWire_reading_t *r) {
+  uint32_t now = time_us_32();
+  int ready = -1;
+  uint32_t late = 0;
+  for (int i = 0;  i < s->num; i++) {
+    if (!s->converting[i]) continue;
+    int32_t l = (int32_t)(now - s->due_us[i]);
+    if (l >= 0 && (ready < 0 || (uint32_t)l > late)) {
+      ready = i;
+      late = l;
+    }
+  }
+  if (ready >= 0) {
+    const oneWire_driver_t *drv = oneWire_find_driver(s->roms[ready] & 0xFF);
+    if (late > s->max_late_us) s->max_late_us = late;
+    oneWire_bus_lock();
+    if (oneWire_driver_read(s->roms[ready], r) != ONE_WIRE_NO_ERROR) s->errors++;
+    stagger_convert(s, ready, drv);
+    oneWire_bus_unlock();
+    s->samples++;
+    return true;
+  }
+  if (s->next_start < s->num) {
+    const oneWire_driver_t *drv = oneWire_find_driver(s->roms[s->next_start] & 0xFF);
+    stagger_convert(s, s->next_start++, drv);
+  }
+  return false;
+}
@@ -0,0 +1,171 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef ONE_WIRE_DRIVERS_H
+#define ONE_WIRE_DRIVERS_H
+
+#include "OneWire.h"
+
+#define ONE_WIRE_MAX_VALUES 4
+#define ONE_WIRE_MAX_DRIVERS 24
+// different conversion commands oneWire_driver_sweep() can send in one round
+#define ONE_WIRE_MAX_CONVERT_CMDS 4
+
+// oneWire_reading_t holds what a driver decoded from one device.  What each value
+// means is up to the driver and is listed with the driver in OneWireDrivers.c
+typedef struct oneWire_reading {
+  uint64_t rom;
+  oneWire_status status;
+  uint8_t num_values;
+  float value[ONE_WIRE_MAX_VALUES];
+} oneWire_reading_t;
+
+// oneWire_driver_t describes how to talk to one family of devices.  The sweep 
+// functions only use this description so a new device type only needs a new
+// oneWire_driver_t, not new application code.
+typedef struct oneWire_driver {
+  uint8_t family;             // family code, the low byte of the rom
+  const char *name;
+  uint8_t convert_cmd;        // command that starts a conversion, 0 if none
+  uint16_t convert_time_ms;   // worst case conversion time
+  uint8_t prepare_cmd[2];     // sent in its own transaction before the read, e.g. a recall
+  uint8_t prepare_len;        // 0 if there is nothing to send
+  uint8_t read_cmd[3];        // command and address bytes that start the read
+  uint8_t read_cmd_len;
+  uint8_t read_len;           // bytes to read including any CRC
+  oneWire_crc_type crc;       // how the response is checked
+  bool crc_includes_cmd;      // the CRC16 covers read_cmd as well as the data
+  // decode turns the bytes read into values.  Returns false if the data is bad.
+  // May be NULL if there is nothing to decode.
+  bool (*decode)(const uint8_t data[], oneWire_reading_t *r);
+  uint8_t convert2_cmd;       // second conversion started when the first is done, 0 if none
+  uint16_t convert2_time_ms;  // worst case time of the second conversion
+} oneWire_driver_t;
+
+// oneWire_find_driver looks up the driver for a family code.
+// returns NULL if no driver is registered for the family.
+const oneWire_driver_t *oneWire_find_driver(uint8_t family);
+
+// oneWire_register_driver adds a driver to the registry.  The driver must stay valid
+// for as long as it is registered.  A driver for a family that is already there
+// replaces the old one.
+// returns 0 if successful.
+// returns error code if the registry is full.
+oneWire_status oneWire_register_driver(const oneWire_driver_t *drv);
+
+// oneWire_match_rom_cmd puts the match rom command and the 8 rom bytes in cmd[] 
+// which must have room for 9 bytes.
+// returns the number of bytes put in cmd[].
+int oneWire_match_rom_cmd(uint64_t rom, uint8_t cmd[]);
+
+// oneWire_driver_read reads and decodes the device with the given rom using the
+// driver for its family.  Does not start a conversion.
+// returns 0 if successful.
+// returns error code if there is no driver, a CRC failure or the decode failed.
+oneWire_status oneWire_driver_read(uint64_t rom, oneWire_reading_t *r);
+
+// oneWire_sweep_stats_t reports the read pass of the last oneWire_driver_sweep().
+typedef struct oneWire_sweep_stats {
+  uint32_t read_us;        // time to read all devices after the conversion
+  int devices;
+  int prefetched;          // devices read with the next device pushed ahead
+  int stalls;              // gaps between devices where the bus waited on the processor
+  uint32_t gap_us;         // total of those gaps, from when the last device was in
+} oneWire_sweep_stats_t;
+
+// oneWire_driver_sweep reads all num devices in roms[] with one conversion for the 
+// whole bus.  Each different conversion command used by the drivers is sent once with
+// skip rom, then after the longest conversion time every device is read and decoded
+// into readings[].  Drivers with a second conversion, like the DS2438 voltage, get a
+// second round of skip rom commands once the first round is done.  With prefetch on,
+// the reset, address and read command of the next device are pushed while the data of
+// the current one is pulled and checked, so the bus goes from one device to the next
+// with no gap.  Devices with a prepare command
+// or more than 16 bytes to read are read on their own.
+// returns the number of devices read successfully.
+// returns error code if a round needs more than ONE_WIRE_MAX_CONVERT_CMDS different 
+// conversion commands.  Nothing is sent to the bus in that case.
+int oneWire_driver_sweep(const uint64_t roms[], int num, oneWire_reading_t readings[]);
+
+// oneWire_set_sweep_prefetch turns read prefetch in oneWire_driver_sweep() on or off.
+// It is on by default.  Off is only useful to compare the two.
+void oneWire_set_sweep_prefetch(bool on);
+
+// oneWire_get_sweep_stats puts the read pass stats of the last sweep in stats.
+void oneWire_get_sweep_stats(oneWire_sweep_stats_t *stats);
+
+// how many times a device that did not take the broadcast config is written on its own
+#define ONE_WIRE_CONFIG_RETRIES 2
+
+// oneWire_config_stats_t reports what oneWire_temp_config_broadcast() cost on the bus
+// and what writing and verifying each device with match rom would have cost.
+typedef struct oneWire_config_stats {
+  uint32_t time_us;            // broadcast, verify and retries start to finish
+  uint32_t bus_bits;           // bits written and read
+  uint32_t resets;
+  uint32_t per_device_bits;    // the same write and verify with match rom per device
+  uint32_t per_device_resets;
+  int mismatches;              // devices that did not verify after the broadcast
+  int retries;                 // match rom writes done for the mismatches
+} oneWire_config_stats_t;
+
+// oneWire_temp_config_broadcast writes TH, TL and the config register of all the 
+// temperature sensors on the bus with one skip rom write scratchpad.  Then the 
+// scratchpad of each of the num devices in roms[] is read back to verify it.  The 
+// verify reads are pipelined, the next device is reset and addressed while the last 
+// one's data is pulled and checked.  Devices that did not take the write are written
+// again with match rom up to ONE_WIRE_CONFIG_RETRIES times.  DS18S20s only take TH
+// and TL.  MAX31850s have no config and are skipped.  The result of each device goes 
+// in status[].  The skip rom write reaches every device so all of them must be 
+// temperature sensors.  If stats is not NULL the bus cost is put there.
+// returns the number of devices verified.
+// returns error code if roms[] has a device that is not a temperature sensor.
+int oneWire_temp_config_broadcast(const uint64_t roms[], int num, uint8_t th, uint8_t tl,
+                                  uint8_t cfg, oneWire_status status[],
+                                  oneWire_config_stats_t *stats);
+
+#define ONE_WIRE_STAGGER_MAX 16
+
+// oneWire_stagger_t is a rolling set of conversions started with 
+// oneWire_stagger_start().  Each device converts on its own time and is read and
+// started again as soon as it is done, so the bus is never idle waiting on the 
+// slowest device.
+typedef struct oneWire_stagger {
+  const uint64_t *roms;
+  int num;
+  uint32_t convert_us;                    // conversion time used for every device
+  uint32_t due_us[ONE_WIRE_STAGGER_MAX];  // when each device will be done
+  bool converting[ONE_WIRE_STAGGER_MAX];
+  int next_start;                         // devices not started yet start from here
+  uint32_t samples;                       // readings returned
+  uint32_t errors;                        // readings that failed
+  uint32_t max_late_us;                   // worst time a done device waited for the bus
+} oneWire_stagger_t;
+
+// oneWire_stagger_start sets up staggered conversions for the num devices in roms[], 
+// which must stay valid until the stagger is no longer polled.  Each device gets its
+// own match rom convert so the devices must have external power.  If convert_ms is 0 
+// the worst case time of the driver is used, a lower resolution can use less.
+// returns 0 if successful.
+// returns error code if a device has no driver with a conversion or a device on the 
+// bus is parasite powered.
+oneWire_status oneWire_stagger_start(oneWire_stagger_t *s, const uint64_t roms[], int num,
+                                     uint16_t convert_ms);
+
+// oneWire_stagger_poll does one bus step.  If a device is done converting the one that
+// has waited longest is read into r and its next conversion started, and true is 
+// returned.  Otherwise the next device not yet started gets its convert command.
+// Never waits for a conversion so it should be called in a loop.  When every device 
+// is busy the poll does nothing, so with enough devices the bus time is all reads.
+// returns true if a reading was put in r, its status says if it worked.
+bool oneWire_stagger_poll(oneWire_stagger_t *s, oneWire_reading_t *r);
+
+// error codes
+#define ONE_WIRE_NO_DRIVER -8
+#define ONE_WIRE_DECODE_FAILURE -9
+#define ONE_WIRE_PARASITE_POWER -15
+
+#endif //ONE_WIRE_DRIVERS_H
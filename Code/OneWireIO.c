@@ -0,0 +1,511 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireDrivers.h"
+#include "OneWireIO.h"
+
+// oneWire_ds2408_stream_start starts a channel access read on the DS2408 with the 
+// given rom.  Samples are put in ring[] which holds ring_size - 1 samples.  The bus
+// stays locked until oneWire_ds2408_stream_stop() so nothing else can use it.
+// returns 0 if successful.
+// returns error code if ring_size is less than 2 or the command could not be sent, 
+// the bus is not left locked.
+oneWire_status oneWire_ds2408_stream_start(oneWire_ds2408_stream_t *s, uint64_t rom,
+                                           uint8_t ring[], uint16_t ring_size) {
+  if (ring_size < 2) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  memset(s, 0, sizeof(*s));
+  s->ring = ring;
+  s->ring_size = ring_size;
+  s->first_block = true;
+  uint8_t cmd[10];
+  int n = oneWire_match_rom_cmd(rom, cmd);
+  cmd[n++] = 0xF5;  // channel access read
+  oneWire_bus_lock();
+  oneWire_status stat = oneWire_transaction(true, cmd, n, NULL, 0, ONE_WIRE_CRC_NONE);
+  if (stat != ONE_WIRE_NO_ERROR) oneWire_bus_unlock();
+  return stat;
+}
+
+// a whole block and its CRC are in so check it and pass the samples on
+static int ds2408_stream_block(oneWire_ds2408_stream_t *s) {
+  uint16_t crc = 0;
+  if (s->first_block) {
+    uint8_t f5 = 0xF5;
+    crc = oneWire_CRC16(0, &f5, 1);
+    s->first_block = false;
+  }
+  if (oneWire_CRC16_check(crc, s->block, DS2408_STREAM_BLOCK + 2) != ONE_WIRE_NO_ERROR) {
+    s->crc_errors++;
+    return 0;
+  }
+  s->blocks++;
+  int added = 0;
+  for (int i = 0;  i < DS2408_STREAM_BLOCK; i++) {
+    uint16_t next = (s->head + 1) % s->ring_size;
+    if (next == s->tail) {
+      s->overruns++;
+      continue;
+    }
+    s->ring[s->head] = s->block[i];
+    s->head = next;
+    added++;
+  }
+  return added;
+}
+
+// oneWire_ds2408_stream_poll keeps the Tx FIFO full of reads and moves whatever has
+// arrived in the Rx FIFO into the current block.  When a block and its CRC16 are in,
+// the CRC is checked and the 32 samples go to the ring buffer.  Never waits so it
+// should be called often, at least once per 4 samples, to keep the bus busy.
+// returns the number of samples added to the ring buffer.
+int oneWire_ds2408_stream_poll(oneWire_ds2408_stream_t *s) {
+  int added = 0;
+  uint32_t w;
+  while (oneWire_pull_read_word(&w, false) == ONE_WIRE_NO_ERROR) {
+    s->outstanding--;
+    for (int k = 0;  k < 4; k++, w >>= 8) {
+      s->block[s->block_pos++] = w & 0xFF;
+      if (s->block_pos == DS2408_STREAM_BLOCK + 2) {
+        added += ds2408_stream_block(s);
+        s->block_pos = 0;
+      }
+    }
+  }
+  // the state machine just stalls if the Rx FIFO fills so the Tx FIFO can be kept full
+  while (oneWire_push_read_words_cmd(4, false) == ONE_WIRE_NO_ERROR) {
+    s->outstanding++;
+  }
+  return added;
+}
+
+// oneWire_ds2408_stream_get takes the oldest sample out of the ring buffer.
+// returns false if the ring buffer is empty.
+bool oneWire_ds2408_stream_get(oneWire_ds2408_stream_t *s, uint8_t *sample) {
+  if (s->tail == s->head) return false;
+  *sample = s->ring[s->tail];
+  s->tail = (s->tail + 1) % s->ring_size;
+  return true;
+}
+
+// oneWire_ds2408_stream_stop waits for the reads in flight, ends the channel access
+// read with a reset and releases the bus.
+void oneWire_ds2408_stream_stop(oneWire_ds2408_stream_t *s) {
+  uint32_t w;
+  while (s->outstanding > 0) {
+    oneWire_pull_read_word(&w, true);
+    s->outstanding--;
+  }
+  oneWire_reset(true);
+  oneWire_bus_unlock();
+}
+
+// checks a DS2413 PIO access read status byte.  The top nibble is the complement
+// of the bottom one.
+static inline bool ds2413_status_ok(uint8_t b) {
+  return (b >> 4) == (~b & 0x0F);
+}
+
+// puts the rom function and the PIO access read command for a DS2413 poll in cmd[]
+// returns the number of bytes
+static int ds2413_poll_cmd(oneWire_ds2413_t *d, bool resume, uint8_t cmd[]) {
+  int n = 0;
+  if (d->rom == 0) {
+    cmd[n++] = 0xCC;  // skip rom
+  } else if (resume) {
+    cmd[n++] = 0xA5;  // resume
+  } else {
+    n = oneWire_match_rom_cmd(d->rom, cmd);
+  }
+  cmd[n++] = 0xF5;  // PIO access read
+  return n;
+}
+
+// true if the device is the one the last rom command left selected
+static inline bool ds2413_can_resume(oneWire_ds2413_t *d) {
+  return d->rom != 0 && oneWire_get_selected_rom() == d->rom;
+}
+
+// oneWire_ds2413_poll reads the PIO state of a DS2413 with as few slots as possible.
+// When the device is the one oneWire_get_selected_rom() reports, resume rom (0xA5) 
+// is used instead of match rom so a poll is a reset plus 24 slots.  Otherwise match 
+// rom is used.  With rom = 0 skip rom is used.
+// The status byte is checked with its complement nibble since there is no CRC.
+// *state gets PIO A state in bit 0, PIO A latch in bit 1, PIO B state in bit 2 and 
+// PIO B latch in bit 3.
+// returns 0 if successful.
+// returns error code if the complement check fails.
+oneWire_status oneWire_ds2413_poll(oneWire_ds2413_t *d, uint8_t *state) {
+  uint8_t cmd[10];
+  uint8_t b;
+  d->polls++;
+  bool resume = ds2413_can_resume(d);
+  int n = ds2413_poll_cmd(d, resume, cmd);
+  oneWire_transaction(true, cmd, n, &b, 1, ONE_WIRE_CRC_NONE);
+  if (!ds2413_status_ok(b) && resume) {
+    // something the core did not see selected another device so match this one
+    d->reselects++;
+    n = ds2413_poll_cmd(d, false, cmd);
+    oneWire_transaction(true, cmd, n, &b, 1, ONE_WIRE_CRC_NONE);
+  }
+  if (!ds2413_status_ok(b)) {
+    d->bad_reads++;
+    return ONE_WIRE_READ_CRC_FAILURE;
+  }
+  *state = b & 0x0F;
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_ds2413_poll_burst reads num more status bytes after one PIO access read
+// command.  The DS2413 sends a new sample for every byte read so after the first one
+// a sample costs 8 slots.  The bus is locked for the whole burst.
+// returns the number of good samples put in states[].
+int oneWire_ds2413_poll_burst(oneWire_ds2413_t *d, uint8_t states[], int num) {
+  uint8_t cmd[10];
+  int good = 0;
+  oneWire_bus_lock();
+  int n = ds2413_poll_cmd(d, ds2413_can_resume(d), cmd);
+  oneWire_transaction(true, cmd, n, NULL, 0, ONE_WIRE_CRC_NONE);
+  for (int i = 0;  i < num; i++) {
+    uint8_t b;
+    oneWire_transaction(false, NULL, 0, &b, 1, ONE_WIRE_CRC_NONE);
+    d->polls++;
+    if (ds2413_status_ok(b)) {
+      states[good++] = b & 0x0F;
+    } else {
+      d->bad_reads++;
+    }
+  }
+  oneWire_reset(true);
+  oneWire_bus_unlock();
+  return good;
+}
+
+// oneWire_ds2438_sweep reads temperature and voltage from all num DS2438 battery 
+// monitors in roms[].  Instead of a convert and read per device it sends convert T
+// to every device with skip rom, then convert V the same way, then reads page 0 of 
+// each device back to back.  The read is a recall memory followed by a read 
+// scratchpad, each with its own match rom since the DS2438 has no resume rom.  Results are decoded by the DS2438 driver into
+// readings[], temperature in C, voltage in V and the raw current register.
+// If sweep_us is not NULL the time the whole sweep took is put there.
+// returns the number of devices read successfully.
+int oneWire_ds2438_sweep(const uint64_t roms[], int num, oneWire_reading_t readings[],
+                         uint32_t *sweep_us) {
+  uint64_t start = time_us_64();
+  const oneWire_driver_t *drv = oneWire_find_driver(0x26);
+  uint8_t convert_t[2] = {0xCC, 0x44};
+  uint8_t convert_v[2] = {0xCC, 0xB4};
+  // the conversion starts when the command is out on the wire, not when it is pushed
+  oneWire_transaction(true, convert_t, 2, NULL, 0, ONE_WIRE_CRC_NONE);
+  oneWire_wait_for_sm_idle();
+  sleep_ms(DS2438_CONVERT_T_MS);
+  oneWire_transaction(true, convert_v, 2, NULL, 0, ONE_WIRE_CRC_NONE);
+  oneWire_wait_for_sm_idle();
+  sleep_ms(DS2438_CONVERT_V_MS);
+  int good = 0;
+  for (int i = 0;  i < num; i++) {
+    uint8_t cmd[11];
+    uint8_t data[9];
+    oneWire_reading_t *r = &readings[i];
+    r->rom = roms[i];
+    r->num_values = 0;
+    // recall page 0 into the scratchpad
+    int n = oneWire_match_rom_cmd(roms[i], cmd);
+    cmd[n++] = 0xB8;
+    cmd[n++] = 0x00;
+    oneWire_transaction(true, cmd, n, NULL, 0, ONE_WIRE_CRC_NONE);
+    // the DS2438 has no resume rom so the read needs a match rom of its own
+    n = oneWire_match_rom_cmd(roms[i], cmd);
+    cmd[n++] = 0xBE;
+    cmd[n++] = 0x00;
+    r->status = oneWire_transaction(true, cmd, n, data, 9, ONE_WIRE_CRC8);
+    if (r->status != ONE_WIRE_NO_ERROR) continue;
+    if (drv == NULL || !drv->decode(data, r)) {
+      r->status = ONE_WIRE_DECODE_FAILURE;
+      continue;
+    }
+    good++;
+  }
+  if (sweep_us != NULL) *sweep_us = time_us_64() - start;
+  return good;
+}
+
+// oneWire_ds2450_sweep converts all four channels of every DS2450 on the bus with one
+// skip rom convert command, so a sweep costs one conversion time for the whole bus.
+// Then the conversion page of each of the num devices in roms[] is read with its 
+// CRC16 straight into the reading.  The four values in readings[] are the channel 
+// results scaled to full_scale, normally the 2.56 or 5.12 volt range the channels 
+// are set up for.  The devices must have VCC power.
+// returns the number of devices read successfully.
+int oneWire_ds2450_sweep(const uint64_t roms[], int num, oneWire_reading_t readings[],
+                         float full_scale) {
+  // convert with all 4 channels selected and the read out registers left alone.  
+  // Every device sends the same CRC16 so they can all answer at once.
+  uint8_t convert[4] = {0xCC, 0x3C, 0x0F, 0x00};
+  uint8_t crc[2];
+  oneWire_transaction(true, convert, 4, crc, 2, ONE_WIRE_CRC_NONE);
+  sleep_ms(DS2450_CONVERT_MS);
+  int good = 0;
+  for (int i = 0;  i < num; i++) {
+    uint8_t cmd[12];
+    uint8_t data[10];
+    oneWire_reading_t *r = &readings[i];
+    r->rom = roms[i];
+    r->num_values = 0;
+    // read memory of the conversion page, the CRC16 covers command, address and data
+    int n = oneWire_match_rom_cmd(roms[i], cmd);
+    cmd[n++] = 0xAA;
+    cmd[n++] = 0x00;
+    cmd[n++] = 0x00;
+    r->status = oneWire_transaction(true, cmd, n, data, 10, ONE_WIRE_CRC16);
+    if (r->status != ONE_WIRE_NO_ERROR) continue;
+    for (int c = 0;  c < 4; c++) {
+      r->value[c] = (float)((data[2*c+1] << 8) | data[2*c]) * full_scale / 65536.0;
+    }
+    r->num_values = 4;
+    good++;
+  }
+  return good;
+}
+
+// sends a DS28EA00 chain command with its complement and checks the confirmation
+static oneWire_status ds28ea00_chain_cmd(uint8_t rom_cmd, uint8_t ctrl) {
+  uint8_t cmd[4] = {rom_cmd, 0x99, ctrl, ~ctrl};
+  uint8_t confirm;
+  oneWire_transaction(true, cmd, 4, &confirm, 1, ONE_WIRE_CRC_NONE);
+  if (confirm != 0xAA) return ONE_WIRE_SEARCH_ROM_FAILURE;
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_ds28ea00_chain finds the DS28EA00s on a linear bus in physical order using 
+// the sequence detect chain.  All devices are put in chain mode with skip rom, then each
+// pass does a conditional read rom, which only the first device not yet done answers,
+// and marks that device done with resume rom and chain DONE.  That is one read rom per
+// device instead of a full search pass and devs[0] is the device nearest the master.
+// At most max_devs roms are put in devs[].  Chain mode is turned off at the end.
+// returns the number of devices found.
+// returns error code if a rom fails its CRC or a chain command is not confirmed.
+int oneWire_ds28ea00_chain(uint64_t devs[], int max_devs) {
+  int num = 0;
+  oneWire_bus_lock();
+  if (ds28ea00_chain_cmd(0xCC, 0x5A) != ONE_WIRE_NO_ERROR) {  // chain ON
+    oneWire_bus_unlock();
+    return ONE_WIRE_SEARCH_ROM_FAILURE;
+  }
+  while (num < max_devs) {
+    union {
+      uint8_t a[8];
+      uint64_t d;
+    } u;
+    uint8_t cond_read = 0x0F;  // conditional read rom
+    oneWire_status stat = oneWire_transaction(true, &cond_read, 1, u.a, 8, ONE_WIRE_CRC8);
+    if (u.d == 0xFFFFFFFFFFFFFFFFULL) break;  // nobody left in the chain
+    if (stat != ONE_WIRE_NO_ERROR ||
+        ds28ea00_chain_cmd(0xA5, 0x96) != ONE_WIRE_NO_ERROR) {  // chain DONE
+      num = ONE_WIRE_SEARCH_ROM_FAILURE;
+      break;
+    }
+    devs[num++] = u.d;
+  }
+  ds28ea00_chain_cmd(0xCC, 0x3C);  // chain OFF
+  oneWire_bus_unlock();
+  return num;
+}
+
+// runs one I2C transaction through the DS28E17 bridge
+static oneWire_status ds28e17_xfer(uint64_t rom, bool resume, oneWire_i2c_xfer_t *x) {
+  uint8_t cmd[9 + 5 + DS28E17_MAX_DATA + 2];
+  if (x->wlen > DS28E17_MAX_DATA || (x->wlen == 0 && x->rlen == 0)) {
+    return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  }
+  int n;
+  if (resume) {
+    cmd[0] = 0xA5;
+    n = 1;
+  } else {
+    n = oneWire_match_rom_cmd(rom, cmd);
+  }
+  int start = n;
+  if (x->rlen == 0) {
+    cmd[n++] = 0x4B;  // write data with stop
+    cmd[n++] = x->addr << 1;
+  } else if (x->wlen == 0) {
+    cmd[n++] = 0x87;  // read data with stop
+    cmd[n++] = (x->addr << 1) | 1;
+  } else {
+    cmd[n++] = 0x2D;  // write read data with stop
+    cmd[n++] = x->addr << 1;
+  }
+  if (x->wlen > 0) {
+    cmd[n++] = x->wlen;
+    memcpy(&cmd[n], x->wdata, x->wlen);
+    n += x->wlen;
+  }
+  if (x->rlen > 0) cmd[n++] = x->rlen;
+  uint16_t crc = ~oneWire_CRC16(0, &cmd[start], n - start);
+  cmd[n++] = crc & 0xFF;
+  cmd[n++] = crc >> 8;
+  oneWire_transaction(true, cmd, n, NULL, 0, ONE_WIRE_CRC_NONE);
+  // the bridge reads 1 until the I2C transfer is done
+  int polls;
+  for (polls = 0;  polls < DS28E17_MAX_POLLS; polls++) {
+    oneWire_push_read_cmd(1);
+    if (oneWire_pull_read_data(1) == 0) break;
+  }
+  if (polls == DS28E17_MAX_POLLS) return ONE_WIRE_FIFO_TIMEOUT;
+  uint8_t status[2] = {0, 0};
+  oneWire_transaction(false, NULL, 0, status, (x->wlen > 0) ? 2 : 1, ONE_WIRE_CRC_NONE);
+  x->i2c_status = status[0];
+  x->write_status = status[1];
+  if (status[0] != 0 || status[1] != 0) return ONE_WIRE_I2C_FAILURE;
+  if (x->rlen > 0) {
+    oneWire_transaction(false, NULL, 0, x->rdata, x->rlen, ONE_WIRE_CRC_NONE);
+  }
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_ds28e17_run runs num I2C transactions through the DS28E17 with the given rom
+// back to back.  Each one is packed with its CRC16 into a single 1-Wire write burst, 
+// then the busy bit is polled one slot at a time until the I2C transfer is done and
+// the status and any data are read.  The first transaction selects the bridge with 
+// match rom and the rest use resume rom.  The bus is locked for the whole queue.
+// returns the number of transactions that worked.  The status of each is in xfers[].
+int oneWire_ds28e17_run(uint64_t rom, oneWire_i2c_xfer_t xfers[], int num) {
+  int good = 0;
+  bool resume = false;
+  oneWire_bus_lock();
+  for (int i = 0;  i < num; i++) {
+    xfers[i].status = ds28e17_xfer(rom, resume, &xfers[i]);
+    if (xfers[i].status == ONE_WIRE_NO_ERROR) good++;
+    // after a failure select the bridge with match rom again to be safe
+    resume = (xfers[i].status == ONE_WIRE_NO_ERROR);
+  }
+  oneWire_bus_unlock();
+  return good;
+}
+
+// sends a DS2409 command to one coupler and checks the confirmation byte.  The smart
+// on commands have a reset stimulus byte before the confirmation.
+static oneWire_status ds2409_cmd(uint64_t rom, uint8_t ds_cmd) {
+  uint8_t cmd[10];
+  uint8_t resp[2];
+  int len = oneWire_match_rom_cmd(rom, cmd);
+  cmd[len++] = ds_cmd;
+  int resp_len = (ds_cmd == 0x66) ? 1 : 2;
+  oneWire_status stat = oneWire_transaction(true, cmd, len, resp, resp_len, ONE_WIRE_CRC_NONE);
+  if (stat != ONE_WIRE_NO_ERROR) return stat;
+  if (resp[resp_len - 1] != ds_cmd) return ONE_WIRE_COUPLER_FAILURE;
+  return ONE_WIRE_NO_ERROR;
+}
+
+// switches one coupler to branch and updates the cache
+static oneWire_status ds2409_switch(oneWire_ds2409_net_t *net, int c, uint8_t branch) {
+  static const uint8_t branch_cmd[3] = {0x66, 0xCC, 0x33};  // all off, smart on main, aux
+  net->switches++;
+  oneWire_status stat = ds2409_cmd(net->couplers[c], branch_cmd[branch]);
+  net->branch[c] = (stat == ONE_WIRE_NO_ERROR) ? branch : DS2409_BRANCH_UNKNOWN;
+  return stat;
+}
+
+// oneWire_ds2409_init sets up net with the num couplers in couplers[] and turns 
+// every branch off so the cached state matches the wire.
+// returns 0 if all couplers confirmed the all lines off.
+oneWire_status oneWire_ds2409_init(oneWire_ds2409_net_t *net, const uint64_t couplers[], 
+                                   int num) {
+  oneWire_status ret = ONE_WIRE_NO_ERROR;
+  if (num > DS2409_MAX_COUPLERS) num = DS2409_MAX_COUPLERS;
+  net->num_couplers = num;
+  net->switches = 0;
+  net->selects = 0;
+  oneWire_bus_lock();
+  for (int c = 0;  c < num; c++) {
+    net->couplers[c] = couplers[c];
+    if (ds2409_switch(net, c, DS2409_BRANCH_OFF) != ONE_WIRE_NO_ERROR) {
+      ret = ONE_WIRE_COUPLER_FAILURE;
+    }
+  }
+  oneWire_bus_unlock();
+  return ret;
+}
+
+// oneWire_ds2409_select makes the branch of coupler the only branch switched on.  Any
+// other coupler with a branch on is turned off first.  Nothing goes on the wire if the
+// cache says the branch is already the only one on.  A coupler of -1 is the trunk and
+// only needs the other branches off.  A failed command marks the coupler unknown so
+// the next select sends it again.
+// returns 0 if successful, error code if a coupler did not confirm a command.
+oneWire_status oneWire_ds2409_select(oneWire_ds2409_net_t *net, int coupler, uint8_t branch) {
+  oneWire_status ret = ONE_WIRE_NO_ERROR;
+  net->selects++;
+  oneWire_bus_lock();
+  // other branches off first so two branches are never on together
+  for (int c = 0;  c < net->num_couplers; c++) {
+    if (c != coupler && net->branch[c] != DS2409_BRANCH_OFF) {
+      if (ds2409_switch(net, c, DS2409_BRANCH_OFF) != ONE_WIRE_NO_ERROR) {
+        ret = ONE_WIRE_COUPLER_FAILURE;
+      }
+    }
+  }
+  if (coupler >= 0 && net->branch[coupler] != branch) {
+    if (ds2409_switch(net, coupler, branch) != ONE_WIRE_NO_ERROR) {
+      ret = ONE_WIRE_COUPLER_FAILURE;
+    }
+  }
+  oneWire_bus_unlock();
+  return ret;
+}
+
+// sort key for a transaction, the trunk first, then the branch on now, then each 
+// coupler main then aux
+static inline int ds2409_key(const oneWire_ds2409_op_t *op, int on_key) {
+  if (op->coupler < 0) return 0;
+  int k = op->coupler * 2 + op->branch;
+  return (k == on_key) ? 1 : k + 2;
+}
+
+// oneWire_ds2409_run runs the num transactions in ops[] with the fewest branch 
+// switches.  ops[] is sorted in place by branch, starting with whatever branch is on
+// now, so each branch is switched on once per call and its transactions run together.
+// Trunk transactions run first since they need nothing switched.
+// returns the number of transactions that worked.  The status of each is in ops[].
+int oneWire_ds2409_run(oneWire_ds2409_net_t *net, oneWire_ds2409_op_t ops[], int num) {
+  // the branch on now, if any, gets the key just after the trunk
+  int on_key = -1;
+  for (int c = 0;  c < net->num_couplers; c++) {
+    if (net->branch[c] == DS2409_BRANCH_MAIN || net->branch[c] == DS2409_BRANCH_AUX) {
+      on_key = c * 2 + net->branch[c];
+    }
+  }
+  // stable insertion sort, the lists are short
+  for (int i = 1;  i < num; i++) {
+    oneWire_ds2409_op_t op = ops[i];
+    int k = ds2409_key(&op, on_key);
+    int j = i - 1;
+    while (j >= 0) {
+      if (ds2409_key(&ops[j], on_key) <= k) break;
+      ops[j + 1] = ops[j];
+      j--;
+    }
+    ops[j + 1] = op;
+  }
+  int good = 0;
+  oneWire_bus_lock();
+  for (int i = 0;  i < num; i++) {
+    oneWire_ds2409_op_t *op = &ops[i];
+    // trunk devices can be seen whatever is switched on
+    if (op->coupler >= 0) {
+      op->status = oneWire_ds2409_select(net, op->coupler, op->branch);
+    } else {
+      op->status = ONE_WIRE_NO_ERROR;
+    }
+    if (op->status == ONE_WIRE_NO_ERROR) op->status = op->run(op->arg);
+    if (op->status == ONE_WIRE_NO_ERROR) good++;
+  }
+  oneWire_bus_unlock();
+  return good;
+}
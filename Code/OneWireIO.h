@@ -0,0 +1,199 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef ONE_WIRE_IO_H
+#define ONE_WIRE_IO_H
+
+#include "OneWire.h"
+#include "OneWireDrivers.h"
+
+// DS2408 channel access read sends 32 samples then a CRC16, over and over
+#define DS2408_STREAM_BLOCK 32
+
+// oneWire_ds2408_stream_t holds the state of a DS2408 channel access stream and the
+// ring buffer the samples go to.  The ring buffer is supplied by the caller.
+typedef struct oneWire_ds2408_stream {
+  uint8_t *ring;
+  uint16_t ring_size;
+  volatile uint16_t head;     // next sample written
+  volatile uint16_t tail;     // next sample read
+  uint8_t block[DS2408_STREAM_BLOCK + 2];
+  int block_pos;
+  bool first_block;           // CRC of the first block includes the command
+  int outstanding;            // 32 bit reads pushed and not pulled
+  uint32_t blocks;            // good blocks received
+  uint32_t crc_errors;        // blocks thrown away because of a bad CRC
+  uint32_t overruns;          // samples lost because the ring was full
+} oneWire_ds2408_stream_t;
+
+// oneWire_ds2408_stream_start starts a channel access read on the DS2408 with the 
+// given rom.  Samples are put in ring[] which holds ring_size - 1 samples.  The bus
+// stays locked until oneWire_ds2408_stream_stop() so nothing else can use it.
+// returns 0 if successful.
+// returns error code if ring_size is less than 2 or the command could not be sent, 
+// the bus is not left locked.
+oneWire_status oneWire_ds2408_stream_start(oneWire_ds2408_stream_t *s, uint64_t rom,
+                                           uint8_t ring[], uint16_t ring_size);
+
+// oneWire_ds2408_stream_poll keeps the Tx FIFO full of reads and moves whatever has
+// arrived in the Rx FIFO into the current block.  When a block and its CRC16 are in,
+// the CRC is checked and the 32 samples go to the ring buffer.  Never waits so it
+// should be called often, at least once per 4 samples, to keep the bus busy.
+// returns the number of samples added to the ring buffer.
+int oneWire_ds2408_stream_poll(oneWire_ds2408_stream_t *s);
+
+// oneWire_ds2408_stream_get takes the oldest sample out of the ring buffer.
+// returns false if the ring buffer is empty.
+bool oneWire_ds2408_stream_get(oneWire_ds2408_stream_t *s, uint8_t *sample);
+
+// oneWire_ds2408_stream_stop waits for the reads in flight, ends the channel access
+// read with a reset and releases the bus.
+void oneWire_ds2408_stream_stop(oneWire_ds2408_stream_t *s);
+
+// oneWire_ds2413_t is a DS2413 dual switch being polled with oneWire_ds2413_poll().
+typedef struct oneWire_ds2413 {
+  uint64_t rom;            // 0 to use skip rom when it is the only device on the bus
+  uint32_t polls;
+  uint32_t reselects;      // times resume found nobody and match rom had to be used
+  uint32_t bad_reads;      // reads that failed the complement check
+} oneWire_ds2413_t;
+
+// oneWire_ds2413_poll reads the PIO state of a DS2413 with as few slots as possible.
+// When the device is the one oneWire_get_selected_rom() reports, resume rom (0xA5) 
+// is used instead of match rom so a poll is a reset plus 24 slots.  Otherwise match 
+// rom is used.  With rom = 0 skip rom is used.
+// The status byte is checked with its complement nibble since there is no CRC.
+// *state gets PIO A state in bit 0, PIO A latch in bit 1, PIO B state in bit 2 and 
+// PIO B latch in bit 3.
+// returns 0 if successful.
+// returns error code if the complement check fails.
+oneWire_status oneWire_ds2413_poll(oneWire_ds2413_t *d, uint8_t *state);
+
+// oneWire_ds2413_poll_burst reads num more status bytes after one PIO access read
+// command.  The DS2413 sends a new sample for every byte read so after the first one
+// a sample costs 8 slots.  The bus is locked for the whole burst.
+// returns the number of good samples put in states[].
+int oneWire_ds2413_poll_burst(oneWire_ds2413_t *d, uint8_t states[], int num);
+
+// DS2438 worst case conversion times
+#define DS2438_CONVERT_T_MS 10
+#define DS2438_CONVERT_V_MS 10
+
+// oneWire_ds2438_sweep reads temperature and voltage from all num DS2438 battery 
+// monitors in roms[].  Instead of a convert and read per device it sends convert T
+// to every device with skip rom, then convert V the same way, then reads page 0 of 
+// each device back to back.  The read is a recall memory followed by a read 
+// scratchpad, each with its own match rom since the DS2438 has no resume rom.  Results are decoded by the DS2438 driver into
+// readings[], temperature in C, voltage in V and the raw current register.
+// If sweep_us is not NULL the time the whole sweep took is put there.
+// returns the number of devices read successfully.
+int oneWire_ds2438_sweep(const uint64_t roms[], int num, oneWire_reading_t readings[],
+                         uint32_t *sweep_us);
+
+// DS2450 worst case time to convert all 4 channels at 16 bits
+#define DS2450_CONVERT_MS 6
+
+// oneWire_ds2450_sweep converts all four channels of every DS2450 on the bus with one
+// skip rom convert command, so a sweep costs one conversion time for the whole bus.
+// Then the conversion page of each of the num devices in roms[] is read with its 
+// CRC16 straight into the reading.  The four values in readings[] are the channel 
+// results scaled to full_scale, normally the 2.56 or 5.12 volt range the channels 
+// are set up for.  The devices must have VCC power.
+// returns the number of devices read successfully.
+int oneWire_ds2450_sweep(const uint64_t roms[], int num, oneWire_reading_t readings[],
+                         float full_scale);
+
+// oneWire_ds28ea00_chain finds the DS28EA00s on a linear bus in physical order using 
+// the sequence detect chain.  All devices are put in chain mode with skip rom, then each
+// pass does a conditional read rom, which only the first device not yet done answers,
+// and marks that device done with resume rom and chain DONE.  That is one read rom per
+// device instead of a full search pass and devs[0] is the device nearest the master.
+// At most max_devs roms are put in devs[].  Chain mode is turned off at the end.
+// returns the number of devices found.
+// returns error code if a rom fails its CRC or a chain command is not confirmed.
+int oneWire_ds28ea00_chain(uint64_t devs[], int max_devs);
+
+#define DS28E17_MAX_DATA 64
+// busy polls are one slot each so this is about 65ms
+#define DS28E17_MAX_POLLS 1000
+
+// oneWire_i2c_xfer_t is one I2C transaction through a DS28E17 bridge.  With wlen > 0
+// and rlen = 0 it is a write, with wlen = 0 and rlen > 0 a read, with both a write
+// then a repeated start read.  Every transaction ends with an I2C stop.
+typedef struct oneWire_i2c_xfer {
+  uint8_t addr;            // 7 bit I2C address
+  const uint8_t *wdata;
+  uint8_t wlen;
+  uint8_t *rdata;
+  uint8_t rlen;
+  // set by oneWire_ds28e17_run()
+  uint8_t i2c_status;      // DS28E17 status byte, 0 if the I2C transfer worked
+  uint8_t write_status;    // bytes not acked, 0 if all were
+  oneWire_status status;
+} oneWire_i2c_xfer_t;
+
+// oneWire_ds28e17_run runs num I2C transactions through the DS28E17 with the given rom
+// back to back.  Each one is packed with its CRC16 into a single 1-Wire write burst, 
+// then the busy bit is polled one slot at a time until the I2C transfer is done and
+// the status and any data are read.  The first transaction selects the bridge with 
+// match rom and the rest use resume rom.  The bus is locked for the whole queue.
+// returns the number of transactions that worked.  The status of each is in xfers[].
+int oneWire_ds28e17_run(uint64_t rom, oneWire_i2c_xfer_t xfers[], int num);
+
+#define DS2409_MAX_COUPLERS 8
+// branch numbers for a DS2409 coupler
+#define DS2409_BRANCH_OFF     0
+#define DS2409_BRANCH_MAIN    1
+#define DS2409_BRANCH_AUX     2
+#define DS2409_BRANCH_UNKNOWN 0xFF
+
+// oneWire_ds2409_net_t is a trunk with DS2409 couplers on it.  The branch each coupler
+// has switched on is kept so a branch is only switched when it has to be.  The trunk 
+// itself can always be seen so devices on the trunk use coupler -1.
+typedef struct oneWire_ds2409_net {
+  uint64_t couplers[DS2409_MAX_COUPLERS];
+  uint8_t branch[DS2409_MAX_COUPLERS];   // what each coupler has on, or unknown
+  int num_couplers;
+  uint32_t switches;       // smart on and all lines off commands sent
+  uint32_t selects;        // oneWire_ds2409_select() calls
+} oneWire_ds2409_net_t;
+
+// oneWire_ds2409_op_t is one transaction to run on a branched network.  run() is
+// called with the bus locked and the branch already switched on.
+typedef struct oneWire_ds2409_op {
+  int coupler;             // index in the net couplers[], -1 for the trunk
+  uint8_t branch;          // DS2409_BRANCH_MAIN or DS2409_BRANCH_AUX
+  oneWire_status (*run)(void *arg);
+  void *arg;
+  oneWire_status status;   // set by oneWire_ds2409_run()
+} oneWire_ds2409_op_t;
+
+// oneWire_ds2409_init sets up net with the num couplers in couplers[] and turns 
+// every branch off so the cached state matches the wire.
+// returns 0 if all couplers confirmed the all lines off.
+oneWire_status oneWire_ds2409_init(oneWire_ds2409_net_t *net, const uint64_t couplers[], 
+                                   int num);
+
+// oneWire_ds2409_select makes the branch of coupler the only branch switched on.  Any
+// other coupler with a branch on is turned off first.  Nothing goes on the wire if the
+// cache says the branch is already the only one on.  A coupler of -1 is the trunk and
+// only needs the other branches off.  A failed command marks the coupler unknown so
+// the next select sends it again.
+// returns 0 if successful, error code if a coupler did not confirm a command.
+oneWire_status oneWire_ds2409_select(oneWire_ds2409_net_t *net, int coupler, uint8_t branch);
+
+// oneWire_ds2409_run runs the num transactions in ops[] with the fewest branch 
+// switches.  ops[] is sorted in place by branch, starting with whatever branch is on
+// now, so each branch is switched on once per call and its transactions run together.
+// Trunk transactions run first since they need nothing switched.
+// returns the number of transactions that worked.  The status of each is in ops[].
+int oneWire_ds2409_run(oneWire_ds2409_net_t *net, oneWire_ds2409_op_t ops[], int num);
+
+// error codes
+#define ONE_WIRE_I2C_FAILURE -12
+#define ONE_WIRE_COUPLER_FAILURE -14
+
+#endif //ONE_WIRE_IO_H
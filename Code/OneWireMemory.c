@@ -0,0 +1,449 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireDrivers.h"
+#include "OneWireMemory.h"
+
+#define MEM_WRITE  0   // next row needs writing
+#define MEM_BUSY   1   // copy scratchpad in progress
+#define MEM_DONE   2
+#define MEM_FAILED 3
+
+typedef struct mem_cache_page {
+  uint64_t rom;
+  uint16_t address;       // page aligned
+  uint16_t crc;           // CRC16 of data when it was read
+  uint32_t generation;    // search generation when it was read
+  uint32_t last_use;
+  bool valid;
+  uint8_t data[ONE_WIRE_MEM_PAGE_SIZE];
+} mem_cache_page_t;
+
+static struct {
+  mem_cache_page_t pages[ONE_WIRE_MEM_CACHE_PAGES];
+  uint32_t use_count;
+  oneWire_mem_cache_stats_t stats;
+} omc;
+
+// oneWire_mem_row_size returns the scratchpad size of an EEPROM family.
+// returns 0 if the family is not a supported EEPROM.
+int oneWire_mem_row_size(uint8_t family) {
+  switch (family) {
+  case 0x2D: return 8;   // DS2431
+  case 0x43: return 32;  // DS28EC20
+  }
+  return 0;
+}
+
+// oneWire_mem_read reads len bytes starting at address from a memory device with the
+// read memory command into data[].  There is no CRC on this command.
+// returns 0 if successful.
+oneWire_status oneWire_mem_read(uint64_t rom, uint16_t address, uint8_t data[], int len) {
+  uint8_t cmd[12];
+  int n = oneWire_match_rom_cmd(rom, cmd);
+  cmd[n++] = 0xF0;
+  cmd[n++] = address & 0xFF;
+  cmd[n++] = address >> 8;
+  return oneWire_transaction(true, cmd, n, data, len, ONE_WIRE_CRC_NONE);
+}
+
+// writes one row to the scratchpad, checks it and starts the copy.
+// returns 0 if the copy was started.
+static oneWire_status mem_write_row(oneWire_mem_write_t *job, int row) {
+  uint8_t cmd[9 + 3 + 32];
+  uint8_t resp[3 + 32 + 2];
+  uint16_t ta = job->address + job->done;
+  oneWire_mem_cache_invalidate(job->rom, ta, row);
+  // write scratchpad and check the CRC16 of command, address and data
+  int n = oneWire_match_rom_cmd(job->rom, cmd);
+  cmd[n++] = 0x0F;
+  cmd[n++] = ta & 0xFF;
+  cmd[n++] = ta >> 8;
+  memcpy(&cmd[n], &job->data[job->done], row);
+  n += row;
+  oneWire_status stat = oneWire_transaction(true, cmd, n, resp, 2, ONE_WIRE_CRC16);
+  if (stat != ONE_WIRE_NO_ERROR) return stat;
+  // read scratchpad back to get E/S and make sure it holds what was sent
+  n = oneWire_match_rom_cmd(job->rom, cmd);
+  cmd[n++] = 0xAA;
+  stat = oneWire_transaction(true, cmd, n, resp, 3 + row + 2, ONE_WIRE_CRC16);
+  if (stat != ONE_WIRE_NO_ERROR) return stat;
+  if (resp[0] != (ta & 0xFF) || resp[1] != (ta >> 8) || 
+      memcmp(&resp[3], &job->data[job->done], row) != 0) {
+    return ONE_WIRE_MEM_VERIFY_FAILURE;
+  }
+  // copy scratchpad with the authorization code
+  n = oneWire_match_rom_cmd(job->rom, cmd);
+  cmd[n++] = 0x55;
+  cmd[n++] = resp[0];
+  cmd[n++] = resp[1];
+  cmd[n++] = resp[2];
+  oneWire_transaction(true, cmd, n, NULL, 0, ONE_WIRE_CRC_NONE);
+  return ONE_WIRE_NO_ERROR;
+}
+
+// counts a failed row and gives up on the job after too many.
+static void mem_row_failed(oneWire_mem_write_t *job, oneWire_status stat, 
+                           oneWire_mem_stats_t *st) {
+  st->retries++;
+  if (++job->retries > ONE_WIRE_EEPROM_RETRIES) {
+    job->status = stat;
+    job->state = MEM_FAILED;
+  } else {
+    job->state = MEM_WRITE;
+  }
+}
+
+// the write in progress, between oneWire_mem_write_start() and the last step
+static struct {
+  oneWire_mem_stats_t st;
+  uint64_t start;
+  int remaining;
+} omw;
+
+// oneWire_mem_write_start sets up num jobs for oneWire_mem_write_step().  Jobs that 
+// don't line up with the rows of their device are marked failed with 
+// ONE_WIRE_MEM_NOT_SUPPORTED here.  Only one set of jobs can be in progress.
+void oneWire_mem_write_start(oneWire_mem_write_t jobs[], int num) {
+  omw.st = (oneWire_mem_stats_t){0};
+  omw.start = time_us_64();
+  omw.remaining = 0;
+  for (int i = 0;  i < num; i++) {
+    oneWire_mem_write_t *job = &jobs[i];
+    int row = oneWire_mem_row_size(job->rom & 0xFF);
+    job->done = 0;
+    job->retries = 0;
+    job->status = ONE_WIRE_NO_ERROR;
+    job->state = MEM_WRITE;
+    if (row == 0 || job->address % row != 0 || job->len % row != 0) {
+      job->status = ONE_WIRE_MEM_NOT_SUPPORTED;
+      job->state = MEM_FAILED;
+    } else if (job->len == 0) {
+      job->state = MEM_DONE;
+    } else {
+      omw.remaining++;
+    }
+  }
+}
+
+// oneWire_mem_write_step does the bus work the jobs need now and returns without 
+// waiting for a copy to finish.  Each device whose copy is done has its row read back
+// and compared, then each device that is not busy has its next row written and 
+// copied.  A row that fails is retried ONE_WIRE_EEPROM_RETRIES times.  Between steps 
+// the bus is free for other work, such as a sensor sweep, while the devices program 
+// for tPROG.  *next is set to when the next step has something to do.
+// returns true when every job is done or failed.
+bool oneWire_mem_write_step(oneWire_mem_write_t jobs[], int num, absolute_time_t *next) {
+  bool all_busy = true;
+  absolute_time_t earliest = at_the_end_of_time;
+  for (int i = 0;  i < num; i++) {
+    oneWire_mem_write_t *job = &jobs[i];
+    int row = oneWire_mem_row_size(job->rom & 0xFF);
+    if (job->state == MEM_BUSY) {
+      if (!time_reached(job->ready)) {
+        if (absolute_time_diff_us(job->ready, earliest) > 0) earliest = job->ready;
+        continue;
+      }
+      // the copy is done so read the row back from memory and compare
+      uint8_t check[32];
+      oneWire_mem_read(job->rom, job->address + job->done, check, row);
+      // a cached read during the copy may have picked up the old row
+      oneWire_mem_cache_invalidate(job->rom, job->address + job->done, row);
+      if (memcmp(check, &job->data[job->done], row) == 0) {
+        job->done += row;
+        job->retries = 0;
+        omw.st.bytes += row;
+        job->state = (job->done >= job->len) ? MEM_DONE : MEM_WRITE;
+      } else {
+        mem_row_failed(job, ONE_WIRE_MEM_VERIFY_FAILURE, &omw.st);
+      }
+      if (job->state == MEM_DONE || job->state == MEM_FAILED) omw.remaining--;
+    }
+    if (job->state == MEM_WRITE) {
+      all_busy = false;
+      oneWire_status stat = mem_write_row(job, row);
+      if (stat == ONE_WIRE_NO_ERROR) {
+        job->state = MEM_BUSY;
+        // tPROG starts when the copy command is out on the wire, not when it
+        // was pushed to the FIFO
+        oneWire_wait_for_sm_idle();
+        job->ready = make_timeout_time_us(ONE_WIRE_EEPROM_TPROG_US);
+      } else {
+        mem_row_failed(job, stat, &omw.st);
+        if (job->state == MEM_FAILED) omw.remaining--;
+      }
+    }
+  }
+  // a device that was written this time may be ready to go again right away
+  if (next != NULL) *next = all_busy ? earliest : get_absolute_time();
+  return omw.remaining == 0;
+}
+
+// oneWire_mem_write_result counts the jobs that completed after the last step.  If 
+// stats is not NULL the throughput from oneWire_mem_write_start() on is put there.
+// returns the number of jobs that completed.  The status of each is in the job.
+int oneWire_mem_write_result(const oneWire_mem_write_t jobs[], int num, 
+                             oneWire_mem_stats_t *stats) {
+  omw.st.time_us = time_us_64() - omw.start;
+  omw.st.bytes_per_s = omw.st.time_us ? (uint64_t)omw.st.bytes * 1000000 / omw.st.time_us : 0;
+  if (stats != NULL) *stats = omw.st;
+  int good = 0;
+  for (int i = 0;  i < num; i++) {
+    if (jobs[i].state == MEM_DONE) good++;
+  }
+  return good;
+}
+
+// oneWire_mem_write_all writes all num jobs to DS2431 or DS28EC20 EEPROMs.  Each row 
+// is written to the scratchpad and checked against the CRC16 the device returns, read 
+// back from the scratchpad and checked again, then copied.  While a device is busy 
+// for the 10ms copy the engine works on the other devices so several devices are 
+// programmed at once.  After the copy the row is read back from memory and compared
+// before the next row is started.  A row that fails is retried ONE_WIRE_EEPROM_RETRIES
+// times.  The devices must be powered well enough to program with other traffic on
+// the bus.  It sleeps when every device is busy, use oneWire_mem_write_step() to use
+// the bus for something else then.  If stats is not NULL the throughput is put there.
+// returns the number of jobs that completed.  The status of each is in the job.
+int oneWire_mem_write_all(oneWire_mem_write_t jobs[], int num, oneWire_mem_stats_t *stats) {
+  absolute_time_t next;
+  oneWire_mem_write_start(jobs, num);
+  while (!oneWire_mem_write_step(jobs, num, &next)) sleep_until(next);
+  return oneWire_mem_write_result(jobs, num, stats);
+}
+
+// starts a read memory with CRC at address.  In overdrive the device is put in overdrive 
+// with overdrive match rom and the rest is sent at overdrive speed.
+static void mem_start_read_crc(uint64_t rom, uint16_t address, const uint8_t password[8],
+                               bool overdrive) {
+  uint8_t cmd[9 + 11];
+  int n = oneWire_match_rom_cmd(rom, cmd);
+  if (overdrive) {
+    uint8_t od = 0x69;  // overdrive match rom, the rom follows at overdrive speed
+    oneWire_transaction(true, &od, 1, NULL, 0, ONE_WIRE_CRC_NONE);
+    oneWire_set_overdrive(true);
+    oneWire_transaction(false, &cmd[1], 8, NULL, 0, ONE_WIRE_CRC_NONE);
+    n = 0;
+  }
+  cmd[n++] = 0x69;
+  cmd[n++] = address & 0xFF;
+  cmd[n++] = address >> 8;
+  for (int i = 0;  i < 8; i++) cmd[n++] = password ? password[i] : 0xFF;
+  oneWire_transaction(!overdrive, cmd, n, NULL, 0, ONE_WIRE_CRC_NONE);
+}
+
+// oneWire_mem_read_pages streams len bytes, a whole number of 32 byte pages starting
+// at the page aligned address, from a device with the read memory with CRC command
+// (0x69) such as the DS1922/DS1923 loggers.  The data goes straight into buf[] and 
+// each page is checked with its CRC16 as it arrives.  The command runs on to the end 
+// of memory so the pages come one after another with no new command.  A page that 
+// fails the CRC starts a new command at that page, up to ONE_WIRE_EEPROM_RETRIES times.
+// password is the 8 byte read password or NULL if none is set.
+// If overdrive is true the transfer is done at overdrive speed.
+// If stats is not NULL the throughput is put there.
+// returns 0 if successful.
+// returns error code if a page can't be read with a good CRC.
+oneWire_status oneWire_mem_read_pages(uint64_t rom, uint16_t address, uint8_t buf[], int len,
+                                      const uint8_t password[8], bool overdrive,
+                                      oneWire_mem_stats_t *stats) {
+  oneWire_mem_stats_t st = {0};
+  if (address % ONE_WIRE_MEM_PAGE_SIZE != 0 || len % ONE_WIRE_MEM_PAGE_SIZE != 0) {
+    return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  }
+  uint64_t start = time_us_64();
+  oneWire_status stat = ONE_WIRE_NO_ERROR;
+  int done = 0;
+  int retries = 0;
+  bool started = false;
+  bool first_page = false;
+  oneWire_bus_lock();
+  while (done < len) {
+    uint16_t page_address = address + done;
+    if (!started) {
+      mem_start_read_crc(rom, page_address, password, overdrive);
+      started = true;
+      first_page = true;
+    }
+    uint8_t crc[2];
+    uint8_t *page = &buf[done];
+    oneWire_transaction(false, NULL, 0, page, ONE_WIRE_MEM_PAGE_SIZE, ONE_WIRE_CRC_NONE);
+    oneWire_transaction(false, NULL, 0, crc, 2, ONE_WIRE_CRC_NONE);
+    // the first page after the command also covers the command and address
+    uint16_t c = 0;
+    if (first_page) {
+      uint8_t hdr[3] = {0x69, page_address & 0xFF, page_address >> 8};
+      c = oneWire_CRC16(0, hdr, 3);
+    }
+    c = oneWire_CRC16(c, page, ONE_WIRE_MEM_PAGE_SIZE);
+    first_page = false;
+    if ((crc[0] | (crc[1] << 8)) == (c ^ 0xFFFF)) {  // the device sends the CRC inverted
+      done += ONE_WIRE_MEM_PAGE_SIZE;
+      retries = 0;
+      continue;
+    }
+    // start over at this page
+    st.retries++;
+    started = false;
+    if (overdrive) oneWire_set_overdrive(false);
+    if (++retries > ONE_WIRE_EEPROM_RETRIES) {
+      stat = ONE_WIRE_READ_CRC_FAILURE;
+      break;
+    }
+  }
+  if (overdrive && started) oneWire_set_overdrive(false);
+  oneWire_reset(true);  // back to standard speed and ends the read
+  oneWire_bus_unlock();
+  st.bytes = done;
+  st.time_us = time_us_64() - start;
+  st.bytes_per_s = st.time_us ? (uint64_t)st.bytes * 1000000 / st.time_us : 0;
+  if (stats != NULL) *stats = st;
+  return stat;
+}
+
+// oneWire_logger_read_log reads len bytes of the mission log of a DS1922/DS1923 into
+// buf[] using oneWire_mem_read_pages().  The full log is 8KB.
+// returns 0 if successful.
+oneWire_status oneWire_logger_read_log(uint64_t rom, uint8_t buf[], int len, 
+                                       const uint8_t password[8], bool overdrive,
+                                       oneWire_mem_stats_t *stats) {
+  if (len > ONE_WIRE_LOGGER_LOG_SIZE) return ONE_WIRE_ILLEGAL_DATA_SIZE_REQ;
+  return oneWire_mem_read_pages(rom, ONE_WIRE_LOGGER_LOG_ADDRESS, buf, len, password,
+                                overdrive, stats);
+}
+
+// reads one page from the bus into the cache page.  A DS28EC20 uses extended read 
+// memory which ends the page with the inverted CRC16 of the command, address and data.
+// Read memory has no CRC so other families are read twice and both reads must agree.
+static oneWire_status mem_cache_fill(mem_cache_page_t *p) {
+  uint8_t cmd[12];
+  uint8_t resp[ONE_WIRE_MEM_PAGE_SIZE + 2];
+  oneWire_status stat;
+  if ((p->rom & 0xFF) == 0x43) {
+    int n = oneWire_match_rom_cmd(p->rom, cmd);
+    cmd[n++] = 0xA5;
+    cmd[n++] = p->address & 0xFF;
+    cmd[n++] = p->address >> 8;
+    stat = oneWire_transaction(true, cmd, n, resp, sizeof(resp), ONE_WIRE_CRC16);
+  } else {
+    uint8_t again[ONE_WIRE_MEM_PAGE_SIZE];
+    stat = oneWire_mem_read(p->rom, p->address, resp, ONE_WIRE_MEM_PAGE_SIZE);
+    if (stat == ONE_WIRE_NO_ERROR) {
+      stat = oneWire_mem_read(p->rom, p->address, again, ONE_WIRE_MEM_PAGE_SIZE);
+    }
+    if (stat == ONE_WIRE_NO_ERROR && memcmp(resp, again, ONE_WIRE_MEM_PAGE_SIZE) != 0) {
+      stat = ONE_WIRE_MEM_READ_MISMATCH;
+    }
+  }
+  if (stat != ONE_WIRE_NO_ERROR) return stat;
+  memcpy(p->data, resp, ONE_WIRE_MEM_PAGE_SIZE);
+  p->crc = oneWire_CRC16(0, p->data, ONE_WIRE_MEM_PAGE_SIZE);
+  return ONE_WIRE_NO_ERROR;
+}
+
+// finds the cached page of rom at the page aligned address.  Pages from before the
+// last search are dropped on the way.
+// returns NULL if the page is not cached.
+static mem_cache_page_t *mem_cache_find(uint64_t rom, uint16_t address) {
+  uint32_t generation = oneWire_get_search_generation();
+  for (int i = 0;  i < ONE_WIRE_MEM_CACHE_PAGES; i++) {
+    mem_cache_page_t *p = &omc.pages[i];
+    if (!p->valid) continue;
+    if (p->generation != generation) {
+      p->valid = false;
+      continue;
+    }
+    if (p->rom == rom && p->address == address) return p;
+  }
+  return NULL;
+}
+
+// returns a free page, or the least recently used one if there are none
+static mem_cache_page_t *mem_cache_victim() {
+  mem_cache_page_t *victim = &omc.pages[0];
+  for (int i = 0;  i < ONE_WIRE_MEM_CACHE_PAGES; i++) {
+    mem_cache_page_t *p = &omc.pages[i];
+    if (!p->valid) return p;
+    if (p->last_use < victim->last_use) victim = p;
+  }
+  return victim;
+}
+
+// oneWire_mem_read_cached reads len bytes starting at address from a memory device 
+// into data[] a page at a time through a RAM cache, so static contents such as
+// calibration and identity data are only read from the bus once.  A page read from
+// a DS28EC20 is checked with the CRC16 of the extended read memory command.  Other 
+// families have no CRC on read memory so the page is read twice and only cached if
+// both reads agree.  Each cached page keeps a CRC16 of its data which is checked on
+// every hit.  Pages are thrown away when oneWire_mem_write_all() writes to them or a
+// new search rom is done, and the least recently used page is replaced when the cache
+// is full.
+// returns 0 if successful.
+// returns error code if a page read from the bus fails its CRC or the two reads differ.
+oneWire_status oneWire_mem_read_cached(uint64_t rom, uint16_t address, uint8_t data[], int len) {
+  int done = 0;
+  while (done < len) {
+    uint16_t addr = address + done;
+    uint16_t page_address = addr - addr % ONE_WIRE_MEM_PAGE_SIZE;
+    int offset = addr - page_address;
+    int n = ONE_WIRE_MEM_PAGE_SIZE - offset;
+    if (n > len - done) n = len - done;
+    mem_cache_page_t *p = mem_cache_find(rom, page_address);
+    if (p != NULL && oneWire_CRC16(0, p->data, ONE_WIRE_MEM_PAGE_SIZE) != p->crc) {
+      omc.stats.crc_rejects++;  // corrupted in RAM, read it again
+      p->valid = false;
+      p = NULL;
+    }
+    if (p != NULL) {
+      omc.stats.hits++;
+    } else {
+      p = mem_cache_victim();
+      p->valid = false;
+      p->rom = rom;
+      p->address = page_address;
+      uint32_t start = time_us_32();
+      oneWire_status stat = mem_cache_fill(p);
+      omc.stats.miss_us += time_us_32() - start;
+      omc.stats.misses++;
+      if (stat == (oneWire_status)ONE_WIRE_READ_CRC_FAILURE) omc.stats.crc_rejects++;
+      if (stat == (oneWire_status)ONE_WIRE_MEM_READ_MISMATCH) omc.stats.mismatches++;
+      if (stat != ONE_WIRE_NO_ERROR) return stat;
+      p->generation = oneWire_get_search_generation();
+      p->valid = true;
+    }
+    p->last_use = ++omc.use_count;
+    memcpy(&data[done], &p->data[offset], n);
+    done += n;
+  }
+  return ONE_WIRE_NO_ERROR;
+}
+
+// oneWire_mem_cache_invalidate throws away the cached pages of rom that hold any of
+// the len bytes starting at address.  A rom of 0 empties the whole cache.  Only needed
+// when memory is changed without oneWire_mem_write_all().
+void oneWire_mem_cache_invalidate(uint64_t rom, uint16_t address, int len) {
+  for (int i = 0;  i < ONE_WIRE_MEM_CACHE_PAGES; i++) {
+    mem_cache_page_t *p = &omc.pages[i];
+    if (!p->valid) continue;
+    if (rom == 0 || (p->rom == rom && p->address < address + len &&
+                     address < p->address + ONE_WIRE_MEM_PAGE_SIZE)) {
+      p->valid = false;
+      omc.stats.invalidations++;
+    }
+  }
+}
+
+// oneWire_mem_get_cache_stats puts the cache counters in stats.
+// If clear = true the counters are reset after they are read.
+void oneWire_mem_get_cache_stats(oneWire_mem_cache_stats_t *stats, bool clear) {
+  oneWire_mem_cache_stats_t *st = &omc.stats;
+  uint32_t reads = st->hits + st->misses;
+  st->hit_percent = reads ? (uint64_t)st->hits * 100 / reads : 0;
+  st->saved_us = st->misses ? (uint64_t)st->miss_us * st->hits / st->misses : 0;
+  *stats = *st;
+  if (clear) memset(st, 0, sizeof(oneWire_mem_cache_stats_t));
+}
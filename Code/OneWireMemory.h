@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef ONE_WIRE_MEMORY_H
+#define ONE_WIRE_MEMORY_H
+
+#include "OneWire.h"
+
+// Time a copy scratchpad takes to program the EEPROM, DS2431 and DS28EC20
+#define ONE_WIRE_EEPROM_TPROG_US 10000
+#define ONE_WIRE_EEPROM_RETRIES 3
+
+#define ONE_WIRE_MEM_PAGE_SIZE 32
+#define ONE_WIRE_LOGGER_LOG_ADDRESS 0x1000
+#define ONE_WIRE_LOGGER_LOG_SIZE 8192
+
+// oneWire_mem_stats_t reports the throughput of a memory engine call.
+typedef struct oneWire_mem_stats {
+  uint32_t bytes;         // bytes written or read successfully
+  uint32_t time_us;       // start to finish
+  uint32_t bytes_per_s;
+  uint32_t retries;       // rows or pages that had to be done again
+} oneWire_mem_stats_t;
+
+// oneWire_mem_write_t is one job for oneWire_mem_write_all().  Fill in the first four
+// fields.  address and len must be multiples of the row size of the device.
+// The rest is used by the engine and holds the result when it is done.
+typedef struct oneWire_mem_write {
+  uint64_t rom;
+  uint16_t address;
+  const uint8_t *data;
+  uint16_t len;
+  // set by the engine
+  uint16_t done;          // bytes written and verified
+  uint8_t state;
+  uint8_t retries;
+  absolute_time_t ready;  // when the copy in progress is finished
+  oneWire_status status;
+} oneWire_mem_write_t;
+
+// oneWire_mem_row_size returns the scratchpad size of an EEPROM family.
+// returns 0 if the family is not a supported EEPROM.
+int oneWire_mem_row_size(uint8_t family);
+
+// oneWire_mem_write_all writes all num jobs to DS2431 or DS28EC20 EEPROMs.  Each row 
+// is written to the scratchpad and checked against the CRC16 the device returns, read 
+// back from the scratchpad and checked again, then copied.  While a device is busy 
+// for the 10ms copy the engine works on the other devices so several devices are 
+// programmed at once.  After the copy the row is read back from memory and compared
+// before the next row is started.  A row that fails is retried ONE_WIRE_EEPROM_RETRIES
+// times.  The devices must be powered well enough to program with other traffic on
+// the bus.  It sleeps when every device is busy, use oneWire_mem_write_step() to use
+// the bus for something else then.  If stats is not NULL the throughput is put there.
+// returns the number of jobs that completed.  The status of each is in the job.
+int oneWire_mem_write_all(oneWire_mem_write_t jobs[], int num, oneWire_mem_stats_t *stats);
+
+// oneWire_mem_write_start sets up num jobs for oneWire_mem_write_step().  Jobs that 
+// don't line up with the rows of their device are marked failed with 
+// ONE_WIRE_MEM_NOT_SUPPORTED here.  Only one set of jobs can be in progress.
+void oneWire_mem_write_start(oneWire_mem_write_t jobs[], int num);
+
+// oneWire_mem_write_step does the bus work the jobs need now and returns without 
+// waiting for a copy to finish.  Each device whose copy is done has its row read back
+// and compared, then each device that is not busy has its next row written and 
+// copied.  A row that fails is retried ONE_WIRE_EEPROM_RETRIES times.  Between steps 
+// the bus is free for other work, such as a sensor sweep, while the devices program 
+// for tPROG.  *next is set to when the next step has something to do.
+// returns true when every job is done or failed.
+bool oneWire_mem_write_step(oneWire_mem_write_t jobs[], int num, absolute_time_t *next);
+
+// oneWire_mem_write_result counts the jobs that completed after the last step.  If 
+// stats is not NULL the throughput from oneWire_mem_write_start() on is put there.
+// returns the number of jobs that completed.  The status of each is in the job.
+int oneWire_mem_write_result(const oneWire_mem_write_t jobs[], int num, 
+                             oneWire_mem_stats_t *stats);
+
+// oneWire_mem_read reads len bytes starting at address from a memory device with the
+// read memory command into data[].  There is no CRC on this command.
+// returns 0 if successful.
+oneWire_status oneWire_mem_read(uint64_t rom, uint16_t address, uint8_t data[], int len);
+
+// oneWire_mem_read_pages streams len bytes, a whole number of 32 byte pages starting
+// at the page aligned address, from a device with the read memory with CRC command
+// (0x69) such as the DS1922/DS1923 loggers.  The data goes straight into buf[] and 
+// each page is checked with its CRC16 as it arrives.  The command runs on to the end 
+// of memory so the pages come one after another with no new command.  A page that 
+// fails the CRC starts a new command at that page, up to ONE_WIRE_EEPROM_RETRIES times.
+// password is the 8 byte read password or NULL if none is set.
+// If overdrive is true the transfer is done at overdrive speed.
+// If stats is not NULL the throughput is put there.
+// returns 0 if successful.
+// returns error code if a page can't be read with a good CRC.
+oneWire_status oneWire_mem_read_pages(uint64_t rom, uint16_t address, uint8_t buf[], int len,
+                                      const uint8_t password[8], bool overdrive,
+                                      oneWire_mem_stats_t *stats);
+
+// oneWire_logger_read_log reads len bytes of the mission log of a DS1922/DS1923 into
+// buf[] using oneWire_mem_read_pages().  The full log is 8KB.
+// returns 0 if successful.
+oneWire_status oneWire_logger_read_log(uint64_t rom, uint8_t buf[], int len, 
+                                       const uint8_t password[8], bool overdrive,
+                                       oneWire_mem_stats_t *stats);
+
+// pages of ONE_WIRE_MEM_PAGE_SIZE bytes kept by oneWire_mem_read_cached()
+#define ONE_WIRE_MEM_CACHE_PAGES 16
+
+// oneWire_mem_cache_stats_t reports how well the memory cache is doing.
+typedef struct oneWire_mem_cache_stats {
+  uint32_t hits;
+  uint32_t misses;          // pages read from the bus
+  uint32_t hit_percent;
+  uint32_t crc_rejects;     // pages that failed their CRC16, on the bus or in RAM
+  uint32_t mismatches;      // pages without a CRC whose two reads differed
+  uint32_t invalidations;   // pages thrown away by writes
+  uint32_t miss_us;         // bus time spent reading missed pages
+  uint32_t saved_us;        // bus time the hits would have cost at the same rate
+} oneWire_mem_cache_stats_t;
+
+// oneWire_mem_read_cached reads len bytes starting at address from a memory device 
+// into data[] a page at a time through a RAM cache, so static contents such as
+// calibration and identity data are only read from the bus once.  A page read from
+// a DS28EC20 is checked with the CRC16 of the extended read memory command.  Other 
+// families have no CRC on read memory so the page is read twice and only cached if
+// both reads agree.  Each cached page keeps a CRC16 of its data which is checked on
+// every hit.  Pages are thrown away when oneWire_mem_write_all() writes to them or a
+// new search rom is done, and the least recently used page is replaced when the cache
+// is full.
+// returns 0 if successful.
+// returns error code if a page read from the bus fails its CRC or the two reads differ.
+oneWire_status oneWire_mem_read_cached(uint64_t rom, uint16_t address, uint8_t data[], int len);
+
+// oneWire_mem_cache_invalidate throws away the cached pages of rom that hold any of
+// the len bytes starting at address.  A rom of 0 empties the whole cache.  Only needed
+// when memory is changed without oneWire_mem_write_all().
+void oneWire_mem_cache_invalidate(uint64_t rom, uint16_t address, int len);
+
+// oneWire_mem_get_cache_stats puts the cache counters in stats.
+// If clear = true the counters are reset after they are read.
+void oneWire_mem_get_cache_stats(oneWire_mem_cache_stats_t *stats, bool clear);
+
+// error codes
+#define ONE_WIRE_MEM_VERIFY_FAILURE -10
+#define ONE_WIRE_MEM_NOT_SUPPORTED -11
+#define ONE_WIRE_MEM_READ_MISMATCH -17
+
+#endif //ONE_WIRE_MEMORY_H
@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "OneWireSearch.h"
+
+#define ONE_WIRE_SEARCH_CMD_SLOTS 8
+
+// oneWire_search_init clears the search state for a new search.
+void oneWire_search_init(oneWire_search_t *s) {
+  s->rom = 0;
+  s->bit = 0;
+  s->last_discrepancy = -1;
+  s->last_zero = -1;
+  s->passes = 0;
+  s->slots = 0;
+}
+
+// oneWire_search_start_pass is called after each reset that had a presence pulse,
+// before the search rom command is written.
+void oneWire_search_start_pass(oneWire_search_t *s) {
+  s->bit = 0;
+  s->last_zero = -1;
+  s->passes++;
+  s->slots += ONE_WIRE_SEARCH_CMD_SLOTS;
+}
+
+// oneWire_search_branch takes the rom bit and complement read for the next bit and
+// works out the direction to write.  At a discrepancy it follows the prefix below
+// the last discrepancy, takes the 1 branch at it and the 0 branch after it.
+// returns the bit to write.
+// returns -1 if nobody answered or no device is left on the path to the next rom,
+// which means a device left the bus during the search.
+int oneWire_search_branch(oneWire_search_t *s, bool id, bool cmp) {
+  uint64_t mask = 1ULL << s->bit;
+  s->slots += 2;
+  if (id && cmp) return -1;  // nobody answered
+  bool dir;
+  if (s->bit <= s->last_discrepancy) {
+    // the prefix shared with the last rom and the 1 branch after it.  A device on
+    // that path must still be there.
+    dir = (s->bit < s->last_discrepancy) ? (s->rom & mask) != 0 : true;
+    if (id != cmp && id != dir) return -1;
+    if (!id && !cmp && !dir) s->last_zero = s->bit;
+  } else if (id != cmp) {
+    dir = id;
+  } else {
+    dir = false;
+    s->last_zero = s->bit;
+  }
+  if (dir) s->rom |= mask;
+  else s->rom &= ~mask;
+  s->bit++;
+  s->slots++;
+  return dir;
+}
+
+// oneWire_search_end_pass is called after the 64th bit.  The rom found is in s->rom.
+// returns true if there is another rom to find.
+bool oneWire_search_end_pass(oneWire_search_t *s) {
+  s->last_discrepancy = s->last_zero;
+  return s->last_discrepancy >= 0;
+}
@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef ONE_WIRE_SEARCH_H
+#define ONE_WIRE_SEARCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The branch logic of the last discrepancy search rom, kept apart from the slots
+// so it can be run against any bus, or none.  A pass is a reset, the search rom
+// command and 64 triplets: read the rom bit, read its complement, write the
+// direction.  Every device listens from bit 0 so the slots of a pass can't be
+// skipped, but the bits up to the last discrepancy are the prefix the previous rom
+// shares with the next one and are copied from it instead of being decided again.
+
+// oneWire_search_t is the state of one search kept between passes.
+typedef struct oneWire_search {
+  uint64_t rom;           // rom of this pass, past bit it is the rom of the last pass
+  int bit;                // next bit of this pass
+  int last_discrepancy;   // where this pass takes the 1 branch, -1 on the first pass
+  int last_zero;          // last discrepancy this pass took the 0 branch at
+  uint32_t passes;        // passes started, one reset each
+  uint32_t slots;         // read and write slots issued, not counting resets
+} oneWire_search_t;
+
+// oneWire_search_init clears the search state for a new search.
+void oneWire_search_init(oneWire_search_t *s);
+
+// oneWire_search_start_pass is called after each reset that had a presence pulse,
+// before the search rom command is written.
+void oneWire_search_start_pass(oneWire_search_t *s);
+
+// oneWire_search_branch takes the rom bit and complement read for the next bit and
+// works out the direction to write.  At a discrepancy it follows the prefix below
+// the last discrepancy, takes the 1 branch at it and the 0 branch after it.
+// returns the bit to write.
+// returns -1 if nobody answered or no device is left on the path to the next rom,
+// which means a device left the bus during the search.
+int oneWire_search_branch(oneWire_search_t *s, bool id, bool cmp);
+
+// oneWire_search_end_pass is called after the 64th bit.  The rom found is in s->rom.
+// returns true if there is another rom to find.
+bool oneWire_search_end_pass(oneWire_search_t *s);
+
+#endif //ONE_WIRE_SEARCH_H
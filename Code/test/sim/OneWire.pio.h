@@ -0,0 +1,30 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Stands in for the header pioasm makes from OneWire.pio.  The programs are read
+// from OneWire.pio by sim_pio.c so the host runs exactly what is in the file.
+
+#ifndef ONE_WIRE_PIO_H
+#define ONE_WIRE_PIO_H
+
+#include "sim_sdk.h"
+
+// public labels, sim_pio.c checks them against the file
+#define OneWire_detect_offset_detect_idle 21u
+
+extern const pio_program_t OneWire_program;
+extern const pio_program_t OneWire_overdrive_program;
+extern const pio_program_t OneWire_detect_program;
+
+pio_sm_config OneWire_program_get_default_config(uint offset);
+pio_sm_config OneWire_overdrive_program_get_default_config(uint offset);
+pio_sm_config OneWire_detect_program_get_default_config(uint offset);
+
+// the same set up as the % c-sdk blocks in OneWire.pio
+void OneWire_program_init(PIO pio, uint sm, uint offset, uint pin);
+void OneWire_detect_program_init(PIO pio, uint sm, uint offset, uint pin);
+
+#endif //ONE_WIRE_PIO_H
@@ -0,0 +1,2 @@
+// stands in for the Pico SDK header on the host
+#include "sim_sdk.h"
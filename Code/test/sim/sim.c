@@ -0,0 +1,510 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// CPU side of the simulation: the clock, GPIOs, hardware alarms, interrupts and
+// mutexes of the SDK.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "sim_int.h"
+
+uint64_t sim_cpu_ps;
+static uint64_t cpu_cost_ps = 50000;
+
+// the XIP cache model keeps the 64 byte blocks of code around the call sites seen
+// since the flush
+#define XIP_LINES 4096
+static uint64_t xip_miss_ps;
+static uintptr_t xip_cache[XIP_LINES];
+static uint32_t xip_misses;
+extern char __start_sim_ram[] __attribute__((weak));
+extern char __stop_sim_ram[] __attribute__((weak));
+static uint64_t (*irq_latency)(void);
+// an unrelated interrupt that takes the CPU for load_cost_ps every load_period_ps
+static uint64_t load_period_ps;
+static uint64_t load_cost_ps;
+static uint64_t load_next_ps;
+static uint64_t irq_busy_ps;      // CPU time spent in alarm callbacks
+
+const absolute_time_t at_the_end_of_time = 0x7FFFFFFFFFFFFFFFULL;
+
+irq_handler_t sim_irq_handler[32];
+bool sim_irq_enabled[32];
+
+static struct {
+  int func;
+  bool dir_out;
+  bool out;
+  bool low;   // what the bus was last told
+} gpios[SIM_NUM_GPIOS];
+
+#define NUM_ALARMS 4
+
+static struct {
+  bool claimed;
+  bool armed;
+  uint64_t target_us;
+  uint64_t fire_ps;         // target plus the interrupt latency
+  hardware_alarm_callback_t callback;
+} alarms[NUM_ALARMS];
+
+static int lock_depth;
+static bool event;    // the event latch, set by __sev() and cleared by __wfe()
+
+void sim_fail(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "sim: ");
+  vfprintf(stderr, fmt, ap);
+  va_end(ap);
+  exit(2);
+}
+
+uint64_t sim_now_ps(void) {
+  return sim_cpu_ps;
+}
+
+void sim_sync(void) {
+  // anything the CPU would do while the other interrupt runs waits for it to finish
+  if (load_period_ps > 0) {
+    while (load_next_ps + load_cost_ps <= sim_cpu_ps) load_next_ps += load_period_ps;
+    if (sim_cpu_ps >= load_next_ps) {
+      sim_cpu_ps = load_next_ps + load_cost_ps;
+      load_next_ps += load_period_ps;
+    }
+  }
+  sim_pio_run(sim_cpu_ps);
+  sim_pio_irqs();
+}
+
+static bool in_ram(uintptr_t addr) {
+  return addr >= (uintptr_t)__start_sim_ram && addr < (uintptr_t)__stop_sim_ram;
+}
+
+// true if the line was not in the cache
+static bool xip_fetch(uintptr_t addr) {
+  uintptr_t line = (addr >> 6) | 1;
+  uint32_t h = (line * 2654435761u) % XIP_LINES;
+  while (xip_cache[h] != 0) {
+    if (xip_cache[h] == line) return false;
+    h = (h + 1) % XIP_LINES;
+  }
+  xip_cache[h] = line;
+  return true;
+}
+
+void sim_cpu_at(void *caller) {
+  sim_cpu_ps += cpu_cost_ps;
+  if (xip_miss_ps > 0 && !in_ram((uintptr_t)caller) && xip_misses < XIP_LINES / 2 &&
+      xip_fetch((uintptr_t)caller)) {
+    xip_misses++;
+    sim_cpu_ps += xip_miss_ps;
+  }
+  sim_sync();
+}
+
+void sim_set_xip_miss_ns(uint32_t ns) {
+  xip_miss_ps = ns * 1000ULL;
+}
+
+void sim_xip_flush(void) {
+  memset(xip_cache, 0, sizeof(xip_cache));
+  xip_misses = 0;
+}
+
+uint32_t sim_xip_misses(void) {
+  return xip_misses;
+}
+
+void sim_advance_ps(uint64_t ps) {
+  sim_cpu_ps += ps;
+  sim_sync();
+}
+
+void sim_set_cpu_ns(uint32_t ns) {
+  cpu_cost_ps = ns * 1000ULL;
+}
+
+void sim_set_irq_latency(uint64_t (*latency_ps)(void)) {
+  irq_latency = latency_ps;
+}
+
+void sim_set_irq_load(uint32_t period_us, uint32_t cost_ns) {
+  load_period_ps = period_us * SIM_PS_PER_US;
+  load_cost_ps = cost_ns * 1000ULL;
+  load_next_ps = sim_cpu_ps + load_period_ps;
+}
+
+void sim_reset(void) {
+  sim_cpu_ps = 0;
+  cpu_cost_ps = 50000;
+  irq_latency = NULL;
+  load_period_ps = 0;
+  xip_miss_ps = 0;
+  sim_xip_flush();
+  memset(gpios, 0, sizeof(gpios));
+  memset(alarms, 0, sizeof(alarms));
+  memset(sim_irq_handler, 0, sizeof(sim_irq_handler));
+  memset(sim_irq_enabled, 0, sizeof(sim_irq_enabled));
+  lock_depth = 0;
+  event = false;
+  sim_pio_reset();
+}
+
+int sim_lock_depth(void) {
+  return lock_depth;
+}
+
+// time ----------------------------------------------------------------------------
+
+static uint64_t now_us(void) {
+  return sim_cpu_ps / SIM_PS_PER_US;
+}
+
+uint32_t time_us_32(void) {
+  sim_cpu();
+  return (uint32_t)now_us();
+}
+
+uint64_t time_us_64(void) {
+  sim_cpu();
+  return now_us();
+}
+
+absolute_time_t get_absolute_time(void) {
+  sim_cpu();
+  return now_us();
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us) {
+  sim_cpu();
+  return now_us() + us;
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms) {
+  sim_cpu();
+  return now_us() + ms * 1000ULL;
+}
+
+absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) {
+  return t + us;
+}
+
+bool time_reached(absolute_time_t t) {
+  sim_cpu();
+  return now_us() >= t;
+}
+
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+  return (int64_t)(to - from);
+}
+
+uint64_t to_us_since_boot(absolute_time_t t) {
+  return t;
+}
+
+// calls the alarm callback and counts the CPU time it takes
+static void run_alarm(int a) {
+  uint64_t start = sim_cpu_ps;
+  if (alarms[a].callback != NULL) alarms[a].callback(a);
+  irq_busy_ps += sim_cpu_ps - start;
+}
+
+uint64_t sim_irq_busy_ps(void) {
+  return irq_busy_ps;
+}
+
+// runs any alarm that comes due before the CPU time reaches end_ps
+static void run_alarms_until(uint64_t end_ps) {
+  for (;;) {
+    int next = -1;
+    for (int a = 0; a < NUM_ALARMS; a++) {
+      if (alarms[a].armed && (next < 0 || alarms[a].fire_ps < alarms[next].fire_ps)) next = a;
+    }
+    if (next < 0) break;
+    uint64_t fire = alarms[next].fire_ps;
+    if (fire > end_ps) break;
+    if (fire > sim_cpu_ps) sim_cpu_ps = fire;
+    alarms[next].armed = false;
+    sim_sync();
+    run_alarm(next);
+  }
+  if (end_ps > sim_cpu_ps) sim_cpu_ps = end_ps;
+  sim_sync();
+}
+
+void sleep_us(uint64_t us) {
+  sim_cpu();
+  run_alarms_until(sim_cpu_ps + us * SIM_PS_PER_US);
+}
+
+void sleep_ms(uint32_t ms) {
+  sim_cpu();
+  run_alarms_until(sim_cpu_ps + ms * 1000ULL * SIM_PS_PER_US);
+}
+
+void sleep_until(absolute_time_t t) {
+  sim_cpu();
+  if (t * SIM_PS_PER_US > sim_cpu_ps) run_alarms_until(t * SIM_PS_PER_US);
+}
+
+void busy_wait_us_32(uint32_t us) {
+  sim_cpu();
+  sim_cpu_ps += us * SIM_PS_PER_US;
+  sim_sync();
+}
+
+void busy_wait_us(uint64_t us) {
+  sim_cpu();
+  sim_cpu_ps += us * SIM_PS_PER_US;
+  sim_sync();
+}
+
+void tight_loop_contents(void) {
+  sim_cpu();
+}
+
+// sleeps until the next alarm and runs it
+static void wait_for_alarm(const char *name) {
+  int next = -1;
+  for (int a = 0; a < NUM_ALARMS; a++) {
+    if (alarms[a].armed && (next < 0 || alarms[a].fire_ps < alarms[next].fire_ps)) next = a;
+  }
+  if (next < 0) sim_fail("%s with no interrupt that can wake it\n", name);
+  uint64_t fire = alarms[next].fire_ps;
+  if (fire > sim_cpu_ps) sim_cpu_ps = fire;
+  alarms[next].armed = false;
+  sim_sync();
+  run_alarm(next);
+}
+
+void __wfi(void) {
+  sim_cpu();
+  wait_for_alarm("__wfi");
+}
+
+void __wfe(void) {
+  sim_cpu();
+  if (!event) wait_for_alarm("__wfe");
+  event = false;
+}
+
+void __sev(void) {
+  sim_cpu();
+  event = true;
+}
+
+// alarms --------------------------------------------------------------------------
+
+int hardware_alarm_claim_unused(bool required) {
+  sim_cpu();
+  for (int a = 0; a < NUM_ALARMS; a++) {
+    if (!alarms[a].claimed) {
+      alarms[a].claimed = true;
+      return a;
+    }
+  }
+  if (required) sim_fail("no free hardware alarm\n");
+  return -1;
+}
+
+void hardware_alarm_unclaim(uint alarm) {
+  sim_cpu();
+  alarms[alarm].claimed = false;
+  alarms[alarm].armed = false;
+}
+
+void hardware_alarm_set_callback(uint alarm, hardware_alarm_callback_t callback) {
+  sim_cpu();
+  alarms[alarm].callback = callback;
+}
+
+// returns true if the target has already gone by, the same as the SDK
+bool hardware_alarm_set_target(uint alarm, absolute_time_t t) {
+  sim_cpu();
+  if (t <= now_us()) {
+    alarms[alarm].armed = false;
+    return true;
+  }
+  alarms[alarm].target_us = t;
+  alarms[alarm].fire_ps = t * SIM_PS_PER_US + (irq_latency != NULL ? irq_latency() : 0);
+  alarms[alarm].armed = true;
+  return false;
+}
+
+void hardware_alarm_cancel(uint alarm) {
+  sim_cpu();
+  alarms[alarm].armed = false;
+}
+
+// clocks --------------------------------------------------------------------------
+
+uint32_t clock_get_hz(int clk) {
+  (void)clk;
+  return SIM_CLK_SYS_HZ;
+}
+
+// gpio ----------------------------------------------------------------------------
+
+static bool pin_low(uint pin) {
+  switch (gpios[pin].func) {
+  case SIM_FUNC_SIO: return gpios[pin].dir_out && !gpios[pin].out;
+  case SIM_FUNC_PIO0: return sim_pio_pin_low(0, pin);
+  case SIM_FUNC_PIO1: return sim_pio_pin_low(1, pin);
+  }
+  return false;
+}
+
+static void update_pin(uint pin, uint64_t t) {
+  bool low = pin_low(pin);
+  if (low == gpios[pin].low) return;
+  gpios[pin].low = low;
+  sim_bus_t *b = sim_bus_for_pin(pin);
+  if (b != NULL) sim_bus_drive(b, low, t);
+}
+
+void sim_gpio_set_function(uint pin, int func) {
+  gpios[pin].func = func;
+  update_pin(pin, sim_cpu_ps);
+}
+
+void sim_gpio_pio_changed(uint pin, int index, uint64_t t) {
+  if (gpios[pin].func == SIM_FUNC_PIO0 + index) update_pin(pin, t);
+}
+
+bool sim_pin_level(uint pin, uint64_t t) {
+  if (pin >= SIM_NUM_GPIOS) return true;
+  sim_bus_t *b = sim_bus_for_pin(pin);
+  if (b != NULL) return sim_bus_level(b, t);
+  return !gpios[pin].low;
+}
+
+void gpio_init(uint pin) {
+  sim_cpu();
+  gpios[pin].dir_out = false;
+  gpios[pin].out = false;
+  sim_gpio_set_function(pin, SIM_FUNC_SIO);
+}
+
+void gpio_set_dir(uint pin, bool out) {
+  sim_cpu();
+  gpios[pin].dir_out = out;
+  update_pin(pin, sim_cpu_ps);
+}
+
+void gpio_put(uint pin, bool value) {
+  sim_cpu();
+  gpios[pin].out = value;
+  update_pin(pin, sim_cpu_ps);
+}
+
+bool gpio_get(uint pin) {
+  sim_cpu();
+  return sim_pin_level(pin, sim_cpu_ps);
+}
+
+uint32_t gpio_get_all(void) {
+  sim_cpu();
+  uint32_t v = 0;
+  for (uint pin = 0; pin < SIM_NUM_GPIOS; pin++) {
+    if (sim_pin_level(pin, sim_cpu_ps)) v |= 1u << pin;
+  }
+  return v;
+}
+
+void gpio_init_mask(uint32_t mask) {
+  for (uint pin = 0; pin < SIM_NUM_GPIOS; pin++) {
+    if (mask & (1u << pin)) gpio_init(pin);
+  }
+}
+
+void gpio_clr_mask(uint32_t mask) {
+  sim_cpu();
+  for (uint pin = 0; pin < SIM_NUM_GPIOS; pin++) {
+    if (mask & (1u << pin)) {
+      gpios[pin].out = false;
+      update_pin(pin, sim_cpu_ps);
+    }
+  }
+}
+
+static void set_dir_masked(uint32_t mask, bool out) {
+  sim_cpu();
+  for (uint pin = 0; pin < SIM_NUM_GPIOS; pin++) {
+    if (mask & (1u << pin)) {
+      gpios[pin].dir_out = out;
+      update_pin(pin, sim_cpu_ps);
+    }
+  }
+}
+
+void gpio_set_dir_in_masked(uint32_t mask) {
+  set_dir_masked(mask, false);
+}
+
+void gpio_set_dir_out_masked(uint32_t mask) {
+  set_dir_masked(mask, true);
+}
+
+// interrupts ----------------------------------------------------------------------
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+  sim_cpu();
+  sim_irq_handler[num] = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+  sim_cpu();
+  sim_irq_enabled[num] = enabled;
+}
+
+uint32_t save_and_disable_interrupts(void) {
+  sim_cpu();
+  return 0;
+}
+
+void restore_interrupts(uint32_t status) {
+  (void)status;
+  sim_cpu();
+}
+
+// mutexes -------------------------------------------------------------------------
+
+void recursive_mutex_init(recursive_mutex_t *m) {
+  m->depth = 0;
+}
+
+void recursive_mutex_enter_blocking(recursive_mutex_t *m) {
+  sim_cpu();
+  m->depth++;
+  lock_depth++;
+}
+
+void recursive_mutex_exit(recursive_mutex_t *m) {
+  sim_cpu();
+  if (m->depth == 0) sim_fail("recursive_mutex_exit of a mutex that is not held\n");
+  m->depth--;
+  lock_depth--;
+}
+
+void mutex_init(mutex_t *m) {
+  m->owned = false;
+}
+
+void mutex_enter_blocking(mutex_t *m) {
+  sim_cpu();
+  if (m->owned) sim_fail("mutex_enter_blocking would deadlock\n");
+  m->owned = true;
+  lock_depth++;
+}
+
+void mutex_exit(mutex_t *m) {
+  sim_cpu();
+  m->owned = false;
+  lock_depth--;
+}
@@ -0,0 +1,219 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Host simulation of the parts of the RP2040 the OneWire code uses and of the
+// devices on a 1-Wire bus.  The PIO state machine runs the programs in OneWire.pio
+// one instruction at a time against simulated devices that see the edges the
+// program drives, so timing, FIFO and protocol problems show up on the host.
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIM_PS_PER_US 1000000ULL
+#define SIM_MAX_DEVS 512
+
+typedef struct sim_bus sim_bus_t;
+typedef struct sim_dev sim_dev_t;
+
+// sim_dev_type_t is what a device does once it has been selected.  The rom layer,
+// reset, presence and the slot timing are done by sim_bus.c for every device.
+typedef struct sim_dev_type {
+  const char *name;
+  bool resume;                              // understands resume rom (0xA5)
+  bool overdrive;                           // understands overdrive skip and match rom
+  void (*reset)(sim_dev_t *d);              // the function layer starts over
+  void (*byte)(sim_dev_t *d, uint8_t b);    // a byte was written after the rom command
+  // called when a slot starts and nothing is queued to send.  Returns the bit to
+  // send, or -1 to take the slot as a write.  May queue bytes with sim_dev_send().
+  int (*idle_bit)(sim_dev_t *d);
+  // true if the device answers a conditional read rom (0x0F) now, NULL if it never does
+  bool (*cond_read)(sim_dev_t *d);
+} sim_dev_type_t;
+
+struct sim_dev {
+  const sim_dev_type_t *type;
+  uint64_t rom;
+  sim_bus_t *bus;
+  // rom layer
+  int state;
+  bool od;                  // at overdrive speed
+  bool rc;                  // resume flag, set when this device alone was selected
+  int bit;                  // rom bit being matched or searched
+  int phase;                // search rom: sending the bit, its complement or receiving
+  uint8_t rx;
+  int rx_bits;
+  int send_bit;             // bit sent in the slot in progress, -1 if receiving
+  uint64_t hold_until;      // holding the bus low for a 0 until then
+  uint64_t presence_from;
+  uint64_t presence_to;
+  uint64_t busy_until;      // programming EEPROM, deaf to the bus until then
+  uint8_t tx[96];
+  int tx_len;               // bytes queued
+  int tx_pos;               // bits sent
+  // function layer, used as each device type needs
+  uint8_t cmd;
+  int count;
+  uint16_t ta;
+  uint8_t es;
+  uint16_t crc;
+  bool aa;                  // authorization accepted
+  uint8_t scratch[64];
+  uint8_t *mem;
+  int mem_size;
+  uint64_t done_at[2];      // when conversions finish
+  bool converting[2];
+  // values the test sets
+  double temp_c;
+  double volts;
+  uint16_t adc[4];
+  uint8_t pio;
+  bool parasite;
+  sim_dev_t *coupler;       // the DS2409 whose branch the device is on, NULL for the trunk
+  uint8_t branch;           // that branch, 1 for main and 2 for aux
+  bool password_on;         // the logger checks the read password
+  uint8_t password[8];
+  // counters the test can check
+  uint32_t selects;
+  uint32_t resumes;
+  uint32_t conversions;
+  uint32_t early_reads;     // conversion results read before they were ready
+  uint32_t copies;
+  uint32_t disturbed;       // bus activity during an EEPROM copy
+  uint32_t corrupt_pages;   // memory pages still to be sent with a bit flipped on the wire
+  uint32_t corrupt_cmds;    // commands still to be received with a bit flipped on the wire
+  uint32_t crc_errors;      // commands the device threw away because of a bad CRC
+};
+
+#define SIM_LOW_HIST 1280
+
+// rom layer states
+#define SIM_DEV_IDLE    0   // waiting for a reset
+#define SIM_DEV_ROM_CMD 1
+#define SIM_DEV_MATCH   2
+#define SIM_DEV_SEARCH  3
+#define SIM_DEV_READ_ROM 4
+#define SIM_DEV_FUNC    5
+
+struct sim_bus {
+  unsigned pin;
+  sim_dev_t *devs[SIM_MAX_DEVS];
+  int num_devs;
+  bool low;                 // master is driving the bus low
+  uint64_t fall;            // time of the last falling edge from the master
+  uint64_t rise;            // time of the last rising edge
+  uint64_t now;             // time of the edge being handled, for the devices
+  bool sample_due;          // a device is sending and the master has not sampled
+  uint32_t unplug_at;       // the devices are taken off the bus at this reset, 0 for never
+  // counters the test can check
+  uint32_t resets;
+  uint32_t slots;
+  uint32_t bits_read;       // slots some device sent in
+  uint32_t violations[2];   // slots outside the data sheet timing, standard and overdrive
+  uint64_t low_ps;          // total time the master held the bus low
+  uint64_t max_idle_ps;     // longest time the bus was left high between two slots
+  uint64_t idle_mark_ps;    // set by the test, idle gaps at least this long are counted
+  uint32_t idles_over_mark;
+  uint64_t busy_ps;         // from the first to the last edge
+  uint64_t first_edge;
+  uint64_t last_edge;
+  uint32_t low_hist[SIM_LOW_HIST];  // low pulses by length in 100ns steps, the last has the rest
+};
+
+// sim.c ---------------------------------------------------------------------------
+
+// the simulated time in picoseconds
+uint64_t sim_now_ps(void);
+// moves the simulated time on, the PIO keeps running
+void sim_advance_ps(uint64_t ps);
+// CPU time charged for every SDK call, 50ns by default
+void sim_set_cpu_ns(uint32_t ns);
+// cost of fetching the code around an SDK call site from flash.  Every SDK call made
+// from code that is not in RAM pays it once per 64 byte block after a flush, the
+// eight 8 byte XIP cache lines the code between two calls takes up.  0 turns the
+// model off.
+void sim_set_xip_miss_ns(uint32_t ns);
+// empties the XIP cache, as a big display update from flash would
+void sim_xip_flush(void);
+// XIP misses since the last flush
+uint32_t sim_xip_misses(void);
+// interrupt latency model for the timer alarm, called for each alarm.  NULL for none.
+void sim_set_irq_latency(uint64_t (*latency_ps)(void));
+// CPU time spent in alarm callbacks since the start
+uint64_t sim_irq_busy_ps(void);
+// an unrelated interrupt that takes the CPU for cost_ns every period_us.  Busy waits
+// and alarm callbacks that come due while it runs are held up until it is done.
+// A period of 0 turns it off.
+void sim_set_irq_load(uint32_t period_us, uint32_t cost_ns);
+// resets the clock, the PIOs, the GPIOs and the lock count
+void sim_reset(void);
+// current depth of the bus lock, 0 when balanced
+int sim_lock_depth(void);
+// preloads Rx FIFO words that are returned without running the state machine
+void sim_preload_rx(const uint32_t words[], int num);
+
+// sim_bus.c -----------------------------------------------------------------------
+
+sim_bus_t *sim_bus_new(unsigned pin);
+void sim_bus_free(sim_bus_t *b);
+sim_bus_t *sim_bus_for_pin(unsigned pin);
+void sim_bus_add(sim_bus_t *b, sim_dev_t *d);
+void sim_bus_clear_stats(sim_bus_t *b);
+// called by the GPIO and PIO models when the master drive changes
+void sim_bus_drive(sim_bus_t *b, bool low, uint64_t t);
+// level of the bus at t, true if high
+bool sim_bus_level(sim_bus_t *b, uint64_t t);
+// queues bytes for the device to send
+void sim_dev_send(sim_dev_t *d, const uint8_t data[], int num);
+// CRCs the way the devices do them
+uint8_t sim_crc8(const uint8_t a[], int len);
+uint16_t sim_crc16(uint16_t crc, const uint8_t a[], int len);
+// a random rom with a good CRC for family
+uint64_t sim_random_rom(uint8_t family);
+uint32_t sim_rand(void);
+void sim_srand(uint32_t seed);
+
+// sim_devices.c -------------------------------------------------------------------
+
+sim_dev_t *sim_ds18b20_new(uint64_t rom, double temp_c);
+sim_dev_t *sim_ds2438_new(uint64_t rom, double temp_c, double volts);
+// a DS2431 (family 0x2D) or DS28EC20 (family 0x43), erased to 0xFF
+sim_dev_t *sim_eeprom_new(uint64_t rom);
+// a DS1922 logger (family 0x41) with 12KB of memory, all 0.  Understands overdrive.
+sim_dev_t *sim_logger_new(uint64_t rom);
+// a DS2413 (family 0x3A) with its PIO state and latches in the low 4 bits of pio
+sim_dev_t *sim_ds2413_new(uint64_t rom, uint8_t pio);
+// a DS2450 (family 0x20) that converts to the values in adc[]
+sim_dev_t *sim_ds2450_new(uint64_t rom);
+// a DS28E17 1-Wire to I2C bridge (family 0x19) with an I2C slave at the 7 bit 
+// address i2c_addr behind it.  The slave has 32 registers in mem[], all 0.
+sim_dev_t *sim_ds28e17_new(uint64_t rom, uint8_t i2c_addr);
+// a DS2409 coupler (family 0x1F) with both branches off.  Devices are put on a
+// branch with sim_dev_t coupler and branch and only see the bus while it is on.
+sim_dev_t *sim_ds2409_new(uint64_t rom);
+// a DS2408 (family 0x29) whose PIO samples count up from pio
+sim_dev_t *sim_ds2408_new(uint64_t rom, uint8_t pio);
+// a DS28EA00 (family 0x42) with chain mode off.  The chain runs through the DS28EA00s
+// in the order they were added to the bus.
+sim_dev_t *sim_ds28ea00_new(uint64_t rom);
+void sim_dev_free(sim_dev_t *d);
+
+// sim_pio.c -----------------------------------------------------------------------
+
+// pulse widths of one command run by a program on its own, for timing checks
+typedef struct sim_pio_pulses {
+  int num;
+  double low_us[64];        // how long each low pulse lasted
+  double sample_us[64];     // when the pin was sampled after the falling edge, -1 if not
+} sim_pio_pulses_t;
+
+// runs cmd through a fresh copy of the named program at the given clock and
+// records each low pulse on a bus with nothing on it.
+bool sim_pio_pulses(const char *program, double clock_hz, uint32_t cmd, sim_pio_pulses_t *p);
+
+#endif //SIM_H
@@ -0,0 +1,356 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// 1-Wire bus model.  The master's edges come from the GPIO or PIO model.  Each
+// device works out at the falling edge whether it sends in the slot and at the
+// rising edge what the master wrote, the same as the real parts do with their
+// own timers.  The rom layer is done here for every device.  What happens after
+// a device is selected is up to its sim_dev_type_t.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_int.h"
+
+#define US SIM_PS_PER_US
+
+// standard speed device timing
+#define STD_SAMPLE      (30 * US)   // a write is a 1 if the bus is back high by then
+#define STD_HOLD        (15 * US)   // how long a 0 is held in a read slot
+#define STD_RESET       (480 * US)
+#define STD_PRESENCE_AT (30 * US)
+#define STD_PRESENCE    (120 * US)
+
+// overdrive device timing
+#define OD_SAMPLE       (3 * US)
+#define OD_HOLD         (2 * US)
+#define OD_RESET        (48 * US)
+#define OD_PRESENCE_AT  (3 * US)
+#define OD_PRESENCE     (10 * US)
+
+#define MAX_BUSES 8
+
+static sim_bus_t *buses[MAX_BUSES];
+
+static uint32_t rand_state = 2463534242u;
+
+uint32_t sim_rand(void) {
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+  return rand_state;
+}
+
+void sim_srand(uint32_t seed) {
+  rand_state = seed ? seed : 1;
+}
+
+uint8_t sim_crc8(const uint8_t a[], int len) {
+  uint8_t crc = 0;
+  for (int i = 0; i < len; i++) {
+    uint8_t b = a[i];
+    for (int j = 0; j < 8; j++, b >>= 1) {
+      bool mix = (crc ^ b) & 1;
+      crc >>= 1;
+      if (mix) crc ^= 0x8C;
+    }
+  }
+  return crc;
+}
+
+uint16_t sim_crc16(uint16_t crc, const uint8_t a[], int len) {
+  for (int i = 0; i < len; i++) {
+    crc ^= a[i];
+    for (int j = 0; j < 8; j++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
+
+uint64_t sim_random_rom(uint8_t family) {
+  uint8_t b[8];
+  b[0] = family;
+  for (int i = 1; i < 7; i++) b[i] = sim_rand();
+  b[7] = sim_crc8(b, 7);
+  uint64_t rom = 0;
+  for (int i = 7; i >= 0; i--) rom = (rom << 8) | b[i];
+  return rom;
+}
+
+sim_bus_t *sim_bus_new(unsigned pin) {
+  for (int i = 0; i < MAX_BUSES; i++) {
+    if (buses[i] == NULL) {
+      sim_bus_t *b = calloc(1, sizeof(sim_bus_t));
+      b->pin = pin;
+      buses[i] = b;
+      return b;
+    }
+  }
+  sim_fail("too many buses\n");
+  return NULL;
+}
+
+void sim_bus_free(sim_bus_t *b) {
+  for (int i = 0; i < MAX_BUSES; i++) {
+    if (buses[i] == b) buses[i] = NULL;
+  }
+  free(b);
+}
+
+sim_bus_t *sim_bus_for_pin(unsigned pin) {
+  for (int i = 0; i < MAX_BUSES; i++) {
+    if (buses[i] != NULL && buses[i]->pin == pin) return buses[i];
+  }
+  return NULL;
+}
+
+void sim_bus_add(sim_bus_t *b, sim_dev_t *d) {
+  if (b->num_devs >= SIM_MAX_DEVS) sim_fail("too many devices on the bus\n");
+  b->devs[b->num_devs++] = d;
+  d->bus = b;
+  d->state = SIM_DEV_IDLE;
+  d->send_bit = -1;
+}
+
+void sim_bus_clear_stats(sim_bus_t *b) {
+  b->resets = 0;
+  b->slots = 0;
+  b->bits_read = 0;
+  b->violations[0] = b->violations[1] = 0;
+  b->low_ps = 0;
+  b->max_idle_ps = 0;
+  b->idles_over_mark = 0;
+  b->busy_ps = 0;
+  b->first_edge = 0;
+  b->last_edge = 0;
+  memset(b->low_hist, 0, sizeof(b->low_hist));
+}
+
+void sim_dev_send(sim_dev_t *d, const uint8_t data[], int num) {
+  if (d->tx_len + num > (int)sizeof(d->tx)) sim_fail("%s: send queue full\n", d->type->name);
+  memcpy(&d->tx[d->tx_len], data, num);
+  d->tx_len += num;
+}
+
+static bool rom_bit(sim_dev_t *d, int bit) {
+  return (d->rom >> bit) & 1;
+}
+
+static bool busy(sim_dev_t *d, uint64_t t) {
+  return t < d->busy_until;
+}
+
+// the bit the device sends in the slot that is starting, or -1 if it listens
+static int tx_bit(sim_dev_t *d) {
+  if (d->tx_pos < d->tx_len * 8) return (d->tx[d->tx_pos / 8] >> (d->tx_pos % 8)) & 1;
+  switch (d->state) {
+  case SIM_DEV_SEARCH:
+    if (d->phase == 0) return rom_bit(d, d->bit);
+    if (d->phase == 1) return !rom_bit(d, d->bit);
+    return -1;
+  case SIM_DEV_FUNC:
+    return d->type->idle_bit != NULL ? d->type->idle_bit(d) : -1;
+  }
+  return -1;
+}
+
+static void selected(sim_dev_t *d) {
+  d->state = SIM_DEV_FUNC;
+  d->rc = true;
+  d->selects++;
+}
+
+static void rom_command(sim_dev_t *d, uint8_t cmd) {
+  if (cmd != 0xA5) d->rc = false;
+  d->bit = 0;
+  d->phase = 0;
+  switch (cmd) {
+  case 0x0F:    // conditional read rom
+    if (d->type->cond_read == NULL || !d->type->cond_read(d)) break;
+    // fall through
+  case 0x33: {  // read rom
+    uint8_t b[8];
+    for (int i = 0; i < 8; i++) b[i] = d->rom >> (8 * i);
+    sim_dev_send(d, b, 8);
+    selected(d);
+    return;
+  }
+  case 0x55:    // match rom
+    d->state = SIM_DEV_MATCH;
+    return;
+  case 0x69:    // overdrive match rom
+    if (!d->type->overdrive) break;
+    d->od = true;
+    d->state = SIM_DEV_MATCH;
+    return;
+  case 0xCC:    // skip rom
+    d->state = SIM_DEV_FUNC;
+    return;
+  case 0x3C:    // overdrive skip rom
+    if (!d->type->overdrive) break;
+    d->od = true;
+    d->state = SIM_DEV_FUNC;
+    return;
+  case 0xF0:    // search rom
+    d->state = SIM_DEV_SEARCH;
+    return;
+  case 0xA5:    // resume
+    if (!d->type->resume || !d->rc) break;
+    d->state = SIM_DEV_FUNC;
+    d->resumes++;
+    return;
+  }
+  d->state = SIM_DEV_IDLE;  // not for this device, wait for the next reset
+}
+
+static void rx_bit(sim_dev_t *d, bool bit) {
+  switch (d->state) {
+  case SIM_DEV_ROM_CMD:
+  case SIM_DEV_FUNC:
+    d->rx |= bit << d->rx_bits;
+    if (++d->rx_bits < 8) return;
+    {
+      uint8_t b = d->rx;
+      d->rx = 0;
+      d->rx_bits = 0;
+      if (d->state == SIM_DEV_ROM_CMD) rom_command(d, b);
+      else if (d->type->byte != NULL) d->type->byte(d, b);
+    }
+    return;
+  case SIM_DEV_MATCH:
+    if (bit != rom_bit(d, d->bit)) {
+      d->state = SIM_DEV_IDLE;
+      d->od = false;
+      return;
+    }
+    if (++d->bit == 64) selected(d);
+    return;
+  case SIM_DEV_SEARCH:
+    if (bit != rom_bit(d, d->bit)) {
+      d->state = SIM_DEV_IDLE;
+      return;
+    }
+    d->phase = 0;
+    if (++d->bit == 64) selected(d);
+    return;
+  }
+}
+
+static void dev_reset(sim_dev_t *d, uint64_t t) {
+  d->state = SIM_DEV_ROM_CMD;
+  d->rx = 0;
+  d->rx_bits = 0;
+  d->tx_len = 0;
+  d->tx_pos = 0;
+  d->cmd = 0;
+  d->count = 0;
+  d->presence_from = t + (d->od ? OD_PRESENCE_AT : STD_PRESENCE_AT);
+  d->presence_to = d->presence_from + (d->od ? OD_PRESENCE : STD_PRESENCE);
+  if (d->type->reset != NULL) d->type->reset(d);
+}
+
+// false if the device is on a coupler branch that is switched off
+static bool connected(sim_dev_t *d) {
+  return d->coupler == NULL || d->coupler->es == d->branch;
+}
+
+static void dev_fall(sim_dev_t *d, uint64_t t) {
+  d->send_bit = -1;
+  d->hold_until = 0;
+  if (!connected(d)) return;
+  if (busy(d, t)) {
+    d->disturbed++;
+    return;
+  }
+  if (d->state == SIM_DEV_IDLE) return;
+  d->send_bit = tx_bit(d);
+  if (d->send_bit == 0) d->hold_until = t + (d->od ? OD_HOLD : STD_HOLD);
+}
+
+static void dev_rise(sim_dev_t *d, uint64_t t, uint64_t low) {
+  if (!connected(d)) return;
+  if (busy(d, t)) {
+    d->disturbed++;
+    return;
+  }
+  if (low >= STD_RESET) {
+    d->od = false;
+    dev_reset(d, t);
+    return;
+  }
+  if (d->od && low >= OD_RESET) {
+    dev_reset(d, t);
+    return;
+  }
+  if (d->state == SIM_DEV_IDLE) return;
+  if (d->send_bit >= 0) {
+    if (d->tx_pos < d->tx_len * 8) {
+      if (++d->tx_pos == d->tx_len * 8) d->tx_len = d->tx_pos = 0;
+    } else if (d->state == SIM_DEV_SEARCH) {
+      d->phase++;
+    }
+    return;
+  }
+  rx_bit(d, low < (d->od ? OD_SAMPLE : STD_SAMPLE));
+}
+
+// true if a low pulse of this length is one the devices are sure to read right.
+// Overdrive is held to the data sheet: tW1L and tRL 1 to 2us, tW0L 7.5 to 16us,
+// tRSTL 70 to 80us.  At standard speed the device model samples at 30us so a write
+// 0 only has to be past that.
+static bool pulse_ok(bool od, uint64_t low) {
+  if (low >= STD_RESET) return true;
+  if (od) {
+    return (low >= 1 * US && low <= 2 * US) ||
+           (low >= 7500000ULL && low < 16 * US) ||
+           (low >= 70 * US && low <= 80 * US);
+  }
+  return (low >= 1 * US && low <= 15 * US) || (low >= STD_SAMPLE && low <= 120 * US);
+}
+
+void sim_bus_drive(sim_bus_t *b, bool low, uint64_t t) {
+  if (low == b->low) return;
+  if (b->first_edge == 0) b->first_edge = t;
+  b->last_edge = t;
+  b->busy_ps = b->last_edge - b->first_edge;
+  b->now = t;
+  b->low = low;
+  if (low) {
+    if (b->rise != 0 && t - b->rise > b->max_idle_ps) b->max_idle_ps = t - b->rise;
+    if (b->rise != 0 && b->idle_mark_ps != 0 && t - b->rise >= b->idle_mark_ps) b->idles_over_mark++;
+    b->fall = t;
+    for (int i = 0; i < b->num_devs; i++) dev_fall(b->devs[i], t);
+    return;
+  }
+  uint64_t len = t - b->fall;
+  b->rise = t;
+  b->low_ps += len;
+  b->low_hist[len / (US / 10) < SIM_LOW_HIST ? len / (US / 10) : SIM_LOW_HIST - 1]++;
+  bool od = false;
+  bool sent = false;
+  for (int i = 0; i < b->num_devs; i++) {
+    if (b->devs[i]->od) od = true;
+    if (b->devs[i]->send_bit >= 0) sent = true;
+  }
+  if (!pulse_ok(od, len)) b->violations[od]++;
+  if (len >= STD_RESET || (od && len >= OD_RESET)) {
+    if (++b->resets == b->unplug_at) b->num_devs = 0;
+  } else {
+    b->slots++;
+    if (sent) b->bits_read++;
+  }
+  for (int i = 0; i < b->num_devs; i++) dev_rise(b->devs[i], t, len);
+}
+
+bool sim_bus_level(sim_bus_t *b, uint64_t t) {
+  if (b->low) return false;
+  for (int i = 0; i < b->num_devs; i++) {
+    sim_dev_t *d = b->devs[i];
+    if (!connected(d)) continue;
+    if (t >= d->presence_from && t < d->presence_to) return false;
+    if (d->send_bit == 0 && t >= b->fall && t < d->hold_until) return false;
+  }
+  return true;
+}
@@ -0,0 +1,724 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Function layers of the simulated devices.  Only what the OneWire code uses is
+// modelled, with the timing from the data sheets.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sim_int.h"
+
+#define US SIM_PS_PER_US
+#define MS (1000 * SIM_PS_PER_US)
+
+static sim_dev_t *dev_new(const sim_dev_type_t *type, uint64_t rom) {
+  sim_dev_t *d = calloc(1, sizeof(sim_dev_t));
+  d->type = type;
+  d->rom = rom;
+  d->send_bit = -1;
+  return d;
+}
+
+void sim_dev_free(sim_dev_t *d) {
+  free(d->mem);
+  free(d);
+}
+
+// DS18B20 -------------------------------------------------------------------------
+// scratch[0..8] is the scratchpad, scratch[16..18] the EEPROM copy of TH, TL and config.
+
+static void ds18b20_finish(sim_dev_t *d) {
+  if (!d->converting[0] || d->bus->now < d->done_at[0]) return;
+  int16_t raw = (int16_t)lround(d->temp_c * 16);
+  // lower resolutions leave the low bits undefined, the part clears them
+  int res = (d->scratch[4] >> 5) & 3;
+  raw &= ~((1 << (3 - res)) - 1);
+  d->scratch[0] = raw & 0xFF;
+  d->scratch[1] = raw >> 8;
+  d->converting[0] = false;
+}
+
+static void ds18b20_byte(sim_dev_t *d, uint8_t b) {
+  ds18b20_finish(d);
+  if (d->cmd == 0 && d->corrupt_cmds > 0) {
+    // the master sent it right, the bus got it wrong
+    d->corrupt_cmds--;
+    b ^= 0x04;
+  }
+  if (d->cmd == 0x4E) {  // write scratchpad: TH, TL, config
+    d->scratch[2 + d->count] = b;
+    if (++d->count == 3) d->cmd = 0xFF;
+    return;
+  }
+  if (d->cmd != 0) return;
+  d->cmd = b;
+  d->count = 0;
+  switch (b) {
+  case 0x44: {  // convert T
+    static const uint32_t conv_ms_x4[4] = { 375, 750, 1500, 3000 };
+    d->converting[0] = true;
+    d->done_at[0] = d->bus->now + conv_ms_x4[(d->scratch[4] >> 5) & 3] * MS / 4;
+    d->conversions++;
+    break;
+  }
+  case 0xBE:    // read scratchpad
+    if (d->converting[0]) d->early_reads++;
+    d->scratch[8] = sim_crc8(d->scratch, 8);
+    sim_dev_send(d, d->scratch, 9);
+    break;
+  case 0x48:    // copy scratchpad
+    memcpy(&d->scratch[16], &d->scratch[2], 3);
+    d->copies++;
+    break;
+  case 0xB8:    // recall E2
+    memcpy(&d->scratch[2], &d->scratch[16], 3);
+    break;
+  }
+}
+
+static int ds18b20_idle_bit(sim_dev_t *d) {
+  ds18b20_finish(d);
+  switch (d->cmd) {
+  case 0:
+  case 0x4E:
+    return -1;
+  case 0x44:
+    return !d->converting[0];
+  case 0xB4:    // read power supply
+    return !d->parasite;
+  }
+  return 1;
+}
+
+static const sim_dev_type_t ds18b20_type = {
+  .name = "DS18B20",
+  .byte = ds18b20_byte,
+  .idle_bit = ds18b20_idle_bit,
+};
+
+sim_dev_t *sim_ds18b20_new(uint64_t rom, double temp_c) {
+  sim_dev_t *d = dev_new(&ds18b20_type, rom);
+  d->temp_c = temp_c;
+  // power on: 85C, TH 75, TL 70, 12 bits
+  static const uint8_t power_on[8] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10 };
+  memcpy(d->scratch, power_on, 8);
+  memcpy(&d->scratch[16], &power_on[2], 3);
+  return d;
+}
+
+// DS2438 --------------------------------------------------------------------------
+// mem is the 8 pages of 8 bytes, scratch[0..7] the scratchpad and count the page.
+// The conversions write page 0 directly, a recall copies a page to the scratchpad.
+
+#define DS2438_CONVERT_MS 10
+
+static void ds2438_finish(sim_dev_t *d) {
+  if (d->converting[0] && d->bus->now >= d->done_at[0]) {
+    int16_t raw = (int16_t)lround(d->temp_c * 256) & ~7;
+    d->mem[1] = raw & 0xFF;
+    d->mem[2] = raw >> 8;
+    d->converting[0] = false;
+  }
+  if (d->converting[1] && d->bus->now >= d->done_at[1]) {
+    uint16_t raw = (uint16_t)lround(d->volts * 100) & 0x3FF;
+    d->mem[3] = raw & 0xFF;
+    d->mem[4] = raw >> 8;
+    d->converting[1] = false;
+  }
+  // TB and ADB status bits
+  d->mem[0] = (d->mem[0] & ~0x50) | (d->converting[0] << 4) | (d->converting[1] << 6);
+}
+
+static void ds2438_byte(sim_dev_t *d, uint8_t b) {
+  ds2438_finish(d);
+  switch (d->cmd) {
+  case 0:
+    break;
+  case 0xB8:    // recall memory page
+    if (d->converting[0] || d->converting[1]) d->early_reads++;
+    d->count = b & 7;
+    memcpy(d->scratch, &d->mem[d->count * 8], 8);
+    d->cmd = 0xFF;
+    return;
+  case 0xBE:    // read scratchpad page
+    d->scratch[8] = sim_crc8(d->scratch, 8);
+    sim_dev_send(d, d->scratch, 9);
+    d->cmd = 0xFF;
+    return;
+  case 0x4E:    // write scratchpad page, then data
+    if (d->ta == 0) {
+      d->count = b & 7;
+      d->ta = 1;
+    } else if (d->ta <= 8) {
+      d->scratch[d->ta++ - 1] = b;
+    }
+    return;
+  case 0x48:    // copy scratchpad to page
+    memcpy(&d->mem[(b & 7) * 8], d->scratch, 8);
+    d->copies++;
+    d->cmd = 0xFF;
+    return;
+  default:
+    return;
+  }
+  d->cmd = b;
+  d->ta = 0;
+  switch (b) {
+  case 0x44:    // convert T
+  case 0xB4:    // convert V
+    d->converting[b == 0xB4] = true;
+    d->done_at[b == 0xB4] = d->bus->now + DS2438_CONVERT_MS * MS;
+    d->conversions++;
+    d->cmd = 0xFF;
+    break;
+  }
+}
+
+static const sim_dev_type_t ds2438_type = {
+  .name = "DS2438",
+  .byte = ds2438_byte,
+};
+
+sim_dev_t *sim_ds2438_new(uint64_t rom, double temp_c, double volts) {
+  sim_dev_t *d = dev_new(&ds2438_type, rom);
+  d->temp_c = temp_c;
+  d->volts = volts;
+  d->mem = calloc(64, 1);
+  d->mem_size = 64;
+  d->mem[0] = 0x0F;   // IAD, CA, EE and AD on
+  return d;
+}
+
+// DS2431 and DS28EC20 -------------------------------------------------------------
+// scratch[0..row-1] is the scratchpad, ta and es the target address and E/S byte.
+// A copy makes the device deaf to the bus for tPROG.  Read memory and extended read
+// memory are streamed from idle_bit() a page at a time.
+
+#define EEPROM_TPROG_MS 10
+
+static int eeprom_row(sim_dev_t *d) {
+  return (d->rom & 0xFF) == 0x43 ? 32 : 8;
+}
+
+static uint8_t eeprom_mem(sim_dev_t *d, int address) {
+  return address < d->mem_size ? d->mem[address] : 0xFF;
+}
+
+static void eeprom_send_crc(sim_dev_t *d) {
+  uint8_t c[2] = { ~d->crc & 0xFF, ~d->crc >> 8 };
+  sim_dev_send(d, c, 2);
+}
+
+static void eeprom_byte(sim_dev_t *d, uint8_t b) {
+  int row = eeprom_row(d);
+  if (d->cmd == 0) {
+    d->cmd = b;
+    d->count = 0;
+    d->crc = sim_crc16(0, &b, 1);
+    if (b == 0xAA) {          // read scratchpad
+      uint8_t h[3] = { d->ta & 0xFF, d->ta >> 8, d->es };
+      int from = d->ta & (row - 1), to = d->es & 0x1F;
+      d->crc = sim_crc16(d->crc, h, 3);
+      sim_dev_send(d, h, 3);
+      if (to >= from) {
+        d->crc = sim_crc16(d->crc, &d->scratch[from], to - from + 1);
+        sim_dev_send(d, &d->scratch[from], to - from + 1);
+      }
+      eeprom_send_crc(d);
+      d->cmd = 0xFF;
+    }
+    return;
+  }
+  int n = d->count++;
+  switch (d->cmd) {
+  case 0x0F:    // write scratchpad: TA1, TA2, data to the end of the row
+    d->crc = sim_crc16(d->crc, &b, 1);
+    if (n < 2) {
+      d->ta = n == 0 ? b : d->ta | (b << 8);
+      d->aa = false;
+      return;
+    }
+    d->scratch[(d->ta & (row - 1)) + n - 2] = b;
+    if ((d->ta & (row - 1)) + n - 1 == row) {
+      d->es = row - 1;
+      eeprom_send_crc(d);
+      d->cmd = 0xFF;
+    }
+    return;
+  case 0x55:    // copy scratchpad: TA1, TA2, E/S as the authorization code
+    if (n < 2) {
+      if (b != ((d->ta >> (8 * n)) & 0xFF)) d->cmd = 0xFF;
+      return;
+    }
+    if (b == d->es) {
+      int base = d->ta & ~(row - 1);
+      if (base + row <= d->mem_size) memcpy(&d->mem[base], d->scratch, row);
+      d->aa = true;
+      d->es |= 0x80;
+      d->busy_until = d->bus->now + EEPROM_TPROG_MS * MS;
+      d->copies++;
+    }
+    d->cmd = 0xFF;
+    return;
+  case 0xF0:    // read memory: TA1, TA2 then the data runs to the end of memory
+  case 0xA5:    // extended read memory: the same with a CRC16 after every page
+    if (d->cmd == 0xA5) d->crc = sim_crc16(d->crc, &b, 1);
+    if (n == 0) d->ta = b;
+    if (n == 1) d->ta |= b << 8;
+    return;
+  }
+}
+
+static int eeprom_idle_bit(sim_dev_t *d) {
+  if ((d->cmd != 0xF0 && d->cmd != 0xA5) || d->count < 2) return -1;
+  int page = d->cmd == 0xA5 ? 32 : 16;
+  uint8_t chunk[32];
+  int n = page - (d->ta % page);
+  for (int i = 0; i < n; i++) chunk[i] = eeprom_mem(d, d->ta + i);
+  if (d->cmd == 0xA5) d->crc = sim_crc16(d->crc, chunk, n);
+  if (d->corrupt_pages > 0) {
+    // the device sent it right, the bus got it wrong
+    d->corrupt_pages--;
+    chunk[n / 2] ^= 0x10;
+  }
+  sim_dev_send(d, chunk, n);
+  d->ta += n;
+  if (d->cmd == 0xA5) {
+    eeprom_send_crc(d);
+    d->crc = 0;
+  }
+  return chunk[0] & 1;
+}
+
+static const sim_dev_type_t eeprom_type = {
+  .name = "EEPROM",
+  .byte = eeprom_byte,
+  .idle_bit = eeprom_idle_bit,
+};
+
+sim_dev_t *sim_eeprom_new(uint64_t rom) {
+  sim_dev_t *d = dev_new(&eeprom_type, rom);
+  d->mem_size = (rom & 0xFF) == 0x43 ? 0xA20 : 0x90;
+  d->mem = malloc(d->mem_size);
+  memset(d->mem, 0xFF, d->mem_size);
+  return d;
+}
+
+// DS1922/DS1923 -------------------------------------------------------------------
+// Only read memory with CRC (0x69) is modelled: TA1, TA2 and the 8 byte password,
+// then 32 byte pages to the end of memory, each followed by the inverted CRC16.
+// The CRC of the first page also covers the command and the address.  A wrong
+// password ends the command so the master reads 1s.
+
+#define LOGGER_MEM_SIZE 0x3000
+
+static void logger_byte(sim_dev_t *d, uint8_t b) {
+  if (d->cmd == 0) {
+    d->cmd = b == 0x69 ? b : 0xFF;
+    d->count = 0;
+    d->crc = sim_crc16(0, &b, 1);
+    return;
+  }
+  if (d->cmd != 0x69) return;
+  int n = d->count++;
+  if (n < 2) {
+    d->crc = sim_crc16(d->crc, &b, 1);
+    d->ta = n == 0 ? b : d->ta | (b << 8);
+  } else if (n < 10 && d->password_on && b != d->password[n - 2]) {
+    d->cmd = 0xFF;
+  }
+}
+
+static int logger_idle_bit(sim_dev_t *d) {
+  if (d->cmd != 0x69 || d->count < 10 || d->ta >= d->mem_size) return -1;
+  uint8_t page[32];
+  int n = 32 - (d->ta % 32);
+  memcpy(page, &d->mem[d->ta], n);
+  sim_dev_send(d, page, n);
+  d->ta += n;
+  d->crc = sim_crc16(d->crc, page, n);
+  eeprom_send_crc(d);
+  d->crc = 0;
+  return page[0] & 1;
+}
+
+static const sim_dev_type_t logger_type = {
+  .name = "DS1922",
+  .overdrive = true,
+  .byte = logger_byte,
+  .idle_bit = logger_idle_bit,
+};
+
+sim_dev_t *sim_logger_new(uint64_t rom) {
+  sim_dev_t *d = dev_new(&logger_type, rom);
+  d->mem_size = LOGGER_MEM_SIZE;
+  d->mem = calloc(1, d->mem_size);
+  return d;
+}
+
+// DS2413 --------------------------------------------------------------------------
+// Only PIO access read (0xF5) is modelled.  Every byte read is the 4 bit state in
+// d->pio with its complement in the top nibble.
+
+static void ds2413_byte(sim_dev_t *d, uint8_t b) {
+  if (d->cmd == 0) d->cmd = b;
+}
+
+static int ds2413_idle_bit(sim_dev_t *d) {
+  if (d->cmd != 0xF5) return -1;
+  uint8_t s = (d->pio & 0x0F) | (~d->pio << 4);
+  sim_dev_send(d, &s, 1);
+  return s & 1;
+}
+
+static const sim_dev_type_t ds2413_type = {
+  .name = "DS2413",
+  .resume = true,
+  .overdrive = true,
+  .byte = ds2413_byte,
+  .idle_bit = ds2413_idle_bit,
+};
+
+sim_dev_t *sim_ds2413_new(uint64_t rom, uint8_t pio) {
+  sim_dev_t *d = dev_new(&ds2413_type, rom);
+  d->pio = pio;
+  return d;
+}
+
+// DS2450 --------------------------------------------------------------------------
+// mem is the 4 pages of 8 bytes.  Convert (0x3C) takes the input select mask and the
+// read out control, sends the inverted CRC16 of all three and then converts the
+// selected channels from adc[] into page 0.  Read memory (0xAA) is streamed a page
+// at a time, each followed by its CRC16.
+
+// 4 channels at 16 bits, 80us a bit per channel and 160us to start
+#define DS2450_CONVERT_US (4 * 16 * 80 + 160)
+
+static void ds2450_finish(sim_dev_t *d) {
+  if (!d->converting[0] || d->bus->now < d->done_at[0]) return;
+  for (int c = 0; c < 4; c++) {
+    if ((d->es & (1 << c)) == 0) continue;
+    d->mem[2 * c] = d->adc[c] & 0xFF;
+    d->mem[2 * c + 1] = d->adc[c] >> 8;
+  }
+  d->converting[0] = false;
+}
+
+static void ds2450_byte(sim_dev_t *d, uint8_t b) {
+  ds2450_finish(d);
+  if (d->cmd == 0) {
+    d->cmd = b;
+    d->count = 0;
+    d->crc = sim_crc16(0, &b, 1);
+    return;
+  }
+  int n = d->count++;
+  switch (d->cmd) {
+  case 0x3C:    // convert: input select mask, read out control
+    d->crc = sim_crc16(d->crc, &b, 1);
+    if (n == 0) d->es = b & 0x0F;
+    if (n == 1) {
+      eeprom_send_crc(d);
+      // counted from the command, a little early since it really starts once the
+      // CRC has been read
+      d->converting[0] = true;
+      d->done_at[0] = d->bus->now + DS2450_CONVERT_US * US;
+      d->conversions++;
+      d->cmd = 0xFF;
+    }
+    return;
+  case 0xAA:    // read memory: TA1, TA2 then the pages to the end of memory
+    d->crc = sim_crc16(d->crc, &b, 1);
+    if (n == 0) d->ta = b;
+    if (n == 1) d->ta |= b << 8;
+    return;
+  }
+}
+
+static int ds2450_idle_bit(sim_dev_t *d) {
+  ds2450_finish(d);
+  if (d->cmd != 0xAA || d->count < 2 || d->ta >= d->mem_size) return -1;
+  if (d->ta < 8 && d->converting[0]) d->early_reads++;
+  uint8_t page[8];
+  int n = 8 - (d->ta % 8);
+  memcpy(page, &d->mem[d->ta], n);
+  sim_dev_send(d, page, n);
+  d->ta += n;
+  d->crc = sim_crc16(d->crc, page, n);
+  eeprom_send_crc(d);
+  d->crc = 0;
+  return page[0] & 1;
+}
+
+static const sim_dev_type_t ds2450_type = {
+  .name = "DS2450",
+  .byte = ds2450_byte,
+  .idle_bit = ds2450_idle_bit,
+};
+
+sim_dev_t *sim_ds2450_new(uint64_t rom) {
+  sim_dev_t *d = dev_new(&ds2450_type, rom);
+  d->mem_size = 32;
+  d->mem = calloc(1, d->mem_size);
+  return d;
+}
+
+// DS28E17 -------------------------------------------------------------------------
+// The command, the I2C address, the lengths and the data are collected in
+// scratch[32..] until the inverted CRC16 that ends them.  A good command runs the I2C
+// transfer at once and the result, the status byte, the write status for commands
+// that write and any data read, goes to scratch[0..ta-1].  The bridge then reads 1
+// until the transfer would be done on the I2C bus, then 0, then sends the result.  A
+// bad CRC sets bit 0 of the status and nothing goes out on I2C.
+// The I2C slave behind it is es at its 7 bit address with mem[0..31] its registers 
+// and mem[32] its register pointer.  The first byte written sets the pointer, the
+// rest are written from there.  Writes past the registers are not acked.  Only 
+// commands of up to 32 bytes and reads of up to 30 are modelled.
+
+// 100kHz I2C, 9 bits a byte
+#define DS28E17_I2C_BYTE_US 90
+#define DS28E17_REGS 32
+
+// the length of the command after the command byte, CRC included, 0 if not known yet
+static int ds28e17_len(sim_dev_t *d) {
+  const uint8_t *p = &d->scratch[32];
+  if (d->count < 2) return 0;
+  switch (d->cmd) {
+  case 0x4B: return 2 + p[1] + 2;      // address, write length, data
+  case 0x87: return 2 + 2;             // address, read length
+  case 0x2D: return 2 + p[1] + 1 + 2;  // address, write length, data, read length
+  }
+  return 0;
+}
+
+// runs the I2C transfer the command asks for and puts the result in scratch[]
+static void ds28e17_i2c(sim_dev_t *d, int len) {
+  const uint8_t *p = &d->scratch[32];
+  uint8_t *ptr = &d->mem[DS28E17_REGS];
+  int wlen = d->cmd == 0x87 ? 0 : p[1];
+  int rlen = d->cmd == 0x4B ? 0 : p[len - 3];
+  uint8_t status = 0, write_status = 0;
+  int bytes = 1;
+  uint16_t crc = ~sim_crc16(sim_crc16(0, &d->cmd, 1), p, len - 2);
+  if ((crc & 0xFF) != p[len - 2] || (crc >> 8) != p[len - 1]) {
+    d->crc_errors++;
+    status = 0x01;
+    bytes = 0;
+    rlen = 0;
+  } else if ((p[0] >> 1) != d->es) {
+    status = 0x02;   // address not acked
+    rlen = 0;
+  } else {
+    for (int i = 0; i < wlen; i++) {
+      bytes++;
+      if (i == 0) {
+        *ptr = p[2];
+      } else if (*ptr < DS28E17_REGS) {
+        d->mem[(*ptr)++] = p[2 + i];
+      } else {
+        write_status = i + 1;
+        rlen = 0;
+        break;
+      }
+    }
+  }
+  int n = 0;
+  d->scratch[n++] = status;
+  if (wlen > 0) d->scratch[n++] = write_status;
+  for (int i = 0; i < rlen; i++, bytes++) {
+    d->scratch[n++] = *ptr < DS28E17_REGS ? d->mem[(*ptr)++] : 0xFF;
+  }
+  d->ta = n;
+  d->aa = false;
+  d->converting[0] = true;
+  d->done_at[0] = d->bus->now + bytes * DS28E17_I2C_BYTE_US * US;
+}
+
+static void ds28e17_reset(sim_dev_t *d) {
+  d->converting[0] = false;
+}
+
+static void ds28e17_byte(sim_dev_t *d, uint8_t b) {
+  if (d->cmd == 0) {
+    d->cmd = (b == 0x4B || b == 0x87 || b == 0x2D) ? b : 0xFF;
+    d->count = 0;
+    return;
+  }
+  if (d->cmd == 0xFF || d->count >= 32) return;
+  if (d->count == 0 && d->corrupt_cmds > 0) {
+    // the master sent it right, the bus got it wrong
+    d->corrupt_cmds--;
+    b ^= 0x04;
+  }
+  d->scratch[32 + d->count++] = b;
+  int len = ds28e17_len(d);
+  if (len > 0 && d->count == len) ds28e17_i2c(d, len);
+}
+
+static int ds28e17_idle_bit(sim_dev_t *d) {
+  if (!d->converting[0]) return -1;
+  if (d->bus->now < d->done_at[0]) return 1;   // still busy on I2C
+  if (!d->aa) {
+    d->aa = true;
+    return 0;
+  }
+  d->converting[0] = false;
+  d->cmd = 0xFF;
+  sim_dev_send(d, d->scratch, d->ta);
+  return d->scratch[0] & 1;
+}
+
+static const sim_dev_type_t ds28e17_type = {
+  .name = "DS28E17",
+  .resume = true,
+  .reset = ds28e17_reset,
+  .byte = ds28e17_byte,
+  .idle_bit = ds28e17_idle_bit,
+};
+
+sim_dev_t *sim_ds28e17_new(uint64_t rom, uint8_t i2c_addr) {
+  sim_dev_t *d = dev_new(&ds28e17_type, rom);
+  d->es = i2c_addr;
+  d->mem_size = DS28E17_REGS;
+  d->mem = calloc(1, DS28E17_REGS + 1);
+  return d;
+}
+
+// DS2409 --------------------------------------------------------------------------
+// es is the branch switched on, 1 for main and 2 for aux, 0 for none.  Only one is on
+// at a time.  All lines off (0x66) sends the command back to confirm.  Smart on main
+// (0xCC) and aux (0x33) send the reset stimulus byte, which reads 0xFF since the 
+// reset on the branch is not modelled, then the command.  The branch switches as soon
+// as the command is in.  Any other command is ignored so the master reads 1s.
+
+static void ds2409_byte(sim_dev_t *d, uint8_t b) {
+  if (d->cmd != 0) return;
+  if (d->corrupt_cmds > 0) {
+    // the master sent it right, the bus got it wrong
+    d->corrupt_cmds--;
+    b ^= 0x04;
+  }
+  d->cmd = b;
+  uint8_t resp[2] = {0xFF, b};
+  switch (b) {
+  case 0x66:    // all lines off
+    d->es = 0;
+    sim_dev_send(d, &resp[1], 1);
+    break;
+  case 0xCC:    // smart on main
+  case 0x33:    // smart on aux
+    d->es = b == 0xCC ? 1 : 2;
+    sim_dev_send(d, resp, 2);
+    break;
+  }
+}
+
+static const sim_dev_type_t ds2409_type = {
+  .name = "DS2409",
+  .byte = ds2409_byte,
+};
+
+sim_dev_t *sim_ds2409_new(uint64_t rom) {
+  return dev_new(&ds2409_type, rom);
+}
+
+// DS2408 --------------------------------------------------------------------------
+// Only channel access read (0xF5) is modelled.  The samples are streamed from 
+// idle_bit() 32 at a time, each block followed by its inverted CRC16.  The CRC of the
+// first block also covers the command.  Each sample is pio, which counts up by one a
+// sample so the test can see which ones arrived.
+
+static void ds2408_byte(sim_dev_t *d, uint8_t b) {
+  if (d->cmd != 0) return;
+  d->cmd = b;
+  d->crc = sim_crc16(0, &b, 1);
+}
+
+static int ds2408_idle_bit(sim_dev_t *d) {
+  if (d->cmd != 0xF5) return -1;
+  uint8_t block[32];
+  for (int i = 0; i < 32; i++) block[i] = d->pio++;
+  d->crc = sim_crc16(d->crc, block, 32);
+  if (d->corrupt_pages > 0) {
+    // the device sent it right, the bus got it wrong
+    d->corrupt_pages--;
+    block[16] ^= 0x10;
+  }
+  sim_dev_send(d, block, 32);
+  eeprom_send_crc(d);
+  d->crc = 0;
+  return block[0] & 1;
+}
+
+static const sim_dev_type_t ds2408_type = {
+  .name = "DS2408",
+  .resume = true,
+  .byte = ds2408_byte,
+  .idle_bit = ds2408_idle_bit,
+};
+
+sim_dev_t *sim_ds2408_new(uint64_t rom, uint8_t pio) {
+  sim_dev_t *d = dev_new(&ds2408_type, rom);
+  d->pio = pio;
+  return d;
+}
+
+// DS28EA00 ------------------------------------------------------------------------
+// Only the sequence detect chain is modelled.  es is the chain state, 0 for off, 1 for
+// on and 2 for done.  Chain (0x99) takes the control byte and its complement and 
+// confirms a good one with 0xAA.  In chain on a device answers conditional read rom
+// when its EN input is high, that is when it is the first DS28EA00 on the bus or the
+// one before it is done.
+
+static void ds28ea00_byte(sim_dev_t *d, uint8_t b) {
+  if (d->cmd == 0) {
+    d->cmd = b;
+    d->count = 0;
+    return;
+  }
+  if (d->cmd != 0x99) return;
+  if (d->count++ == 0) {
+    if (d->corrupt_cmds > 0) {
+      // the master sent it right, the bus got it wrong
+      d->corrupt_cmds--;
+      b ^= 0x04;
+    }
+    d->ta = b;
+    return;
+  }
+  d->cmd = 0xFF;
+  if (b != (uint8_t)~d->ta) return;
+  switch (d->ta) {
+  case 0x3C: d->es = 0; break;   // off
+  case 0x5A: d->es = 1; break;   // on
+  case 0x96: d->es = 2; break;   // done
+  default: return;
+  }
+  uint8_t confirm = 0xAA;
+  sim_dev_send(d, &confirm, 1);
+}
+
+static bool ds28ea00_cond_read(sim_dev_t *d) {
+  if (d->es != 1) return false;
+  sim_dev_t *before = NULL;
+  for (int i = 0; i < d->bus->num_devs && d->bus->devs[i] != d; i++) {
+    if (d->bus->devs[i]->type == d->type) before = d->bus->devs[i];
+  }
+  return before == NULL || before->es == 2;
+}
+
+static const sim_dev_type_t ds28ea00_type = {
+  .name = "DS28EA00",
+  .resume = true,
+  .overdrive = true,
+  .byte = ds28ea00_byte,
+  .cond_read = ds28ea00_cond_read,
+};
+
+sim_dev_t *sim_ds28ea00_new(uint64_t rom) {
+  return dev_new(&ds28ea00_type, rom);
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// What the parts of the simulation need from each other.  Not for the tests.
+
+#ifndef SIM_INT_H
+#define SIM_INT_H
+
+#include "sim_sdk.h"
+#include "sim.h"
+
+#define SIM_NUM_GPIOS 30
+#define SIM_CLK_SYS_HZ 125000000
+
+// CPU time in picoseconds
+extern uint64_t sim_cpu_ps;
+
+// charges the CPU cost of an SDK call, and an XIP miss if the call came from code
+// in flash that is not in the cache, then brings the PIOs up to the CPU time
+void sim_cpu_at(void *caller);
+#define sim_cpu() sim_cpu_at(__builtin_return_address(0))
+// brings the PIOs up to the CPU time and runs any interrupt that is due
+void sim_sync(void);
+// prints the message and stops the test
+void sim_fail(const char *fmt, ...);
+
+// gpio function select
+#define SIM_FUNC_NULL 0
+#define SIM_FUNC_SIO  1
+#define SIM_FUNC_PIO0 2
+#define SIM_FUNC_PIO1 3
+void sim_gpio_set_function(uint pin, int func);
+// level of the pin at t, true if high.  The bus pull up keeps a pin with
+// nothing driving it high.
+bool sim_pin_level(uint pin, uint64_t t);
+// the drive on the pin from PIO index changed at t
+void sim_gpio_pio_changed(uint pin, int index, uint64_t t);
+
+// NVIC
+extern irq_handler_t sim_irq_handler[32];
+extern bool sim_irq_enabled[32];
+
+// sim_pio.c
+void sim_pio_reset(void);
+void sim_pio_run(uint64_t t);
+bool sim_pio_pin_low(int index, uint pin);
+// runs the handlers of any PIO interrupt that is raised and enabled
+void sim_pio_irqs(void);
+
+#endif //SIM_INT_H
@@ -0,0 +1,976 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// PIO model.  The programs are read from the text of OneWire.pio and run one
+// instruction at a time.  Each state machine keeps its own time and is run up to
+// the CPU time whenever the CPU touches the PIO, so the FIFOs, stalls and the
+// edges on the pins happen when they would on the chip.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "sim_int.h"
+#include "OneWire.pio.h"
+
+#ifndef ONE_WIRE_PIO_FILE
+#error ONE_WIRE_PIO_FILE must name OneWire.pio
+#endif
+
+#define OP_PULL 0
+#define OP_PUSH 1
+#define OP_OUT  2
+#define OP_IN   3
+#define OP_JMP  4
+#define OP_SET  5
+#define OP_NOP  6
+#define OP_WAIT 7
+#define OP_IRQ  8
+
+#define SRC_PINS    0
+#define SRC_X       1
+#define SRC_Y       2
+#define SRC_NULL    3
+#define SRC_PINDIRS 4
+
+#define COND_ALWAYS 0
+#define COND_NOT_X  1
+#define COND_X_DEC  2
+#define COND_NOT_Y  3
+#define COND_Y_DEC  4
+#define COND_X_NE_Y 5
+#define COND_PIN    6
+#define COND_NOT_OSRE 7
+
+typedef struct sim_instr {
+  uint8_t op;
+  uint8_t arg;        // source, destination or condition
+  uint8_t value;      // bit count, set value, pin index or irq number
+  uint8_t target;     // jump target, relative to the program start
+  uint8_t delay;
+  bool block;
+  char label[24];     // jump target name until resolved
+} sim_instr_t;
+
+typedef struct sim_program {
+  char name[32];
+  int len;
+  sim_instr_t code[32];
+} sim_program_t;
+
+static sim_program_t programs[8];
+static int num_programs;
+
+#define STEP_RAN   0
+#define STEP_PULL  1   // waiting for the CPU to push
+#define STEP_PUSH  2   // waiting for the CPU to pull
+#define STEP_WAIT  3   // waiting on a pin
+
+typedef struct sim_sm {
+  bool claimed;
+  bool enabled;
+  uint pc;
+  uint32_t x, y, osr, isr;
+  int osr_count, isr_count;
+  uint32_t tx[4];
+  int tx_n;
+  uint32_t rx[4];
+  int rx_n;
+  uint64_t t;
+  uint64_t period_ps;
+  pio_sm_config cfg;
+} sim_sm_t;
+
+typedef struct sim_pio {
+  pio_hw_t hw;
+  uint32_t fdebug;
+  sim_instr_t mem[32];
+  uint32_t used;
+  sim_sm_t sm[4];
+  bool pin_dir[32];
+  bool pin_out[32];
+  uint32_t irq;
+  bool irq0_int0;
+} sim_pio_t;
+
+// the third PIO only exists for sim_pio_pulses()
+static sim_pio_t pios[3];
+PIO pio0 = &pios[0].hw;
+PIO pio1 = &pios[1].hw;
+
+const pio_program_t OneWire_program = { "OneWire" };
+const pio_program_t OneWire_overdrive_program = { "OneWire_overdrive" };
+const pio_program_t OneWire_detect_program = { "OneWire_detect" };
+
+// the CPU writes 1s to FDEBUG to clear bits.  The model always keeps this unused
+// bit set so a write from the CPU shows up as it being clear.
+#define FDEBUG_SENTINEL (1u << 4)
+
+// the words sim_preload_rx() put in front of the Rx FIFO
+static uint32_t preload[64];
+static int preload_n, preload_pos;
+
+// what sim_pio_pulses() records
+static sim_pio_pulses_t *probe;
+static uint probe_pin;
+static uint64_t probe_fall;
+static bool probe_low;
+
+static sim_pio_t *get_pio(PIO pio) {
+  return &pios[pio == pio0 ? 0 : (pio == pio1 ? 1 : 2)];
+}
+
+static int pio_index(sim_pio_t *p) {
+  return p - pios;
+}
+
+// parsing -------------------------------------------------------------------------
+
+static bool is(const char *a, const char *b) {
+  return strcasecmp(a, b) == 0;
+}
+
+static int parse_src(const char *s, int line) {
+  if (is(s, "pins")) return SRC_PINS;
+  if (is(s, "x")) return SRC_X;
+  if (is(s, "y")) return SRC_Y;
+  if (is(s, "null")) return SRC_NULL;
+  if (is(s, "pindirs")) return SRC_PINDIRS;
+  sim_fail("OneWire.pio line %d: unknown source or destination %s\n", line, s);
+  return 0;
+}
+
+static int parse_num(const char *s, int line) {
+  char *end;
+  long v = strtol(s, &end, 0);
+  if (*end != 0) sim_fail("OneWire.pio line %d: bad number %s\n", line, s);
+  return v;
+}
+
+static void parse_line(char *s, int line, sim_program_t **prog) {
+  char *tok[16];
+  int n = 0;
+  int delay = 0;
+  for (char *c = s; *c; c++) if (*c == ',') *c = ' ';
+  for (char *t = strtok(s, " \t\r\n"); t != NULL && n < 16; t = strtok(NULL, " \t\r\n")) {
+    tok[n++] = t;
+  }
+  if (n == 0) return;
+  if (is(tok[0], ".program")) {
+    if (n < 2 || num_programs >= 8) sim_fail("OneWire.pio line %d: bad .program\n", line);
+    *prog = &programs[num_programs++];
+    memset(*prog, 0, sizeof(**prog));
+    strncpy((*prog)->name, tok[1], sizeof((*prog)->name) - 1);
+    return;
+  }
+  if (tok[0][0] == '.') sim_fail("OneWire.pio line %d: %s is not modelled\n", line, tok[0]);
+  if (*prog == NULL) sim_fail("OneWire.pio line %d: instruction before .program\n", line);
+  sim_program_t *p = *prog;
+  // labels were picked up by load_programs()
+  int first = 0;
+  while (first < n && (is(tok[first], "public") || tok[first][strlen(tok[first]) - 1] == ':')) first++;
+  // the delay is the last token
+  if (n > first && tok[n-1][0] == '[') {
+    char *d = tok[n-1] + 1;
+    d[strlen(d) - 1] = 0;
+    delay = parse_num(d, line);
+    n--;
+  }
+  if (n > first) {
+    if (p->len >= 32) sim_fail("OneWire.pio line %d: program too long\n", line);
+    sim_instr_t *in = &p->code[p->len++];
+    memset(in, 0, sizeof(*in));
+    in->delay = delay;
+    in->block = true;
+    const char *op = tok[first];
+    char **a = &tok[first + 1];
+    int na = n - first - 1;
+    if (is(op, "pull") || is(op, "push")) {
+      in->op = is(op, "pull") ? OP_PULL : OP_PUSH;
+      for (int i = 0; i < na; i++) {
+        if (is(a[i], "noblock")) in->block = false;
+        else if (!is(a[i], "block")) sim_fail("OneWire.pio line %d: %s not modelled\n", line, a[i]);
+      }
+    } else if (is(op, "out") || is(op, "in")) {
+      if (na != 2) sim_fail("OneWire.pio line %d: bad %s\n", line, op);
+      in->op = is(op, "out") ? OP_OUT : OP_IN;
+      in->arg = parse_src(a[0], line);
+      in->value = parse_num(a[1], line);
+    } else if (is(op, "set")) {
+      if (na != 2) sim_fail("OneWire.pio line %d: bad set\n", line);
+      in->op = OP_SET;
+      in->arg = parse_src(a[0], line);
+      in->value = parse_num(a[1], line);
+    } else if (is(op, "jmp")) {
+      in->op = OP_JMP;
+      in->arg = COND_ALWAYS;
+      if (na == 2) {
+        if (is(a[0], "!x")) in->arg = COND_NOT_X;
+        else if (is(a[0], "x--")) in->arg = COND_X_DEC;
+        else if (is(a[0], "!y")) in->arg = COND_NOT_Y;
+        else if (is(a[0], "y--")) in->arg = COND_Y_DEC;
+        else if (is(a[0], "x!=y")) in->arg = COND_X_NE_Y;
+        else if (is(a[0], "pin")) in->arg = COND_PIN;
+        else if (is(a[0], "!osre")) in->arg = COND_NOT_OSRE;
+        else sim_fail("OneWire.pio line %d: bad jmp condition %s\n", line, a[0]);
+        strncpy(in->label, a[1], sizeof(in->label) - 1);
+      } else if (na == 1) {
+        strncpy(in->label, a[0], sizeof(in->label) - 1);
+      } else {
+        sim_fail("OneWire.pio line %d: bad jmp\n", line);
+      }
+    } else if (is(op, "nop")) {
+      in->op = OP_NOP;
+    } else if (is(op, "wait")) {
+      if (na != 3 || !is(a[1], "pin")) sim_fail("OneWire.pio line %d: only wait pin is modelled\n", line);
+      in->op = OP_WAIT;
+      in->arg = parse_num(a[0], line);
+      in->value = parse_num(a[2], line);
+    } else if (is(op, "irq")) {
+      in->op = OP_IRQ;
+      if (na == 2 && (is(a[0], "nowait") || is(a[0], "set"))) in->value = parse_num(a[1], line);
+      else if (na == 1) in->value = parse_num(a[0], line);
+      else sim_fail("OneWire.pio line %d: only irq set is modelled\n", line);
+    } else {
+      sim_fail("OneWire.pio line %d: %s is not modelled\n", line, op);
+    }
+  }
+}
+
+// labels are found in a second pass over the file so forward jumps work
+typedef struct sim_label {
+  char name[24];
+  int program;
+  int addr;
+} sim_label_t;
+
+static sim_label_t labels[128];
+static int num_labels;
+
+static void load_programs(void) {
+  if (num_programs > 0) return;
+  FILE *f = fopen(ONE_WIRE_PIO_FILE, "r");
+  if (f == NULL) sim_fail("can't open %s\n", ONE_WIRE_PIO_FILE);
+  char buf[256];
+  int line = 0;
+  bool in_c = false;
+  sim_program_t *prog = NULL;
+  while (fgets(buf, sizeof(buf), f) != NULL) {
+    line++;
+    if (in_c) {
+      if (strncmp(buf, "%}", 2) == 0) in_c = false;
+      continue;
+    }
+    if (buf[0] == '%') {
+      in_c = true;
+      continue;
+    }
+    char *c = strstr(buf, "//");
+    if (c != NULL) *c = 0;
+    c = strchr(buf, ';');
+    if (c != NULL) *c = 0;
+    // pick up the labels before the instruction is parsed
+    char copy[256];
+    strcpy(copy, buf);
+    char *t = strtok(copy, " \t\r\n");
+    if (t != NULL && is(t, ".program")) {
+      parse_line(buf, line, &prog);
+      continue;
+    }
+    if (t != NULL && is(t, "public")) t = strtok(NULL, " \t\r\n");
+    while (t != NULL && t[strlen(t) - 1] == ':') {
+      if (num_labels >= 128) sim_fail("too many labels\n");
+      t[strlen(t) - 1] = 0;
+      strncpy(labels[num_labels].name, t, sizeof(labels[0].name) - 1);
+      labels[num_labels].program = num_programs - 1;
+      labels[num_labels].addr = prog ? prog->len : 0;
+      num_labels++;
+      t = strtok(NULL, " \t\r\n");
+    }
+    parse_line(buf, line, &prog);
+  }
+  fclose(f);
+  for (int p = 0; p < num_programs; p++) {
+    for (int i = 0; i < programs[p].len; i++) {
+      sim_instr_t *in = &programs[p].code[i];
+      if (in->op != OP_JMP) continue;
+      int l;
+      for (l = 0; l < num_labels; l++) {
+        if (labels[l].program == p && strcmp(labels[l].name, in->label) == 0) break;
+      }
+      if (l == num_labels) sim_fail("%s: no label %s\n", programs[p].name, in->label);
+      in->target = labels[l].addr;
+    }
+  }
+  // the public labels pioasm would put in OneWire.pio.h
+  for (int l = 0; l < num_labels; l++) {
+    if (strcmp(programs[labels[l].program].name, "OneWire_detect") == 0 &&
+        strcmp(labels[l].name, "detect_idle") == 0 &&
+        labels[l].addr != OneWire_detect_offset_detect_idle) {
+      sim_fail("OneWire_detect_offset_detect_idle is %d, OneWire.pio has %d\n",
+               OneWire_detect_offset_detect_idle, labels[l].addr);
+    }
+  }
+}
+
+static sim_program_t *find_program(const char *name) {
+  load_programs();
+  for (int p = 0; p < num_programs; p++) {
+    if (strcmp(programs[p].name, name) == 0) return &programs[p];
+  }
+  sim_fail("no program %s in OneWire.pio\n", name);
+  return NULL;
+}
+
+// running -------------------------------------------------------------------------
+
+static bool sm_pin_level(sim_pio_t *p, uint pin, uint64_t t) {
+  (void)p;
+  return sim_pin_level(pin, t);
+}
+
+static void probe_drive(uint pin, bool low, uint64_t t) {
+  if (probe == NULL || pin != probe_pin || low == probe_low) return;
+  probe_low = low;
+  if (low) {
+    probe_fall = t;
+    if (probe->num < 64) probe->sample_us[probe->num] = -1;
+  } else if (probe->num < 64) {
+    probe->low_us[probe->num++] = (t - probe_fall) / (double)SIM_PS_PER_US;
+  }
+}
+
+static void probe_sample(uint pin, uint64_t t) {
+  if (probe == NULL || pin != probe_pin) return;
+  int i = probe_low ? probe->num : probe->num - 1;
+  if (i < 0 || i >= 64 || probe->sample_us[i] >= 0) return;
+  probe->sample_us[i] = (t - probe_fall) / (double)SIM_PS_PER_US;
+}
+
+static void set_pindir(sim_pio_t *p, uint pin, bool out, uint64_t t) {
+  pin &= 31;
+  if (p->pin_dir[pin] == out) return;
+  p->pin_dir[pin] = out;
+  probe_drive(pin, out && !p->pin_out[pin], t);
+  if (pin < SIM_NUM_GPIOS) sim_gpio_pio_changed(pin, pio_index(p), t);
+}
+
+static void set_pin(sim_pio_t *p, uint pin, bool value, uint64_t t) {
+  pin &= 31;
+  if (p->pin_out[pin] == value) return;
+  p->pin_out[pin] = value;
+  probe_drive(pin, p->pin_dir[pin] && !value, t);
+  if (pin < SIM_NUM_GPIOS) sim_gpio_pio_changed(pin, pio_index(p), t);
+}
+
+bool sim_pio_pin_low(int index, uint pin) {
+  return pios[index].pin_dir[pin] && !pios[index].pin_out[pin];
+}
+
+static void write_dest(sim_pio_t *p, sim_sm_t *sm, int dest, uint32_t v, int count, uint base,
+                       uint pins, uint64_t t) {
+  switch (dest) {
+  case SRC_X: sm->x = v; break;
+  case SRC_Y: sm->y = v; break;
+  case SRC_NULL: break;
+  case SRC_PINS:
+    for (uint i = 0; i < pins && i < (uint)count; i++) set_pin(p, base + i, (v >> i) & 1, t);
+    break;
+  case SRC_PINDIRS:
+    for (uint i = 0; i < pins && i < (uint)count; i++) set_pindir(p, base + i, (v >> i) & 1, t);
+    break;
+  }
+}
+
+static uint next_pc(sim_sm_t *sm) {
+  if (sm->pc == sm->cfg.wrap) return sm->cfg.wrap_target;
+  return (sm->pc + 1) & 31;
+}
+
+// runs the instruction at pc at time sm->t.  The time moves on by the cycles it took,
+// or one cycle if it stalled.
+static int step(sim_pio_t *p, int num) {
+  sim_sm_t *sm = &p->sm[num];
+  sim_instr_t *in = &p->mem[sm->pc];
+  uint64_t t = sm->t;
+  uint pc = next_pc(sm);
+  switch (in->op) {
+  case OP_PULL:
+    if (sm->tx_n == 0) {
+      if (in->block) {
+        p->fdebug |= 1u << (PIO_FDEBUG_TXSTALL_LSB + num);
+        sm->t += sm->period_ps;
+        return STEP_PULL;
+      }
+      sm->osr = sm->x;
+    } else {
+      sm->osr = sm->tx[0];
+      memmove(&sm->tx[0], &sm->tx[1], --sm->tx_n * sizeof(uint32_t));
+    }
+    sm->osr_count = 0;
+    break;
+  case OP_PUSH:
+    if (sm->rx_n == 4) {
+      if (in->block) {
+        p->fdebug |= 1u << (PIO_FDEBUG_RXSTALL_LSB + num);
+        sm->t += sm->period_ps;
+        return STEP_PUSH;
+      }
+    } else {
+      sm->rx[sm->rx_n++] = sm->isr;
+    }
+    sm->isr = 0;
+    sm->isr_count = 0;
+    break;
+  case OP_OUT: {
+    int n = in->value ? in->value : 32;
+    uint32_t mask = n == 32 ? 0xFFFFFFFF : (1u << n) - 1;
+    uint32_t v;
+    if (sm->cfg.out_shift_right) {
+      v = sm->osr & mask;
+      sm->osr = n == 32 ? 0 : sm->osr >> n;
+    } else {
+      v = n == 32 ? sm->osr : sm->osr >> (32 - n);
+      sm->osr = n == 32 ? 0 : sm->osr << n;
+    }
+    sm->osr_count += n;
+    write_dest(p, sm, in->arg, v, n, sm->cfg.out_base, sm->cfg.out_count, t);
+    break;
+  }
+  case OP_IN: {
+    int n = in->value ? in->value : 32;
+    if (sm->cfg.autopush && sm->isr_count + n >= (int)sm->cfg.push_threshold && sm->rx_n == 4) {
+      p->fdebug |= 1u << (PIO_FDEBUG_RXSTALL_LSB + num);
+      sm->t += sm->period_ps;
+      return STEP_PUSH;
+    }
+    uint32_t v = 0;
+    switch (in->arg) {
+    case SRC_PINS:
+      for (int i = 0; i < n; i++) {
+        if (sm_pin_level(p, sm->cfg.in_base + i, t)) v |= 1u << i;
+      }
+      probe_sample(sm->cfg.in_base, t);
+      break;
+    case SRC_X: v = sm->x; break;
+    case SRC_Y: v = sm->y; break;
+    default: v = 0; break;
+    }
+    if (n < 32) v &= (1u << n) - 1;
+    if (sm->cfg.in_shift_right) {
+      sm->isr = n == 32 ? v : (sm->isr >> n) | (v << (32 - n));
+    } else {
+      sm->isr = n == 32 ? v : (sm->isr << n) | v;
+    }
+    sm->isr_count += n;
+    if (sm->isr_count > 32) sm->isr_count = 32;
+    if (sm->cfg.autopush && sm->isr_count >= (int)sm->cfg.push_threshold) {
+      sm->rx[sm->rx_n++] = sm->isr;
+      sm->isr = 0;
+      sm->isr_count = 0;
+    }
+    break;
+  }
+  case OP_JMP: {
+    bool take = false;
+    switch (in->arg) {
+    case COND_ALWAYS: take = true; break;
+    case COND_NOT_X: take = sm->x == 0; break;
+    case COND_X_DEC: take = sm->x != 0; sm->x--; break;
+    case COND_NOT_Y: take = sm->y == 0; break;
+    case COND_Y_DEC: take = sm->y != 0; sm->y--; break;
+    case COND_X_NE_Y: take = sm->x != sm->y; break;
+    case COND_PIN:
+      take = sm_pin_level(p, sm->cfg.jmp_pin, t);
+      probe_sample(sm->cfg.jmp_pin, t);
+      break;
+    case COND_NOT_OSRE: take = sm->osr_count < (int)sm->cfg.pull_threshold; break;
+    }
+    if (take) pc = in->target;
+    break;
+  }
+  case OP_SET:
+    write_dest(p, sm, in->arg, in->value, 5, sm->cfg.set_base, sm->cfg.set_count, t);
+    break;
+  case OP_NOP:
+    break;
+  case OP_WAIT:
+    probe_sample(sm->cfg.in_base + in->value, t);
+    if (sm_pin_level(p, sm->cfg.in_base + in->value, t) != (in->arg != 0)) {
+      sm->t += sm->period_ps;
+      return STEP_WAIT;
+    }
+    break;
+  case OP_IRQ:
+    p->irq |= 1u << in->value;
+    break;
+  }
+  sm->pc = pc;
+  sm->t += (1 + in->delay) * sm->period_ps;
+  return STEP_RAN;
+}
+
+// runs the state machine until its time reaches t.  A state machine waiting on a FIFO
+// can't move until the CPU does something so its time jumps straight to t.
+static void run_sm(sim_pio_t *p, int num, uint64_t t) {
+  sim_sm_t *sm = &p->sm[num];
+  if (!sm->enabled) return;
+  while (sm->t < t) {
+    int r = step(p, num);
+    if (r == STEP_PULL || r == STEP_PUSH) {
+      sm->t = t;
+      break;
+    }
+  }
+}
+
+void sim_pio_run(uint64_t t) {
+  for (int i = 0; i < 2; i++) {
+    sim_pio_t *p = &pios[i];
+    // a CPU write to FDEBUG cleared the bits it wrote
+    if ((p->hw.fdebug & FDEBUG_SENTINEL) == 0) p->fdebug &= ~p->hw.fdebug;
+    for (int s = 0; s < 4; s++) run_sm(p, s, t);
+    p->hw.fdebug = p->fdebug | FDEBUG_SENTINEL;
+  }
+}
+
+void sim_pio_irqs(void) {
+  static bool in_irq;
+  if (in_irq) return;
+  in_irq = true;
+  for (int i = 0; i < 2; i++) {
+    uint num = i ? PIO1_IRQ_0 : PIO0_IRQ_0;
+    if ((pios[i].irq & 1) && pios[i].irq0_int0 && sim_irq_enabled[num] && sim_irq_handler[num]) {
+      sim_irq_handler[num]();
+    }
+  }
+  in_irq = false;
+}
+
+void sim_pio_reset(void) {
+  for (int i = 0; i < 3; i++) {
+    memset(&pios[i], 0, sizeof(pios[i]));
+    pios[i].hw.fdebug = FDEBUG_SENTINEL;
+  }
+  preload_n = preload_pos = 0;
+}
+
+// a blocking FIFO call that can't go on until the state machine moves.  Runs it
+// until cond is met and moves the CPU time to when it was.
+static void run_for(sim_pio_t *p, int num, bool (*cond)(sim_sm_t *sm), const char *what) {
+  sim_sm_t *sm = &p->sm[num];
+  while (!cond(sm)) {
+    if (!sm->enabled) sim_fail("%s on a disabled state machine would hang\n", what);
+    uint64_t before = sm->t;
+    int r = step(p, num);
+    if (r == STEP_PULL || r == STEP_PUSH) {
+      sim_fail("%s would hang: the state machine is waiting on the %s FIFO at pc %d\n",
+               what, r == STEP_PULL ? "Tx" : "Rx", sm->pc);
+    }
+    if (r == STEP_RAN && before > sim_cpu_ps) sim_cpu_ps = before;
+  }
+  if (sim_cpu_ps < sm->t) {
+    // the CPU sees the FIFO change at the end of the instruction that changed it
+    sim_cpu_ps = sm->t;
+  }
+  sim_pio_run(sim_cpu_ps);
+}
+
+static bool tx_not_full(sim_sm_t *sm) { return sm->tx_n < 4; }
+static bool rx_not_empty(sim_sm_t *sm) { return sm->rx_n > 0; }
+
+// SDK -----------------------------------------------------------------------------
+
+uint pio_get_index(PIO pio) {
+  return pio_index(get_pio(pio));
+}
+
+static int find_offset(sim_pio_t *p, int len) {
+  for (int off = 32 - len; off >= 0; off--) {
+    uint32_t mask = ((len == 32) ? 0xFFFFFFFF : ((1u << len) - 1)) << off;
+    if ((p->used & mask) == 0) return off;
+  }
+  return -1;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program) {
+  sim_cpu();
+  return find_offset(get_pio(pio), find_program(program->name)->len) >= 0;
+}
+
+bool pio_can_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset) {
+  sim_cpu();
+  int len = find_program(program->name)->len;
+  if (offset + len > 32) return false;
+  uint32_t mask = ((len == 32) ? 0xFFFFFFFF : ((1u << len) - 1)) << offset;
+  return (get_pio(pio)->used & mask) == 0;
+}
+
+void pio_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset) {
+  if (!pio_can_add_program_at_offset(pio, program, offset)) {
+    sim_fail("no room for %s at %d\n", program->name, offset);
+  }
+  sim_pio_t *p = get_pio(pio);
+  sim_program_t *prog = find_program(program->name);
+  for (int i = 0; i < prog->len; i++) {
+    p->mem[offset + i] = prog->code[i];
+    p->mem[offset + i].target += offset;
+    p->used |= 1u << (offset + i);
+  }
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+  sim_cpu();
+  int off = find_offset(get_pio(pio), find_program(program->name)->len);
+  if (off < 0) sim_fail("no room for %s in PIO%d\n", program->name, pio_get_index(pio));
+  pio_add_program_at_offset(pio, program, off);
+  return off;
+}
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint offset) {
+  sim_cpu();
+  sim_pio_t *p = get_pio(pio);
+  int len = find_program(program->name)->len;
+  for (int i = 0; i < len; i++) {
+    p->used &= ~(1u << (offset + i));
+    memset(&p->mem[offset + i], 0, sizeof(sim_instr_t));
+  }
+}
+
+int pio_claim_unused_sm(PIO pio, bool required) {
+  sim_cpu();
+  sim_pio_t *p = get_pio(pio);
+  for (int s = 0; s < 4; s++) {
+    if (!p->sm[s].claimed) {
+      p->sm[s].claimed = true;
+      return s;
+    }
+  }
+  if (required) sim_fail("no free state machine in PIO%d\n", pio_get_index(pio));
+  return -1;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm) {
+  get_pio(pio)->sm[sm].claimed = false;
+}
+
+void pio_gpio_init(PIO pio, uint pin) {
+  sim_cpu();
+  sim_gpio_set_function(pin, get_pio(pio) == &pios[0] ? SIM_FUNC_PIO0 : SIM_FUNC_PIO1);
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div) {
+  sim_cpu();
+  // the divider is 16.8 fixed point
+  double d = floor(div * 256.0 + 0.5) / 256.0;
+  get_pio(pio)->sm[sm].period_ps = (uint64_t)(d * (1e12 / SIM_CLK_SYS_HZ) + 0.5);
+  get_pio(pio)->sm[sm].cfg.clkdiv = div;
+}
+
+void pio_sm_restart(PIO pio, uint sm) {
+  sim_cpu();
+  sim_sm_t *s = &get_pio(pio)->sm[sm];
+  s->osr_count = 32;
+  s->isr_count = 0;
+  s->isr = 0;
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+  sim_cpu();
+  sim_sm_t *s = &get_pio(pio)->sm[sm];
+  s->tx_n = 0;
+  s->rx_n = 0;
+}
+
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+  sim_cpu();
+  sim_sm_t *s = &get_pio(pio)->sm[sm];
+  s->enabled = false;
+  s->cfg = *config;
+  pio_sm_set_clkdiv(pio, sm, config->clkdiv);
+  pio_sm_clear_fifos(pio, sm);
+  pio_sm_restart(pio, sm);
+  s->x = s->y = s->osr = 0;
+  s->pc = initial_pc;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+  sim_cpu();
+  sim_sm_t *s = &get_pio(pio)->sm[sm];
+  if (enabled && !s->enabled) s->t = sim_cpu_ps;
+  s->enabled = enabled;
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr) {
+  sim_cpu();
+  sim_pio_t *p = get_pio(pio);
+  sim_sm_t *s = &p->sm[sm];
+  if ((instr & 0xE000) == 0x0000) {         // jmp always
+    s->pc = instr & 0x1F;
+  } else if ((instr & 0xE000) == 0xE000) {  // set
+    write_dest(p, s, (instr >> 5) & 7, instr & 0x1F, 5, s->cfg.set_base, s->cfg.set_count, sim_cpu_ps);
+  } else {
+    sim_fail("pio_sm_exec of 0x%04x is not modelled\n", instr);
+  }
+}
+
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values) {
+  sim_cpu();
+  (void)sm;
+  sim_pio_t *p = get_pio(pio);
+  for (uint pin = 0; pin < 32; pin++) set_pin(p, pin, (pin_values >> pin) & 1, sim_cpu_ps);
+}
+
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+  sim_cpu();
+  (void)sm;
+  sim_pio_t *p = get_pio(pio);
+  for (uint i = 0; i < pin_count; i++) set_pindir(p, pin_base + i, is_out, sim_cpu_ps);
+}
+
+uint8_t pio_sm_get_pc(PIO pio, uint sm) {
+  sim_cpu();
+  return get_pio(pio)->sm[sm].pc;
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+  sim_cpu();
+  sim_sm_t *s = &get_pio(pio)->sm[sm];
+  if (s->tx_n < 4) s->tx[s->tx_n++] = data;
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) {
+  sim_cpu();
+  sim_pio_t *p = get_pio(pio);
+  run_for(p, sm, tx_not_full, "pio_sm_put_blocking");
+  p->sm[sm].tx[p->sm[sm].tx_n++] = data;
+}
+
+static bool preloaded(void) {
+  return preload_pos < preload_n;
+}
+
+static uint32_t rx_pop(sim_sm_t *s) {
+  if (preloaded()) return preload[preload_pos++];
+  if (s->rx_n == 0) return 0;
+  uint32_t v = s->rx[0];
+  memmove(&s->rx[0], &s->rx[1], --s->rx_n * sizeof(uint32_t));
+  return v;
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm) {
+  sim_cpu();
+  return rx_pop(&get_pio(pio)->sm[sm]);
+}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm) {
+  sim_cpu();
+  if (!preloaded()) run_for(get_pio(pio), sm, rx_not_empty, "pio_sm_get_blocking");
+  return rx_pop(&get_pio(pio)->sm[sm]);
+}
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm) {
+  sim_cpu();
+  return get_pio(pio)->sm[sm].tx_n == 4;
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm) {
+  sim_cpu();
+  return get_pio(pio)->sm[sm].tx_n == 0;
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) {
+  sim_cpu();
+  if (preloaded()) return false;
+  return get_pio(pio)->sm[sm].rx_n == 0;
+}
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm) {
+  sim_cpu();
+  return get_pio(pio)->sm[sm].rx_n == 4;
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm) {
+  sim_cpu();
+  return get_pio(pio)->sm[sm].tx_n;
+}
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm) {
+  sim_cpu();
+  if (preloaded()) return preload_n - preload_pos;
+  return get_pio(pio)->sm[sm].rx_n;
+}
+
+void pio_set_irq0_source_enabled(PIO pio, enum pio_interrupt_source source, bool enabled) {
+  sim_cpu();
+  if (source == pis_interrupt0) get_pio(pio)->irq0_int0 = enabled;
+}
+
+void pio_interrupt_clear(PIO pio, uint num) {
+  sim_cpu();
+  get_pio(pio)->irq &= ~(1u << num);
+}
+
+bool pio_interrupt_get(PIO pio, uint num) {
+  sim_cpu();
+  return (get_pio(pio)->irq >> num) & 1;
+}
+
+uint pio_encode_jmp(uint addr) {
+  return addr & 0x1F;
+}
+
+uint pio_encode_set(enum pio_src_dest dest, uint value) {
+  return 0xE000 | (dest << 5) | (value & 0x1F);
+}
+
+pio_sm_config pio_get_default_sm_config(void) {
+  pio_sm_config c;
+  memset(&c, 0, sizeof(c));
+  c.clkdiv = 1;
+  c.in_shift_right = true;
+  c.out_shift_right = true;
+  c.push_threshold = 32;
+  c.pull_threshold = 32;
+  c.wrap = 31;
+  return c;
+}
+
+void sm_config_set_out_pins(pio_sm_config *c, uint base, uint count) {
+  c->out_base = base;
+  c->out_count = count;
+}
+
+void sm_config_set_set_pins(pio_sm_config *c, uint base, uint count) {
+  c->set_base = base;
+  c->set_count = count;
+}
+
+void sm_config_set_in_pins(pio_sm_config *c, uint base) {
+  c->in_base = base;
+}
+
+void sm_config_set_jmp_pin(pio_sm_config *c, uint pin) {
+  c->jmp_pin = pin;
+}
+
+void sm_config_set_clkdiv(pio_sm_config *c, float div) {
+  c->clkdiv = div;
+}
+
+void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint threshold) {
+  c->in_shift_right = shift_right;
+  c->autopush = autopush;
+  c->push_threshold = threshold;
+}
+
+void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint threshold) {
+  c->out_shift_right = shift_right;
+  c->autopull = autopull;
+  c->pull_threshold = threshold;
+}
+
+// OneWire.pio.h -------------------------------------------------------------------
+
+static pio_sm_config default_config(const char *name, uint offset) {
+  pio_sm_config c = pio_get_default_sm_config();
+  c.wrap_target = offset;
+  c.wrap = offset + find_program(name)->len - 1;
+  return c;
+}
+
+pio_sm_config OneWire_program_get_default_config(uint offset) {
+  return default_config("OneWire", offset);
+}
+
+pio_sm_config OneWire_overdrive_program_get_default_config(uint offset) {
+  return default_config("OneWire_overdrive", offset);
+}
+
+pio_sm_config OneWire_detect_program_get_default_config(uint offset) {
+  return default_config("OneWire_detect", offset);
+}
+
+void OneWire_program_init(PIO pio, uint sm, uint offset, uint pin) {
+  pio_sm_config c = OneWire_program_get_default_config(offset);
+  sm_config_set_out_pins(&c, pin, 1);
+  sm_config_set_set_pins(&c, pin, 1);
+  sm_config_set_in_pins(&c, pin);
+  sm_config_set_jmp_pin(&c, pin);
+  pio_gpio_init(pio, pin);
+  pio_sm_set_consecutive_pindirs(pio, sm, pin, 1, false);
+  float div = (float)clock_get_hz(clk_sys) / (5 * 100000);
+  sm_config_set_clkdiv(&c, div);
+  pio_sm_init(pio, sm, offset, &c);
+  pio_sm_set_pins(pio, sm, 0);
+  pio_sm_set_enabled(pio, sm, true);
+}
+
+void OneWire_detect_program_init(PIO pio, uint sm, uint offset, uint pin) {
+  pio_sm_config c = OneWire_detect_program_get_default_config(offset);
+  sm_config_set_out_pins(&c, pin, 1);
+  sm_config_set_set_pins(&c, pin, 1);
+  sm_config_set_in_pins(&c, pin);
+  sm_config_set_jmp_pin(&c, pin);
+  sm_config_set_in_shift(&c, true, true, 32);
+  sm_config_set_out_shift(&c, true, false, 32);
+  pio_gpio_init(pio, pin);
+  pio_sm_set_consecutive_pindirs(pio, sm, pin, 1, false);
+  float div = (float)clock_get_hz(clk_sys) / (5 * 100000);
+  sm_config_set_clkdiv(&c, div);
+  pio_sm_init(pio, sm, offset, &c);
+  pio_sm_set_pins(pio, sm, 0);
+  pio_sm_set_enabled(pio, sm, true);
+}
+
+// test helpers --------------------------------------------------------------------
+
+void sim_preload_rx(const uint32_t words[], int num) {
+  if (num > 64) sim_fail("sim_preload_rx: too many words\n");
+  memcpy(preload, words, num * sizeof(uint32_t));
+  preload_n = num;
+  preload_pos = 0;
+}
+
+bool sim_pio_pulses(const char *program, double clock_hz, uint32_t cmd, sim_pio_pulses_t *pulses) {
+  sim_pio_t *p = &pios[2];
+  sim_program_t *prog = find_program(program);
+  memset(p, 0, sizeof(*p));
+  memset(pulses, 0, sizeof(*pulses));
+  for (int i = 0; i < prog->len; i++) {
+    p->mem[i] = prog->code[i];
+    p->used |= 1u << i;
+  }
+  sim_sm_t *sm = &p->sm[0];
+  // a pin no bus is on so it reads high whenever the program lets go
+  uint pin = 31;
+  sm->cfg = pio_get_default_sm_config();
+  sm->cfg.wrap = prog->len - 1;
+  sm->cfg.out_base = sm->cfg.set_base = sm->cfg.in_base = sm->cfg.jmp_pin = pin;
+  sm->cfg.out_count = sm->cfg.set_count = 1;
+  sm->period_ps = (uint64_t)(1e12 / clock_hz + 0.5);
+  sm->enabled = true;
+  sm->osr_count = 32;
+  p->pin_dir[pin] = false;
+  p->pin_out[pin] = false;
+  probe = pulses;
+  probe_pin = pin;
+  probe_low = false;
+  sm->tx[sm->tx_n++] = cmd;
+  // run until the command is done and the program is back waiting for the next one
+  bool ok = false;
+  for (int i = 0; i < 100000; i++) {
+    int r = step(p, 0);
+    if (r == STEP_PULL) {
+      ok = true;
+      break;
+    }
+    if (r == STEP_PUSH) break;
+  }
+  probe = NULL;
+  return ok;
+}
@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// The part of the Pico SDK the OneWire code uses, declared for the host.  The
+// functions are implemented by sim.c on top of the simulated PIO, GPIOs, timer
+// and 1-Wire bus.  Every call costs some simulated CPU time so polling loops
+// move time on the way they do on the chip.
+
+#ifndef SIM_SDK_H
+#define SIM_SDK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+// time
+typedef uint64_t absolute_time_t;
+extern const absolute_time_t at_the_end_of_time;
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+absolute_time_t get_absolute_time(void);
+absolute_time_t make_timeout_time_us(uint64_t us);
+absolute_time_t make_timeout_time_ms(uint32_t ms);
+absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us);
+bool time_reached(absolute_time_t t);
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to);
+uint64_t to_us_since_boot(absolute_time_t t);
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+void sleep_until(absolute_time_t t);
+void busy_wait_us_32(uint32_t us);
+void busy_wait_us(uint64_t us);
+void tight_loop_contents(void);
+void __wfi(void);
+void __wfe(void);
+void __sev(void);
+
+// hardware alarms
+typedef void (*hardware_alarm_callback_t)(uint alarm);
+int hardware_alarm_claim_unused(bool required);
+void hardware_alarm_unclaim(uint alarm);
+void hardware_alarm_set_callback(uint alarm, hardware_alarm_callback_t callback);
+bool hardware_alarm_set_target(uint alarm, absolute_time_t t);
+void hardware_alarm_cancel(uint alarm);
+
+// clocks
+#define clk_sys 5
+uint32_t clock_get_hz(int clk);
+
+// gpio
+#define GPIO_IN 0
+#define GPIO_OUT 1
+void gpio_init(uint pin);
+void gpio_set_dir(uint pin, bool out);
+void gpio_put(uint pin, bool value);
+bool gpio_get(uint pin);
+uint32_t gpio_get_all(void);
+void gpio_init_mask(uint32_t mask);
+void gpio_clr_mask(uint32_t mask);
+void gpio_set_dir_in_masked(uint32_t mask);
+void gpio_set_dir_out_masked(uint32_t mask);
+
+// interrupts
+#define PIO0_IRQ_0 7
+#define PIO1_IRQ_0 9
+typedef void (*irq_handler_t)(void);
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+// mutexes
+typedef struct { int depth; } recursive_mutex_t;
+typedef struct { bool owned; } mutex_t;
+void recursive_mutex_init(recursive_mutex_t *m);
+void recursive_mutex_enter_blocking(recursive_mutex_t *m);
+void recursive_mutex_exit(recursive_mutex_t *m);
+void mutex_init(mutex_t *m);
+void mutex_enter_blocking(mutex_t *m);
+void mutex_exit(mutex_t *m);
+
+// pio
+typedef struct pio_hw {
+  volatile uint32_t ctrl;
+  volatile uint32_t fstat;
+  volatile uint32_t fdebug;
+  volatile uint32_t flevel;
+} pio_hw_t;
+typedef pio_hw_t *PIO;
+extern PIO pio0;
+extern PIO pio1;
+
+#define PIO_FDEBUG_TXSTALL_LSB 24
+#define PIO_FDEBUG_RXSTALL_LSB 0
+
+// only the name is kept, the instructions are read from OneWire.pio
+typedef struct pio_program {
+  const char *name;
+} pio_program_t;
+
+typedef struct {
+  float clkdiv;
+  uint out_base, out_count;
+  uint set_base, set_count;
+  uint in_base;
+  uint jmp_pin;
+  bool in_shift_right, autopush;
+  uint push_threshold;
+  bool out_shift_right, autopull;
+  uint pull_threshold;
+  uint wrap_target, wrap;
+} pio_sm_config;
+
+enum pio_src_dest {
+  pio_pins = 0,
+  pio_x = 1,
+  pio_y = 2,
+  pio_null = 3,
+  pio_pindirs = 4,
+};
+
+enum pio_interrupt_source {
+  pis_interrupt0 = 8,
+};
+
+uint pio_get_index(PIO pio);
+bool pio_can_add_program(PIO pio, const pio_program_t *program);
+uint pio_add_program(PIO pio, const pio_program_t *program);
+bool pio_can_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset);
+void pio_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset);
+void pio_remove_program(PIO pio, const pio_program_t *program, uint offset);
+int pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_unclaim(PIO pio, uint sm);
+void pio_gpio_init(PIO pio, uint pin);
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_sm_restart(PIO pio, uint sm);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div);
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values);
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+uint8_t pio_sm_get_pc(PIO pio, uint sm);
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+uint32_t pio_sm_get(PIO pio, uint sm);
+uint32_t pio_sm_get_blocking(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm);
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm);
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm);
+void pio_set_irq0_source_enabled(PIO pio, enum pio_interrupt_source source, bool enabled);
+void pio_interrupt_clear(PIO pio, uint num);
+bool pio_interrupt_get(PIO pio, uint num);
+uint pio_encode_jmp(uint addr);
+uint pio_encode_set(enum pio_src_dest dest, uint value);
+
+void sm_config_set_out_pins(pio_sm_config *c, uint base, uint count);
+void sm_config_set_set_pins(pio_sm_config *c, uint base, uint count);
+void sm_config_set_in_pins(pio_sm_config *c, uint base);
+void sm_config_set_jmp_pin(pio_sm_config *c, uint pin);
+void sm_config_set_clkdiv(pio_sm_config *c, float div);
+void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint threshold);
+void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint threshold);
+pio_sm_config pio_get_default_sm_config(void);
+
+// code and data meant for SRAM go in their own sections so the XIP model in sim.c
+// can tell them from code that would run from flash
+#define __not_in_flash(group) __attribute__((section("sim_ram_data")))
+#define __not_in_flash_func(func) __attribute__((section("sim_ram"))) func
+#define __time_critical_func(func) __not_in_flash_func(func)
+#define __aligned(x) __attribute__((aligned(x)))
+
+#endif //SIM_SDK_H
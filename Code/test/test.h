@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// A few macros for the host tests.  Each test is its own program that returns
+// non zero if any check failed.
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "sim.h"
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long _a = (long long)(a), _b = (long long)(b); \
+    if (_a != _b) { \
+      printf("FAIL %s:%d: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+      test_failures++; \
+    } \
+  } while (0)
+
+static inline int test_done(const char *name) {
+  printf("%s: %s\n", name, test_failures ? "FAILED" : "passed");
+  return test_failures != 0;
+}
+
+// host time in nanoseconds for the benchmarks
+static inline uint64_t host_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// simulated time in microseconds
+static inline double sim_us(void) {
+  return sim_now_ps() / (double)SIM_PS_PER_US;
+}
+
+#endif //TEST_H
@@ -0,0 +1,272 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Checks the CRC8 table against the bitwise CRC, the CRC16 functions, and that the
+// word aligned pull gives the same bytes and CRC result as the byte pull.  Times the
+// two 9 byte pulls with the Rx FIFO already full.  Also checks that a write held back
+// by the coalescer keeps the bus lock until a flush, unlock or read pushes it, that a
+// short read comes back right aligned and that a reset sees who is there.  Times the 
+// timed pulls against a timeout and against data that comes in time.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireDrivers.h"
+#include "test.h"
+
+static void test_crc8_table(void) {
+  // every byte followed by its bitwise CRC must check out with the table
+  for (int b = 0; b < 256; b++) {
+    uint8_t a[2] = { b, 0 };
+    a[1] = sim_crc8(a, 1);
+    CHECK_EQ(oneWire_CRC(a, 2), ONE_WIRE_NO_ERROR);
+  }
+  uint8_t check[10] = "123456789";
+  CHECK_EQ(sim_crc8(check, 9), 0xA1);
+  check[9] = 0xA1;
+  CHECK_EQ(oneWire_CRC(check, 10), ONE_WIRE_NO_ERROR);
+  // random messages pass and any one bit flip fails
+  sim_srand(53);
+  for (int n = 0; n < 1000; n++) {
+    uint8_t m[9];
+    for (int i = 0; i < 8; i++) m[i] = sim_rand();
+    m[8] = sim_crc8(m, 8);
+    CHECK_EQ(oneWire_CRC(m, 9), ONE_WIRE_NO_ERROR);
+    int bit = sim_rand() % 72;
+    m[bit / 8] ^= 1 << (bit % 8);
+    CHECK(oneWire_CRC(m, 9) == (oneWire_status)ONE_WIRE_READ_CRC_FAILURE);
+  }
+}
+
+static void test_crc16(void) {
+  const uint8_t check[] = "123456789";
+  CHECK_EQ(oneWire_CRC16(0, check, 9), 0xBB3D);
+  // continuing from a seed is the same as one pass
+  CHECK_EQ(oneWire_CRC16(oneWire_CRC16(0, check, 4), &check[4], 5), 0xBB3D);
+  // the device sends the inverted CRC low byte first
+  uint8_t cmd[3] = { 0xF0, 0x10, 0x00 };
+  uint8_t data[10];
+  for (int i = 0; i < 8; i++) data[i] = i * 37;
+  uint16_t crc = ~sim_crc16(sim_crc16(0, cmd, 3), data, 8);
+  data[8] = crc & 0xFF;
+  data[9] = crc >> 8;
+  CHECK_EQ(oneWire_CRC16_check(oneWire_CRC16(0, cmd, 3), data, 10), ONE_WIRE_NO_ERROR);
+  CHECK(oneWire_CRC16_check(0, data, 10) == (oneWire_status)ONE_WIRE_READ_CRC_FAILURE);
+  CHECK(oneWire_CRC16_check(0, data, 1) == (oneWire_status)ONE_WIRE_ILLEGAL_DATA_SIZE_REQ);
+}
+
+// what the state machine leaves in the Rx FIFO for a 9 byte read.  The byte pull
+// gets the last byte in the top of a word, the word pull gets it in the bottom.
+static void fifo_words(const uint8_t m[9], bool aligned, uint32_t w[3]) {
+  w[0] = m[0] | (m[1] << 8) | (m[2] << 16) | ((uint32_t)m[3] << 24);
+  w[1] = m[4] | (m[5] << 8) | (m[6] << 16) | ((uint32_t)m[7] << 24);
+  w[2] = aligned ? m[8] : (uint32_t)m[8] << 24;
+}
+
+static void test_pull_benchmark(void) {
+  const int runs = 20000;
+  uint8_t m[9] = { 0x91, 0x01, 0x4B, 0x46, 0x7F, 0xFF, 0x0F, 0x10, 0 };
+  m[8] = sim_crc8(m, 8);
+  uint32_t raw[3], aligned[3];
+  fifo_words(m, false, raw);
+  fifo_words(m, true, aligned);
+
+  uint8_t bytes[9];
+  uint32_t words[3];
+  uint64_t sim_start = sim_now_ps();
+  uint64_t start = host_ns();
+  for (int i = 0; i < runs; i++) {
+    sim_preload_rx(raw, 3);
+    CHECK_EQ(oneWire_pull_read_bytes(bytes, 9, true), ONE_WIRE_NO_ERROR);
+  }
+  double bytes_ns = (host_ns() - start) / (double)runs;
+  double bytes_sim = (sim_now_ps() - sim_start) / 1000.0 / runs;
+  sim_start = sim_now_ps();
+  start = host_ns();
+  for (int i = 0; i < runs; i++) {
+    sim_preload_rx(aligned, 3);
+    CHECK_EQ(oneWire_pull_read_words(words, 9, true), ONE_WIRE_NO_ERROR);
+  }
+  double words_ns = (host_ns() - start) / (double)runs;
+  double words_sim = (sim_now_ps() - sim_start) / 1000.0 / runs;
+  CHECK(memcmp(bytes, m, 9) == 0);
+  CHECK(memcmp(words, m, 9) == 0);
+  printf("9 byte pull: oneWire_pull_read_bytes %.0fns host, %.0fns of SDK calls\n", bytes_ns, bytes_sim);
+  printf("9 byte pull: oneWire_pull_read_words %.0fns host, %.0fns of SDK calls\n", words_ns, words_sim);
+
+  // a bad CRC is caught the same way by both
+  m[3] ^= 0x10;
+  fifo_words(m, false, raw);
+  fifo_words(m, true, aligned);
+  sim_preload_rx(raw, 3);
+  CHECK(oneWire_pull_read_bytes(bytes, 9, true) == (oneWire_status)ONE_WIRE_READ_CRC_FAILURE);
+  sim_preload_rx(aligned, 3);
+  CHECK(oneWire_pull_read_words(words, 9, true) == (oneWire_status)ONE_WIRE_READ_CRC_FAILURE);
+}
+
+// the same scratchpad read through the state machine with both pulls
+static void test_scratchpad_read(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t rom = sim_random_rom(0x28);
+  sim_dev_t *d = sim_ds18b20_new(rom, 21.5);
+  sim_bus_add(bus, d);
+  init_OneWire();
+
+  uint8_t cmd[10];
+  int len = oneWire_match_rom_cmd(rom, cmd);
+  cmd[len++] = 0xBE;
+  uint8_t data[9];
+  CHECK_EQ(oneWire_transaction(true, cmd, len, data, 9, ONE_WIRE_CRC8), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(data[0], 0x50);   // 85C at power on
+  CHECK_EQ(data[1], 0x05);
+
+  uint32_t words[3];
+  oneWire_reset(true);
+  for (int i = 0; i < len; i++) oneWire_write_byte(cmd[i], true);
+  CHECK_EQ(oneWire_read_words(words, 9), ONE_WIRE_NO_ERROR);
+  CHECK(memcmp(words, data, 9) == 0);
+  CHECK_EQ(d->selects, 2);
+
+  // the odd byte is held back and keeps the bus lock until it is flushed
+  oneWire_get_coalesced_writes(true);
+  oneWire_reset(true);
+  oneWire_wait_for_sm_idle();
+  uint32_t slots = bus->slots;
+  for (int i = 0; i < len - 1; i++) oneWire_write_byte(cmd[i], true);
+  CHECK_EQ(sim_lock_depth(), 1);
+  sleep_ms(6);
+  CHECK_EQ(bus->slots - slots, 8 * (len - 2));
+  oneWire_flush();
+  CHECK_EQ(sim_lock_depth(), 0);
+  sleep_ms(1);
+  CHECK_EQ(bus->slots - slots, 8 * (len - 1));
+  CHECK_EQ(oneWire_get_coalesced_writes(true), len / 2);
+  CHECK_EQ(d->selects, 3);
+
+  // releasing the bus pushes it too, the lock is back to where it was
+  oneWire_reset(true);
+  oneWire_wait_for_sm_idle();
+  slots = bus->slots;
+  oneWire_bus_lock();
+  for (int i = 0; i < len - 1; i++) oneWire_write_byte(cmd[i], true);
+  CHECK_EQ(sim_lock_depth(), 2);
+  oneWire_bus_unlock();
+  CHECK_EQ(sim_lock_depth(), 0);
+  sleep_ms(6);
+  CHECK_EQ(bus->slots - slots, 8 * (len - 1));
+  CHECK_EQ(d->selects, 4);
+
+  // and pushed ahead of a read, match rom and read scratchpad in 5 words
+  oneWire_get_coalesced_writes(true);
+  oneWire_reset(true);
+  for (int i = 0; i < len; i++) oneWire_write_byte(cmd[i], true);
+  memset(words, 0, sizeof(words));
+  CHECK_EQ(oneWire_read_words(words, 9), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(sim_lock_depth(), 0);
+  CHECK(memcmp(words, data, 9) == 0);
+  CHECK_EQ(oneWire_get_coalesced_writes(true), len / 2);
+  CHECK_EQ(d->selects, 5);
+
+  // the temperature and TH, then the reset ends the read and sees the presence pulse
+  CHECK(oneWire_reset_presence());
+  for (int i = 0; i < len; i++) oneWire_write_byte(cmd[i], true);
+  oneWire_push_read_cmd(24);
+  CHECK_EQ(oneWire_pull_read_data(24), data[0] | data[1] << 8 | data[2] << 16);
+  bus->num_devs = 0;
+  CHECK(!oneWire_reset_presence());
+  bus->num_devs = 1;
+  CHECK(oneWire_reset_presence());
+  CHECK_EQ(d->selects, 6);
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  sim_dev_free(d);
+  sim_bus_free(bus);
+}
+
+// a read slot is 34 cycles of the 500kHz state machine clock and each read command
+// takes about 20us more to decode and push
+#define READ_SLOT_US 68
+#define READ_CMD_US 30
+
+// the timed pulls give up when the timeout is up, not before and not much after, and
+// return as soon as the data is there when it comes in time
+static void test_timed_pull(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t rom = sim_random_rom(0x28);
+  sim_dev_t *d = sim_ds18b20_new(rom, 21.5);
+  sim_bus_add(bus, d);
+  uint8_t cmd[10];
+  int len = oneWire_match_rom_cmd(rom, cmd);
+  cmd[len++] = 0xBE;
+
+  // nothing was asked for
+  uint32_t v = 0;
+  uint recoveries = oneWire_get_last_recovery(NULL);
+  uint64_t start = time_us_64();
+  CHECK(oneWire_pull_read_data_timeout(8, &v, 500) == (oneWire_status)ONE_WIRE_FIFO_TIMEOUT);
+  uint64_t took = time_us_64() - start;
+  CHECK(took >= 500 && took < 520);
+  CHECK_EQ(oneWire_get_last_recovery(NULL), recoveries + 1);
+
+  // 8 read slots take about 544us, less time than that is a timeout
+  oneWire_reset(true);
+  for (int i = 0; i < len; i++) oneWire_write_byte(cmd[i], true);
+  oneWire_wait_for_sm_idle();
+  oneWire_push_read_cmd(8);
+  start = time_us_64();
+  CHECK(oneWire_pull_read_data_timeout(8, &v, 4 * READ_SLOT_US) == (oneWire_status)ONE_WIRE_FIFO_TIMEOUT);
+  took = time_us_64() - start;
+  CHECK(took >= 4 * READ_SLOT_US && took < 4 * READ_SLOT_US + 20);
+  CHECK_EQ(oneWire_get_last_recovery(NULL), recoveries + 2);
+  // and more is the byte, with no wait past the last slot
+  oneWire_reset(true);
+  for (int i = 0; i < len; i++) oneWire_write_byte(cmd[i], true);
+  oneWire_wait_for_sm_idle();
+  oneWire_push_read_cmd(8);
+  start = time_us_64();
+  CHECK(oneWire_pull_read_data_timeout(8, &v, 5000) == ONE_WIRE_NO_ERROR);
+  took = time_us_64() - start;
+  CHECK_EQ(v, 0x50);
+  CHECK(took >= 8 * READ_SLOT_US && took < 8 * READ_SLOT_US + READ_CMD_US);
+  CHECK_EQ(oneWire_get_last_recovery(NULL), recoveries + 2);
+
+  // 9 bytes come in 3 words, the pull waits for the last one
+  uint8_t data[9];
+  oneWire_reset(true);
+  for (int i = 0; i < len; i++) oneWire_write_byte(cmd[i], true);
+  oneWire_wait_for_sm_idle();
+  oneWire_push_read_bytes_cmd(9, true);
+  CHECK(oneWire_pull_read_bytes_timeout(data, 9, 64 * READ_SLOT_US) == 
+        (oneWire_status)ONE_WIRE_FIFO_TIMEOUT);
+  CHECK_EQ(oneWire_get_last_recovery(NULL), recoveries + 3);
+  oneWire_reset(true);
+  for (int i = 0; i < len; i++) oneWire_write_byte(cmd[i], true);
+  oneWire_wait_for_sm_idle();
+  oneWire_push_read_bytes_cmd(9, true);
+  start = time_us_64();
+  CHECK(oneWire_pull_read_bytes_timeout(data, 9, 100 * READ_SLOT_US) == ONE_WIRE_NO_ERROR);
+  took = time_us_64() - start;
+  CHECK(took >= 72 * READ_SLOT_US && took < 72 * READ_SLOT_US + 3 * READ_CMD_US);
+  CHECK_EQ(data[0], 0x50);
+  CHECK_EQ(oneWire_get_last_recovery(NULL), recoveries + 3);
+
+  // the bus is fine after the recoveries
+  CHECK_EQ(oneWire_transaction(true, cmd, len, data, 9, ONE_WIRE_CRC8), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  sim_dev_free(d);
+  sim_bus_free(bus);
+}
+
+int main() {
+  sim_reset();
+  test_crc8_table();
+  test_crc16();
+  test_pull_benchmark();
+  test_scratchpad_read();
+  test_timed_pull();
+  return test_done("crc");
+}
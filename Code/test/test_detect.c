@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Runs the OneWire_detect program on an empty bus, then puts a device on it the way
+// an iButton touches a probe.  Checks that the presence pulse raises the interrupt,
+// that the callback gets the rom with a good CRC, that it is armed again when the
+// callback asks for it and that stopping hands the pin back to the OneWire program.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireDrivers.h"
+#include "test.h"
+
+static int calls;
+static int keep_going;
+static uint64_t last_rom;
+static oneWire_status last_stat;
+
+static bool on_touch(uint64_t rom, oneWire_status stat) {
+  calls++;
+  last_rom = rom;
+  last_stat = stat;
+  return --keep_going > 0;
+}
+
+int main() {
+  sim_reset();
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  init_OneWire();
+
+  // nobody there, the detector keeps sending resets and never calls back
+  keep_going = 2;
+  CHECK(oneWire_detect_start(on_touch) == ONE_WIRE_NO_ERROR);
+  uint32_t resets = bus->resets;
+  sleep_ms(30);
+  CHECK(bus->resets - resets >= 8);
+  CHECK_EQ(calls, 0);
+
+  // a device touches the bus, its presence pulse starts the read rom
+  uint64_t rom = sim_random_rom(0x28);
+  sim_dev_t *d = sim_ds18b20_new(rom, 25);
+  sim_bus_add(bus, d);
+  sleep_ms(10);
+  CHECK_EQ(calls, 1);
+  CHECK(last_rom == rom);
+  CHECK(last_stat == ONE_WIRE_NO_ERROR);
+
+  // the callback asked to be armed again, the second time it stops the detector
+  sleep_ms(10);
+  CHECK_EQ(calls, 2);
+  CHECK(last_rom == rom);
+  resets = bus->resets;
+  sleep_ms(10);
+  CHECK_EQ(calls, 2);
+  CHECK_EQ(bus->resets, resets);
+
+  // the OneWire program has the pin back
+  uint8_t cmd[10];
+  int len = oneWire_match_rom_cmd(rom, cmd);
+  cmd[len++] = 0xBE;
+  uint8_t data[9];
+  CHECK(oneWire_transaction(true, cmd, len, data, 9, ONE_WIRE_CRC8) == ONE_WIRE_NO_ERROR);
+  CHECK_EQ(data[0], 0x50);   // 85C at power on
+  CHECK_EQ(d->selects, 3);
+
+  // and the detector starts again after a stop from outside the callback
+  keep_going = 10;
+  CHECK(oneWire_detect_start(on_touch) == ONE_WIRE_NO_ERROR);
+  sleep_ms(10);
+  CHECK(calls > 2);
+  // stopped in the middle of a pulse it finishes the pulse first
+  while (!bus->low) sleep_us(1);
+  oneWire_detect_stop();
+  CHECK(!bus->low);
+  int stopped_at = calls;
+  sleep_ms(10);
+  CHECK_EQ(calls, stopped_at);
+  CHECK(oneWire_transaction(true, cmd, len, data, 9, ONE_WIRE_CRC8) == ONE_WIRE_NO_ERROR);
+
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  sim_dev_free(d);
+  sim_bus_free(bus);
+  return test_done("detect");
+}
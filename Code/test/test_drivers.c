@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Runs oneWire_driver_sweep() over a bus of DS18B20s and DS2438s.  Checks that the
+// DS2438 gets its Convert V, that no device is read before its conversion is done,
+// and that a sweep needing too many conversion commands is refused before it
+// touches the bus.  Also prints the gaps between devices with prefetch on and off, 
+// checks that staggered conversions are never read early, and that a configuration 
+// broadcast writes again only the devices that dropped it.
+
+#include <math.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireDrivers.h"
+#include "test.h"
+
+#define NUM_TEMP 3
+#define NUM_BATT 2
+
+static bool decode_none(const uint8_t data[], oneWire_reading_t *r) {
+  (void)data;
+  r->num_values = 0;
+  return true;
+}
+
+static void test_mixed_sweep(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t roms[NUM_TEMP + NUM_BATT];
+  for (int i = 0; i < NUM_TEMP; i++) {
+    roms[i] = sim_random_rom(0x28);
+    sim_bus_add(bus, sim_ds18b20_new(roms[i], 20.5 + i));
+  }
+  for (int i = 0; i < NUM_BATT; i++) {
+    roms[NUM_TEMP + i] = sim_random_rom(0x26);
+    sim_bus_add(bus, sim_ds2438_new(roms[NUM_TEMP + i], 25.25, 3.71 + i));
+  }
+  init_OneWire();
+
+  oneWire_reading_t readings[NUM_TEMP + NUM_BATT];
+  CHECK_EQ(oneWire_driver_sweep(roms, NUM_TEMP + NUM_BATT, readings), NUM_TEMP + NUM_BATT);
+  for (int i = 0; i < NUM_TEMP; i++) {
+    CHECK_EQ(readings[i].status, ONE_WIRE_NO_ERROR);
+    CHECK(readings[i].value[0] == (float)(20.5 + i));
+  }
+  for (int i = 0; i < NUM_BATT; i++) {
+    oneWire_reading_t *r = &readings[NUM_TEMP + i];
+    CHECK_EQ(r->status, ONE_WIRE_NO_ERROR);
+    CHECK(r->value[0] == 25.25f);
+    CHECK_EQ(lround(r->value[1] * 100), 371 + 100 * i);
+    CHECK_EQ(bus->devs[NUM_TEMP + i]->conversions, 2);   // Convert T and Convert V
+  }
+  for (int i = 0; i < bus->num_devs; i++) CHECK_EQ(bus->devs[i]->early_reads, 0);
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  sim_bus_free(bus);
+}
+
+#define NUM_PREFETCH 12
+
+// with prefetch off the bus waits on the processor between every pair of devices and
+// the time taken comes back as the gap time.  With it on there are no gaps.
+static void test_prefetch_gaps(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t roms[NUM_PREFETCH];
+  for (int i = 0; i < NUM_PREFETCH; i++) {
+    roms[i] = sim_random_rom(0x28);
+    sim_bus_add(bus, sim_ds18b20_new(roms[i], 19 + i));
+  }
+  oneWire_reading_t readings[NUM_PREFETCH];
+  oneWire_sweep_stats_t on, off;
+  sim_set_cpu_ns(2000);   // a slow decode so the gaps are whole microseconds
+  oneWire_set_sweep_prefetch(false);
+  CHECK_EQ(oneWire_driver_sweep(roms, NUM_PREFETCH, readings), NUM_PREFETCH);
+  oneWire_get_sweep_stats(&off);
+  oneWire_set_sweep_prefetch(true);
+  CHECK_EQ(oneWire_driver_sweep(roms, NUM_PREFETCH, readings), NUM_PREFETCH);
+  oneWire_get_sweep_stats(&on);
+  sim_set_cpu_ns(50);
+  for (int i = 0; i < NUM_PREFETCH; i++) CHECK(readings[i].value[0] == (float)(19 + i));
+
+  CHECK_EQ(off.prefetched, 0);
+  CHECK_EQ(off.stalls, NUM_PREFETCH - 1);
+  CHECK(off.gap_us > 0);
+  CHECK_EQ(on.prefetched, NUM_PREFETCH);
+  CHECK_EQ(on.stalls, 0);
+  CHECK_EQ(on.gap_us, 0);
+  // the read pass is shorter by the gap time plus the end of each pull, which is
+  // before the sweep has the data so it is not in the gaps.  A call or two a device.
+  int32_t saved = off.read_us - on.read_us;
+  CHECK(saved >= (int32_t)off.gap_us);
+  CHECK(saved - (int32_t)off.gap_us <= 2 * 2 * NUM_PREFETCH);
+  printf("read pass of %d DS18B20s: prefetch off %uus with %u us of gaps, on %uus with %u us\n",
+         NUM_PREFETCH, off.read_us, off.gap_us, on.read_us, on.gap_us);
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  for (int i = 0; i < NUM_PREFETCH; i++) sim_dev_free(bus->devs[i]);
+  sim_bus_free(bus);
+}
+
+#define NUM_STAGGER 4
+
+// each device is read as soon as its own conversion time is up, counted from when the
+// convert command was out on the wire
+static void test_stagger(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t roms[NUM_STAGGER];
+  for (int i = 0; i < NUM_STAGGER; i++) {
+    roms[i] = sim_random_rom(0x28);
+    sim_bus_add(bus, sim_ds18b20_new(roms[i], 30 + i));
+  }
+  oneWire_stagger_t st;
+  CHECK_EQ(oneWire_stagger_start(&st, roms, NUM_STAGGER, 0), ONE_WIRE_NO_ERROR);
+  oneWire_reading_t r;
+  while (st.samples < 3 * NUM_STAGGER) {
+    if (oneWire_stagger_poll(&st, &r)) {
+      CHECK_EQ(r.status, ONE_WIRE_NO_ERROR);
+    } else {
+      sleep_us(100);
+    }
+    // the read of a match rom takes long enough to hide a due time a few commands 
+    // early, so hold the due time to when the device will be done
+    for (int i = 0; i < NUM_STAGGER; i++) {
+      sim_dev_t *d = bus->devs[i];
+      if (st.converting[i] && d->converting[0]) {
+        CHECK((uint64_t)(st.due_us[i] + 1) * SIM_PS_PER_US >= d->done_at[0]);
+      }
+    }
+  }
+  CHECK_EQ(st.errors, 0);
+  for (int i = 0; i < NUM_STAGGER; i++) {
+    CHECK(bus->devs[i]->conversions >= 3);
+    CHECK_EQ(bus->devs[i]->early_reads, 0);
+  }
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  for (int i = 0; i < NUM_STAGGER; i++) sim_dev_free(bus->devs[i]);
+  sim_bus_free(bus);
+}
+
+#define NUM_CONFIG 4
+
+// one device misses the skip rom write and is written again with match rom.  Then one
+// misses every command, the broadcast, the verify and all the retries.
+static void test_config_broadcast(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t roms[NUM_CONFIG];
+  for (int i = 0; i < NUM_CONFIG; i++) {
+    roms[i] = sim_random_rom(0x28);
+    sim_bus_add(bus, sim_ds18b20_new(roms[i], 20));
+  }
+  oneWire_status status[NUM_CONFIG];
+  oneWire_config_stats_t st;
+  bus->devs[1]->corrupt_cmds = 1;
+  uint32_t resets = bus->resets;
+  CHECK_EQ(oneWire_temp_config_broadcast(roms, NUM_CONFIG, 0x50, 0x0A, 0x3F, status, &st),
+           NUM_CONFIG);
+  CHECK_EQ(st.mismatches, 1);
+  CHECK_EQ(st.retries, 1);
+  CHECK_EQ(st.resets, 1 + NUM_CONFIG + 2);
+  CHECK_EQ(bus->resets - resets, st.resets);
+  for (int i = 0; i < NUM_CONFIG; i++) {
+    sim_dev_t *d = bus->devs[i];
+    CHECK(status[i] == ONE_WIRE_NO_ERROR);
+    CHECK_EQ(d->scratch[2], 0x50);
+    CHECK_EQ(d->scratch[3], 0x0A);
+    CHECK_EQ(d->scratch[4], 0x3F);
+    CHECK_EQ(d->selects, i == 1 ? 3 : 1);
+  }
+
+  bus->devs[2]->corrupt_cmds = 2 + 2 * ONE_WIRE_CONFIG_RETRIES;
+  CHECK_EQ(oneWire_temp_config_broadcast(roms, NUM_CONFIG, 0x4B, 0x46, 0x7F, status, &st),
+           NUM_CONFIG - 1);
+  CHECK_EQ(st.mismatches, 1);
+  CHECK_EQ(st.retries, ONE_WIRE_CONFIG_RETRIES);
+  for (int i = 0; i < NUM_CONFIG; i++) {
+    CHECK(status[i] == (i == 2 ? (oneWire_status)ONE_WIRE_READ_CRC_FAILURE : ONE_WIRE_NO_ERROR));
+    CHECK_EQ(bus->devs[i]->scratch[2], i == 2 ? 0x50 : 0x4B);
+  }
+  CHECK_EQ(bus->devs[2]->corrupt_cmds, 0);
+
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  for (int i = 0; i < NUM_CONFIG; i++) sim_dev_free(bus->devs[i]);
+  sim_bus_free(bus);
+}
+
+// with only DS2438s the reads follow the Convert V right away.  The bus has to be
+// left alone for the whole conversion time after the command is out on the wire.
+static void test_convert_wait(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t roms[NUM_BATT];
+  for (int i = 0; i < NUM_BATT; i++) {
+    roms[i] = sim_random_rom(0x26);
+    sim_bus_add(bus, sim_ds2438_new(roms[i], 18, 5.02));
+  }
+  oneWire_reading_t readings[NUM_BATT];
+  CHECK_EQ(oneWire_driver_sweep(roms, NUM_BATT, readings), NUM_BATT);
+  CHECK(bus->max_idle_ps >= 10 * 1000 * SIM_PS_PER_US);
+  for (int i = 0; i < NUM_BATT; i++) CHECK_EQ(bus->devs[i]->early_reads, 0);
+}
+
+static void test_too_many_converts(void) {
+  static oneWire_driver_t extra[ONE_WIRE_MAX_CONVERT_CMDS];
+  uint64_t roms[ONE_WIRE_MAX_CONVERT_CMDS + 1];
+  for (int i = 0; i < ONE_WIRE_MAX_CONVERT_CMDS; i++) {
+    extra[i] = (oneWire_driver_t){ .family = 0x70 + i, .name = "test", .convert_cmd = 0x60 + i,
+                                   .convert_time_ms = 5, .read_cmd = {0xBE}, .read_cmd_len = 1,
+                                   .read_len = 1, .crc = ONE_WIRE_CRC_NONE, .decode = decode_none };
+    CHECK_EQ(oneWire_register_driver(&extra[i]), ONE_WIRE_NO_ERROR);
+    roms[i] = sim_random_rom(0x70 + i);
+  }
+  // with the DS18B20 Convert T that is one too many
+  roms[ONE_WIRE_MAX_CONVERT_CMDS] = sim_random_rom(0x28);
+  sim_bus_t *bus = sim_bus_for_pin(ONE_WIRE_GPIO);
+  uint32_t resets = bus->resets;
+  oneWire_reading_t readings[ONE_WIRE_MAX_CONVERT_CMDS + 1];
+  CHECK_EQ(oneWire_driver_sweep(roms, ONE_WIRE_MAX_CONVERT_CMDS + 1, readings),
+           ONE_WIRE_ILLEGAL_DATA_SIZE_REQ);
+  CHECK_EQ(bus->resets, resets);
+}
+
+int main() {
+  sim_reset();
+  sim_srand(58);
+  test_mixed_sweep();
+  test_prefetch_gaps();
+  test_stagger();
+  test_config_broadcast();
+  test_convert_wait();
+  test_too_many_converts();
+  return test_done("drivers");
+}
@@ -0,0 +1,461 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Polls two DS2413s and checks that resume rom is only used on the device the core
+// last selected, and that a search, skip rom, a plain reset and a recovery are all
+// followed by a match rom.  Then sweeps 20 DS2438s and 16 DS2450s and prints the
+// sweep times.  Runs I2C writes and reads through a DS28E17 and checks that a 
+// command the bridge got with a bad CRC, a missing I2C device and a byte that was
+// not acked all come back as I2C failures with the bridge status.  Walks the main
+// and aux branches of two DS2409 couplers and checks that a coupler that does not
+// confirm smart on is switched again next time.  Streams a DS2408 through a ring
+// buffer that wraps, checks the first block CRC takes in the command, and that a bad
+// block and a full ring lose samples without mixing them up.  Walks a chain of 
+// DS28EA00s and checks they are found in the order they are wired, that every chain
+// command is confirmed and that a chain on nobody confirms fails.
+
+#include <math.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireIO.h"
+#include "test.h"
+
+static void test_ds2413_resume(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  sim_dev_t *dev[2];
+  for (int i = 0; i < 2; i++) {
+    dev[i] = sim_ds2413_new(sim_random_rom(0x3A), i == 0 ? 0x5 : 0xA);
+    sim_bus_add(bus, dev[i]);
+  }
+  // the search leaves the device it found last selected
+  uint64_t found[2];
+  CHECK_EQ(oneWire_search_rom_fast(found, 2, NULL), 2);
+  CHECK(oneWire_get_selected_rom() == found[1]);
+  sim_dev_t *a = dev[0]->rom == found[1] ? dev[0] : dev[1];
+  sim_dev_t *b = a == dev[0] ? dev[1] : dev[0];
+  init_OneWire();
+
+  oneWire_ds2413_t da = { .rom = a->rom }, db = { .rom = b->rom };
+  uint8_t state;
+  uint32_t slots = bus->slots;
+  CHECK_EQ(oneWire_ds2413_poll(&da, &state), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(state, a->pio);
+  CHECK_EQ(a->resumes, 1);
+  CHECK_EQ(bus->slots - slots, 24);
+  uint32_t selects = a->selects;
+
+  // another device matched in between, so match rather than resume into nobody
+  CHECK_EQ(oneWire_ds2413_poll(&db, &state), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(state, b->pio);
+  CHECK(oneWire_get_selected_rom() == b->rom);
+  CHECK_EQ(oneWire_ds2413_poll(&da, &state), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(a->selects, selects + 1);
+  CHECK_EQ(a->resumes, 1);
+  CHECK_EQ(oneWire_ds2413_poll(&da, &state), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(a->resumes, 2);
+
+  // skip rom, a plain reset and a recovery leave nobody selected
+  uint8_t skip = 0xCC;
+  oneWire_transaction(true, &skip, 1, NULL, 0, ONE_WIRE_CRC_NONE);
+  CHECK(oneWire_get_selected_rom() == 0);
+  CHECK_EQ(oneWire_ds2413_poll(&da, &state), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(a->selects, selects + 2);
+  oneWire_reset(true);
+  CHECK(oneWire_get_selected_rom() == 0);
+  CHECK_EQ(oneWire_ds2413_poll(&da, &state), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(a->selects, selects + 3);
+  oneWire_recover(NULL);
+  CHECK(oneWire_get_selected_rom() == 0);
+  CHECK_EQ(oneWire_ds2413_poll(&da, &state), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(a->selects, selects + 4);
+
+  // a burst resumes too
+  uint8_t states[5];
+  CHECK_EQ(oneWire_ds2413_poll_burst(&da, states, 5), 5);
+  CHECK_EQ(a->resumes, 3);
+  for (int i = 0; i < 5; i++) CHECK_EQ(states[i], a->pio);
+
+  CHECK_EQ(da.reselects + db.reselects, 0);
+  CHECK_EQ(da.bad_reads + db.bad_reads, 0);
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  for (int i = 0; i < 2; i++) sim_dev_free(dev[i]);
+  sim_bus_free(bus);
+}
+
+#define NUM_DS2438 20
+
+static void test_ds2438_sweep(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t roms[NUM_DS2438];
+  for (int i = 0; i < NUM_DS2438; i++) {
+    roms[i] = sim_random_rom(0x26);
+    sim_bus_add(bus, sim_ds2438_new(roms[i], 10 + i, 3 + i * 0.05));
+  }
+  bus->idle_mark_ps = DS2438_CONVERT_T_MS * 1000 * SIM_PS_PER_US;
+  oneWire_reading_t readings[NUM_DS2438];
+  uint32_t sweep_us;
+  CHECK_EQ(oneWire_ds2438_sweep(roms, NUM_DS2438, readings, &sweep_us), NUM_DS2438);
+  for (int i = 0; i < NUM_DS2438; i++) {
+    sim_dev_t *d = bus->devs[i];
+    CHECK_EQ(readings[i].status, ONE_WIRE_NO_ERROR);
+    CHECK(readings[i].value[0] == (float)(10 + i));
+    CHECK_EQ(lround(readings[i].value[1] * 100), 300 + 5 * i);
+    CHECK_EQ(d->conversions, 2);
+    CHECK_EQ(d->early_reads, 0);
+    CHECK_EQ(d->resumes, 0);
+  }
+  // both conversions get their full time once the command is on the wire
+  CHECK_EQ(bus->idles_over_mark, 2);
+  // two conversions and two transactions a device, a recall and a read of 9 bytes
+  uint32_t wire_us = bus->busy_ps / SIM_PS_PER_US;
+  CHECK(sweep_us >= (DS2438_CONVERT_T_MS + DS2438_CONVERT_V_MS) * 1000);
+  CHECK(sweep_us < wire_us + 1000);
+  printf("DS2438 sweep of %d devices: %.1fms, %.1fms a device after the conversions\n",
+         NUM_DS2438, sweep_us / 1000.0,
+         (sweep_us - (DS2438_CONVERT_T_MS + DS2438_CONVERT_V_MS) * 1000) / 1000.0 / NUM_DS2438);
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  for (int i = 0; i < NUM_DS2438; i++) sim_dev_free(bus->devs[i]);
+  sim_bus_free(bus);
+}
+
+#define NUM_DS2450 16
+
+static void test_ds2450_sweep(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t roms[NUM_DS2450];
+  for (int i = 0; i < NUM_DS2450; i++) {
+    roms[i] = sim_random_rom(0x20);
+    sim_dev_t *d = sim_ds2450_new(roms[i]);
+    for (int c = 0; c < 4; c++) d->adc[c] = sim_rand();
+    sim_bus_add(bus, d);
+  }
+  bus->idle_mark_ps = (DS2450_CONVERT_MS - 1) * 1000 * SIM_PS_PER_US;
+  oneWire_reading_t readings[NUM_DS2450];
+  double start = sim_us();
+  CHECK_EQ(oneWire_ds2450_sweep(roms, NUM_DS2450, readings, 5.12f), NUM_DS2450);
+  double took = sim_us() - start;
+  for (int i = 0; i < NUM_DS2450; i++) {
+    sim_dev_t *d = bus->devs[i];
+    CHECK_EQ(readings[i].status, ONE_WIRE_NO_ERROR);
+    CHECK_EQ(readings[i].num_values, 4);
+    for (int c = 0; c < 4; c++) {
+      CHECK(readings[i].value[c] == (float)((float)d->adc[c] * 5.12f / 65536.0));
+    }
+    CHECK_EQ(d->conversions, 1);
+    CHECK_EQ(d->early_reads, 0);
+  }
+  // one conversion time for the whole bus
+  CHECK_EQ(bus->idles_over_mark, 1);
+  printf("DS2450 sweep of %d devices: %.1fms, %.0f channels/s\n", NUM_DS2450, took / 1000,
+         4 * NUM_DS2450 / (took / 1e6));
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  for (int i = 0; i < NUM_DS2450; i++) sim_dev_free(bus->devs[i]);
+  sim_bus_free(bus);
+}
+
+static void test_ds28e17(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t rom = sim_random_rom(0x19);
+  sim_dev_t *d = sim_ds28e17_new(rom, 0x50);
+  sim_bus_add(bus, d);
+
+  // a write to registers 4 to 6, a write read of 4 and 5 and a read that goes on 
+  // from the register pointer, the first matches the bridge and the rest resume it
+  static const uint8_t regs[4] = {0x04, 0xDE, 0xAD, 0xBE};
+  static const uint8_t reg = 0x04;
+  uint8_t rd[2] = {0};
+  uint8_t more[2] = {0xFF, 0xFF};
+  oneWire_i2c_xfer_t x[3] = {
+    {.addr = 0x50, .wdata = regs, .wlen = 4},
+    {.addr = 0x50, .wdata = &reg, .wlen = 1, .rdata = rd, .rlen = 2},
+    {.addr = 0x50, .rdata = more, .rlen = 2},
+  };
+  CHECK_EQ(oneWire_ds28e17_run(rom, x, 3), 3);
+  for (int i = 0; i < 3; i++) {
+    CHECK(x[i].status == ONE_WIRE_NO_ERROR);
+    CHECK_EQ(x[i].i2c_status, 0);
+    CHECK_EQ(x[i].write_status, 0);
+  }
+  CHECK_EQ(d->mem[4], 0xDE);
+  CHECK_EQ(d->mem[5], 0xAD);
+  CHECK_EQ(d->mem[6], 0xBE);
+  CHECK(memcmp(rd, &regs[1], 2) == 0);
+  CHECK_EQ(more[0], 0xBE);   // read on from register 6
+  CHECK_EQ(more[1], 0x00);
+  CHECK_EQ(d->selects, 1);
+  CHECK_EQ(d->resumes, 2);
+  CHECK_EQ(d->crc_errors, 0);
+
+  // the second command reaches the bridge with a bit flipped, its CRC16 fails and
+  // nothing goes out on I2C.  The one after it matches the bridge again.
+  static const uint8_t zap[2] = {0x04, 0x00};
+  oneWire_i2c_xfer_t y[3] = {
+    {.addr = 0x50, .wdata = &reg, .wlen = 1, .rdata = rd, .rlen = 1},
+    {.addr = 0x50, .wdata = zap, .wlen = 2},
+    {.addr = 0x50, .wdata = &reg, .wlen = 1, .rdata = rd, .rlen = 1},
+  };
+  CHECK_EQ(oneWire_ds28e17_run(rom, y, 1), 1);
+  d->corrupt_cmds = 1;
+  CHECK_EQ(oneWire_ds28e17_run(rom, &y[1], 2), 1);
+  CHECK(y[1].status == (oneWire_status)ONE_WIRE_I2C_FAILURE);
+  CHECK_EQ(y[1].i2c_status, 0x01);
+  CHECK_EQ(y[1].write_status, 0);
+  CHECK(y[2].status == ONE_WIRE_NO_ERROR);
+  CHECK_EQ(d->crc_errors, 1);
+  CHECK_EQ(d->mem[4], 0xDE);
+  CHECK_EQ(rd[0], 0xDE);
+  CHECK_EQ(d->selects, 4);
+
+  // nobody at the address, then a write that runs off the end of the registers
+  static const uint8_t past[4] = {0x1F, 0x01, 0x02, 0x03};
+  oneWire_i2c_xfer_t z[2] = {
+    {.addr = 0x51, .wdata = regs, .wlen = 4},
+    {.addr = 0x50, .wdata = past, .wlen = 4},
+  };
+  CHECK_EQ(oneWire_ds28e17_run(rom, z, 2), 0);
+  CHECK(z[0].status == (oneWire_status)ONE_WIRE_I2C_FAILURE);
+  CHECK_EQ(z[0].i2c_status, 0x02);
+  CHECK(z[1].status == (oneWire_status)ONE_WIRE_I2C_FAILURE);
+  CHECK_EQ(z[1].i2c_status, 0);
+  CHECK_EQ(z[1].write_status, 3);
+  CHECK_EQ(d->mem[0x1F], 0x01);
+  CHECK_EQ(d->crc_errors, 1);
+
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  sim_dev_free(d);
+  sim_bus_free(bus);
+}
+
+// a DS2413 read as a DS2409 network transaction
+typedef struct branch_poll {
+  oneWire_ds2413_t dev;
+  uint8_t pio;
+  int reads;
+} branch_poll_t;
+
+static oneWire_status branch_poll(void *arg) {
+  branch_poll_t *p = arg;
+  uint8_t state;
+  oneWire_status stat = oneWire_ds2413_poll(&p->dev, &state);
+  if (stat == ONE_WIRE_NO_ERROR && state != p->pio) stat = ONE_WIRE_READ_CRC_FAILURE;
+  if (stat == ONE_WIRE_NO_ERROR) p->reads++;
+  return stat;
+}
+
+static void test_ds2409_branches(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  sim_dev_t *c[2];
+  uint64_t couplers[2];
+  for (int i = 0; i < 2; i++) {
+    couplers[i] = sim_random_rom(0x1F);
+    c[i] = sim_ds2409_new(couplers[i]);
+    sim_bus_add(bus, c[i]);
+  }
+  // a DS2413 on the trunk, one on each branch of coupler 0 and one on main of 
+  // coupler 1
+  static const int where[4][2] = {
+    {-1, 0}, {0, DS2409_BRANCH_MAIN}, {0, DS2409_BRANCH_AUX}, {1, DS2409_BRANCH_MAIN}
+  };
+  sim_dev_t *d[4];
+  branch_poll_t p[4];
+  for (int i = 0; i < 4; i++) {
+    d[i] = sim_ds2413_new(sim_random_rom(0x3A), 1 << i);
+    if (where[i][0] >= 0) {
+      d[i]->coupler = c[where[i][0]];
+      d[i]->branch = where[i][1];
+    }
+    sim_bus_add(bus, d[i]);
+    p[i] = (branch_poll_t){ .dev = { .rom = d[i]->rom }, .pio = 1 << i };
+  }
+  oneWire_ds2409_net_t net;
+  CHECK(oneWire_ds2409_init(&net, couplers, 2) == ONE_WIRE_NO_ERROR);
+  CHECK_EQ(net.switches, 2);
+
+  // with a branch of coupler 0 on the trunk device and the device on that branch
+  // answer and the devices on the branches that are off do not
+  uint8_t state;
+  for (int b = DS2409_BRANCH_MAIN; b <= DS2409_BRANCH_AUX; b++) {
+    CHECK(oneWire_ds2409_select(&net, 0, b) == ONE_WIRE_NO_ERROR);
+    CHECK_EQ(c[0]->es, b);
+    for (int i = 0; i < 4; i++) {
+      bool on = where[i][0] < 0 || (where[i][0] == 0 && where[i][1] == b);
+      CHECK_EQ(oneWire_ds2413_poll(&p[i].dev, &state) == ONE_WIRE_NO_ERROR, on);
+      if (on) CHECK_EQ(state, p[i].pio);
+    }
+  }
+  CHECK_EQ(net.switches, 4);
+
+  // out of order, the run goes trunk, the branch on now (coupler 0 aux), coupler 0
+  // main and then coupler 1 main, switching each branch once
+  oneWire_ds2409_op_t ops[5] = {
+    {.coupler = 1, .branch = DS2409_BRANCH_MAIN, .run = branch_poll, .arg = &p[3]},
+    {.coupler = 0, .branch = DS2409_BRANCH_MAIN, .run = branch_poll, .arg = &p[1]},
+    {.coupler = -1, .run = branch_poll, .arg = &p[0]},
+    {.coupler = 0, .branch = DS2409_BRANCH_AUX, .run = branch_poll, .arg = &p[2]},
+    {.coupler = 0, .branch = DS2409_BRANCH_MAIN, .run = branch_poll, .arg = &p[1]},
+  };
+  CHECK_EQ(oneWire_ds2409_run(&net, ops, 5), 5);
+  static const int order[5] = {0, 2, 1, 1, 3};
+  for (int i = 0; i < 5; i++) {
+    CHECK(ops[i].status == ONE_WIRE_NO_ERROR);
+    CHECK(ops[i].arg == &p[order[i]]);
+  }
+  // coupler 0 aux to main, then coupler 0 off and coupler 1 main
+  CHECK_EQ(net.switches, 7);
+  CHECK_EQ(p[0].reads + p[1].reads + p[2].reads + p[3].reads, 5);
+  CHECK_EQ(c[0]->es, 0);
+  CHECK_EQ(c[1]->es, DS2409_BRANCH_MAIN);
+  // a device on a branch that is off can't be seen
+  CHECK(oneWire_ds2413_poll(&p[1].dev, &state) == (oneWire_status)ONE_WIRE_READ_CRC_FAILURE);
+
+  // coupler 0 gets a smart on main it does not know and sends no confirmation.  It is
+  // marked unknown, the transaction behind it is not run and the next select sends
+  // smart on main again.
+  c[0]->corrupt_cmds = 1;
+  oneWire_ds2409_op_t op = {
+    .coupler = 0, .branch = DS2409_BRANCH_MAIN, .run = branch_poll, .arg = &p[1]
+  };
+  CHECK_EQ(oneWire_ds2409_run(&net, &op, 1), 0);
+  CHECK(op.status == (oneWire_status)ONE_WIRE_COUPLER_FAILURE);
+  CHECK_EQ(p[1].reads, 2);
+  CHECK_EQ(net.branch[0], DS2409_BRANCH_UNKNOWN);
+  CHECK_EQ(net.branch[1], DS2409_BRANCH_OFF);
+  CHECK_EQ(c[1]->es, 0);
+  CHECK(oneWire_ds2409_select(&net, 0, DS2409_BRANCH_MAIN) == ONE_WIRE_NO_ERROR);
+  CHECK_EQ(net.branch[0], DS2409_BRANCH_MAIN);
+  CHECK_EQ(c[0]->es, DS2409_BRANCH_MAIN);
+  CHECK(branch_poll(&p[1]) == ONE_WIRE_NO_ERROR);
+  CHECK_EQ(net.switches, 10);
+
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  for (int i = 0; i < bus->num_devs; i++) sim_dev_free(bus->devs[i]);
+  sim_bus_free(bus);
+}
+
+static void test_ds2408_stream(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t rom = sim_random_rom(0x29);
+  sim_dev_t *d = sim_ds2408_new(rom, 0x10);
+  sim_bus_add(bus, d);
+  oneWire_ds2408_stream_t s;
+  uint8_t ring[40];
+  uint8_t sample;
+  CHECK(oneWire_ds2408_stream_start(&s, rom, ring, 1) ==
+        (oneWire_status)ONE_WIRE_ILLEGAL_DATA_SIZE_REQ);
+  CHECK_EQ(sim_lock_depth(), 0);
+
+  // drained after every poll the ring wraps four times.  The first block only checks
+  // out with the CRC seeded with the 0xF5 command and the rest only without it.
+  CHECK(oneWire_ds2408_stream_start(&s, rom, ring, 40) == ONE_WIRE_NO_ERROR);
+  CHECK_EQ(sim_lock_depth(), 1);
+  uint8_t next = 0x10;
+  int got = 0, bad = 0;
+  while (got < 160) {
+    oneWire_ds2408_stream_poll(&s);
+    while (oneWire_ds2408_stream_get(&s, &sample)) {
+      if (sample != next++) bad++;
+      got++;
+    }
+    sleep_us(500);
+  }
+  oneWire_ds2408_stream_stop(&s);
+  CHECK_EQ(sim_lock_depth(), 0);
+  CHECK_EQ(bad, 0);
+  CHECK_EQ(got, 160);
+  CHECK_EQ(s.blocks, 5);
+  CHECK_EQ(s.crc_errors, 0);
+  CHECK_EQ(s.overruns, 0);
+  CHECK_EQ(s.head, 160 % 40);
+  CHECK_EQ(d->selects, 1);
+
+  // the first block of the next stream is hit on the wire and thrown away, then two
+  // good blocks without draining fill the ring and the rest of the second is lost
+  uint8_t first = d->pio;
+  d->corrupt_pages = 1;
+  CHECK(oneWire_ds2408_stream_start(&s, rom, ring, 40) == ONE_WIRE_NO_ERROR);
+  while (s.blocks < 2) {
+    oneWire_ds2408_stream_poll(&s);
+    sleep_us(500);
+  }
+  oneWire_ds2408_stream_stop(&s);
+  CHECK_EQ(s.crc_errors, 1);
+  CHECK_EQ(s.overruns, 32 + 32 - 39);
+  next = first + 32;
+  got = bad = 0;
+  while (oneWire_ds2408_stream_get(&s, &sample)) {
+    if (sample != next++) bad++;
+    got++;
+  }
+  CHECK_EQ(bad, 0);
+  CHECK_EQ(got, 39);
+
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  sim_dev_free(d);
+  sim_bus_free(bus);
+}
+
+#define NUM_DS28EA00 6
+
+static void test_ds28ea00_chain(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  sim_dev_t *d[NUM_DS28EA00];
+  for (int i = 0; i < NUM_DS28EA00; i++) {
+    d[i] = sim_ds28ea00_new(sim_random_rom(0x42));
+    sim_bus_add(bus, d[i]);
+    // a device that is not in the chain in the middle of it
+    if (i == 2) sim_bus_add(bus, sim_ds18b20_new(sim_random_rom(0x28), 20));
+  }
+  // one conditional read rom a device, in the order they are wired, not rom order
+  uint64_t found[NUM_DS28EA00 + 2];
+  CHECK_EQ(oneWire_ds28ea00_chain(found, NUM_DS28EA00 + 2), NUM_DS28EA00);
+  for (int i = 0; i < NUM_DS28EA00; i++) {
+    CHECK(found[i] == d[i]->rom);
+    CHECK_EQ(d[i]->selects, 1);
+    CHECK_EQ(d[i]->resumes, 1);
+    CHECK_EQ(d[i]->es, 0);   // chain off at the end
+  }
+  CHECK_EQ(bus->devs[3]->selects, 0);
+
+  // max_devs ends the walk early and still turns chain mode off
+  CHECK_EQ(oneWire_ds28ea00_chain(found, 2), 2);
+  CHECK(found[0] == d[0]->rom && found[1] == d[1]->rom);
+  for (int i = 0; i < NUM_DS28EA00; i++) CHECK_EQ(d[i]->es, 0);
+  CHECK_EQ(d[2]->selects, 1);
+
+  // every device gets a chain on it does not know so nobody sends the 0xAA
+  for (int i = 0; i < NUM_DS28EA00; i++) d[i]->corrupt_cmds = 1;
+  CHECK_EQ(oneWire_ds28ea00_chain(found, NUM_DS28EA00), ONE_WIRE_SEARCH_ROM_FAILURE);
+  for (int i = 0; i < NUM_DS28EA00; i++) CHECK_EQ(d[i]->es, 0);
+
+  // a device missed chain on, the walk stops in front of it
+  d[3]->corrupt_cmds = 1;
+  CHECK_EQ(oneWire_ds28ea00_chain(found, NUM_DS28EA00), 3);
+
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  for (int i = 0; i < bus->num_devs; i++) sim_dev_free(bus->devs[i]);
+  sim_bus_free(bus);
+}
+
+int main() {
+  sim_reset();
+  sim_srand(62);
+  test_ds2413_resume();
+  test_ds2438_sweep();
+  test_ds2450_sweep();
+  test_ds28e17();
+  test_ds2409_branches();
+  test_ds2408_stream();
+  test_ds28ea00_chain();
+  return test_done("io");
+}
@@ -0,0 +1,187 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Programs simulated DS2431 and DS28EC20 EEPROMs with oneWire_mem_write_all().  The
+// devices are deaf to the bus for tPROG after a copy, so a verify read that comes
+// too early fails and shows up as a retry.  Steps a write with a DS2413 polled in 
+// the tPROG windows.  Then reads both through the page cache with a bit flipped on 
+// the wire now and then.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireDrivers.h"
+#include "OneWireMemory.h"
+#include "OneWireIO.h"
+#include "test.h"
+
+#define NUM_DS2431 3
+
+static void test_write_all(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  oneWire_mem_write_t jobs[NUM_DS2431 + 1];
+  static uint8_t data[NUM_DS2431 + 1][64];
+  for (int i = 0; i <= NUM_DS2431; i++) {
+    bool big = i == NUM_DS2431;
+    uint64_t rom = sim_random_rom(big ? 0x43 : 0x2D);
+    sim_bus_add(bus, sim_eeprom_new(rom));
+    for (int j = 0; j < 64; j++) data[i][j] = sim_rand();
+    jobs[i] = (oneWire_mem_write_t){ .rom = rom, .address = big ? 0x40 : 0x20,
+                                     .data = data[i], .len = big ? 64 : 32 };
+  }
+  init_OneWire();
+
+  oneWire_mem_stats_t stats;
+  CHECK_EQ(oneWire_mem_write_all(jobs, NUM_DS2431 + 1, &stats), NUM_DS2431 + 1);
+  CHECK_EQ(stats.retries, 0);
+  CHECK_EQ(stats.bytes, NUM_DS2431 * 32 + 64);
+  for (int i = 0; i <= NUM_DS2431; i++) {
+    sim_dev_t *d = bus->devs[i];
+    CHECK_EQ(jobs[i].status, ONE_WIRE_NO_ERROR);
+    CHECK(memcmp(&d->mem[jobs[i].address], data[i], jobs[i].len) == 0);
+    CHECK_EQ(d->copies, i == NUM_DS2431 ? 2 : 4);
+    // the bytes either side are untouched
+    CHECK_EQ(d->mem[jobs[i].address - 1], 0xFF);
+    CHECK_EQ(d->mem[jobs[i].address + jobs[i].len], 0xFF);
+  }
+  printf("EEPROM write of %u bytes to %d devices: %.0fms, %u bytes/s\n", stats.bytes,
+         NUM_DS2431 + 1, stats.time_us / 1000.0, stats.bytes_per_s);
+
+  // on its own the verify read follows the copy as soon as tPROG is up, so tPROG
+  // has to be counted from when the copy went out on the wire
+  uint8_t row[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  oneWire_mem_write_t one = { .rom = jobs[0].rom, .address = 0x60, .data = row, .len = 8 };
+  CHECK_EQ(oneWire_mem_write_all(&one, 1, &stats), 1);
+  CHECK_EQ(stats.retries, 0);
+  CHECK(memcmp(&bus->devs[0]->mem[0x60], row, 8) == 0);
+
+  // a job that does not line up with the rows is refused
+  oneWire_mem_write_t bad = { .rom = jobs[0].rom, .address = 3, .data = data[0], .len = 8 };
+  CHECK_EQ(oneWire_mem_write_all(&bad, 1, NULL), 0);
+  CHECK(bad.status == (oneWire_status)ONE_WIRE_MEM_NOT_SUPPORTED);
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  for (int i = 0; i <= NUM_DS2431; i++) sim_dev_free(bus->devs[i]);
+  sim_bus_free(bus);
+}
+
+// a DS2413 is polled between steps while a DS2431 programs.  The polls fit in the
+// tPROG windows so the write takes no longer than oneWire_mem_write_all() does.
+static void test_write_steps(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  sim_dev_t *ee = sim_eeprom_new(sim_random_rom(0x2D));
+  sim_dev_t *sw = sim_ds2413_new(sim_random_rom(0x3A), 0x5);
+  sim_bus_add(bus, ee);
+  sim_bus_add(bus, sw);
+  uint8_t data[32];
+  for (int j = 0; j < 32; j++) data[j] = sim_rand();
+  oneWire_mem_write_t job = { .rom = ee->rom, .data = data, .len = 32 };
+
+  oneWire_mem_stats_t alone;
+  CHECK_EQ(oneWire_mem_write_all(&job, 1, &alone), 1);
+
+  job.address = 0x20;
+  oneWire_ds2413_t ds = { .rom = sw->rom };
+  int polls = 0;
+  int64_t poll_us = 7000;   // a match rom and PIO read, measured as it goes
+  absolute_time_t next;
+  oneWire_mem_write_start(&job, 1);
+  while (!oneWire_mem_write_step(&job, 1, &next)) {
+    while (absolute_time_diff_us(get_absolute_time(), next) > poll_us) {
+      uint8_t state;
+      uint64_t start = time_us_64();
+      CHECK_EQ(oneWire_ds2413_poll(&ds, &state), ONE_WIRE_NO_ERROR);
+      CHECK_EQ(state, 0x5);
+      int64_t took = time_us_64() - start;
+      if (took > poll_us) poll_us = took;
+      polls++;
+    }
+    sleep_until(next);
+  }
+  oneWire_mem_stats_t stats;
+  CHECK_EQ(oneWire_mem_write_result(&job, 1, &stats), 1);
+  CHECK_EQ(stats.retries, 0);
+  CHECK_EQ(stats.bytes, 32);
+  // one poll in each of the 4 copies
+  CHECK_EQ(polls, 4);
+  CHECK(stats.time_us <= alone.time_us + 1000);
+  CHECK_EQ(job.status, ONE_WIRE_NO_ERROR);
+  CHECK(memcmp(&ee->mem[0x20], data, 32) == 0);
+  CHECK_EQ(ee->copies, 8);
+  printf("EEPROM write of 32 bytes with %d DS2413 polls in tPROG: %.0fms, %.0fms alone\n",
+         polls, stats.time_us / 1000.0, alone.time_us / 1000.0);
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  sim_dev_free(ee);
+  sim_dev_free(sw);
+  sim_bus_free(bus);
+}
+
+// a DS2431 page has no CRC so it is read twice, a DS28EC20 page comes with a CRC16.
+// Either way a page that went wrong on the wire is not cached.
+static void test_read_cache(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  sim_dev_t *small = sim_eeprom_new(sim_random_rom(0x2D));
+  sim_dev_t *big = sim_eeprom_new(sim_random_rom(0x43));
+  sim_bus_add(bus, small);
+  sim_bus_add(bus, big);
+  for (int i = 0; i < small->mem_size; i++) small->mem[i] = sim_rand();
+  for (int i = 0; i < big->mem_size; i++) big->mem[i] = sim_rand();
+  oneWire_mem_cache_invalidate(0, 0, 0);
+
+  uint8_t buf[64];
+  oneWire_mem_cache_stats_t st;
+  oneWire_mem_get_cache_stats(&st, true);
+  for (int pass = 0; pass < 2; pass++) {
+    CHECK_EQ(oneWire_mem_read_cached(small->rom, 0, buf, 64), ONE_WIRE_NO_ERROR);
+    CHECK(memcmp(buf, small->mem, 64) == 0);
+    CHECK_EQ(oneWire_mem_read_cached(big->rom, 0x100, buf, 64), ONE_WIRE_NO_ERROR);
+    CHECK(memcmp(buf, &big->mem[0x100], 64) == 0);
+  }
+  oneWire_mem_get_cache_stats(&st, true);
+  CHECK_EQ(st.misses, 4);
+  CHECK_EQ(st.hits, 4);
+  CHECK_EQ(st.crc_rejects + st.mismatches, 0);
+
+  // the two reads of a DS2431 page differ, nothing is cached and the next read is good
+  oneWire_mem_cache_invalidate(small->rom, 0, 32);
+  small->corrupt_pages = 1;
+  CHECK(oneWire_mem_read_cached(small->rom, 0, buf, 32) == 
+        (oneWire_status)ONE_WIRE_MEM_READ_MISMATCH);
+  CHECK_EQ(oneWire_mem_read_cached(small->rom, 0, buf, 32), ONE_WIRE_NO_ERROR);
+  CHECK(memcmp(buf, small->mem, 32) == 0);
+  oneWire_mem_get_cache_stats(&st, true);
+  CHECK_EQ(st.mismatches, 1);
+  CHECK_EQ(st.crc_rejects, 0);
+  CHECK_EQ(st.misses, 2);
+
+  // a DS28EC20 page fails its CRC16
+  oneWire_mem_cache_invalidate(big->rom, 0x100, 32);
+  big->corrupt_pages = 1;
+  CHECK(oneWire_mem_read_cached(big->rom, 0x100, buf, 32) == 
+        (oneWire_status)ONE_WIRE_READ_CRC_FAILURE);
+  CHECK_EQ(oneWire_mem_read_cached(big->rom, 0x100, buf, 32), ONE_WIRE_NO_ERROR);
+  CHECK(memcmp(buf, &big->mem[0x100], 32) == 0);
+  oneWire_mem_get_cache_stats(&st, true);
+  CHECK_EQ(st.crc_rejects, 1);
+  CHECK_EQ(st.mismatches, 0);
+  printf("page cache: %uus of bus a miss\n", st.miss_us / st.misses);
+
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  sim_dev_free(small);
+  sim_dev_free(big);
+  sim_bus_free(bus);
+}
+
+int main() {
+  sim_reset();
+  sim_srand(59);
+  test_write_all();
+  test_write_steps();
+  test_read_cache();
+  return test_done("memory");
+}
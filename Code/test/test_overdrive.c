@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Runs each command of the OneWire_overdrive program on its own and holds the
+// pulses to the overdrive data sheet timing.  Then reads the 8KB log of a simulated
+// DS1922 at standard speed and in overdrive, with and without a read password, and
+// prints the throughput of both.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireMemory.h"
+#include "test.h"
+
+// one command through the overdrive program, one low pulse expected
+static void od_pulse(uint32_t cmd, double min_us, double max_us, sim_pio_pulses_t *p) {
+  CHECK(sim_pio_pulses("OneWire_overdrive", ONE_WIRE_OVERDRIVE_HZ, cmd, p));
+  CHECK_EQ(p->num, 1);
+  CHECK(p->low_us[0] >= min_us && p->low_us[0] <= max_us);
+}
+
+static void test_timing(void) {
+  sim_pio_pulses_t w1, w0, rd, rst;
+  od_pulse((1 << 6) + 3, 1, 2, &w1);        // write 1, tW1L
+  od_pulse(3, 7.5, 16, &w0);                // write 0, tW0L
+  od_pulse(1, 1, 2, &rd);                   // read, tRL
+  // tMSR: sampled after the release and no later than 2us
+  CHECK(rd.sample_us[0] > rd.low_us[0] && rd.sample_us[0] <= 2);
+  od_pulse(2, 70, 80, &rst);                // reset, tRSTL
+  printf("overdrive: write 1 %.2fus, write 0 %.2fus, read sampled at %.2fus, reset %.2fus\n",
+         w1.low_us[0], w0.low_us[0], rd.sample_us[0], rst.low_us[0]);
+}
+
+static void test_logger(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t rom = sim_random_rom(0x41);
+  sim_dev_t *logger = sim_logger_new(rom);
+  sim_bus_add(bus, logger);
+  // a standard speed device has to sit through the overdrive traffic
+  sim_bus_add(bus, sim_ds18b20_new(sim_random_rom(0x28), 21));
+  for (int i = 0; i < ONE_WIRE_LOGGER_LOG_SIZE; i++) {
+    logger->mem[ONE_WIRE_LOGGER_LOG_ADDRESS + i] = sim_rand();
+  }
+  init_OneWire();
+
+  static uint8_t buf[ONE_WIRE_LOGGER_LOG_SIZE];
+  oneWire_mem_stats_t std, od;
+  CHECK_EQ(oneWire_logger_read_log(rom, buf, sizeof(buf), NULL, false, &std), ONE_WIRE_NO_ERROR);
+  CHECK(memcmp(buf, &logger->mem[ONE_WIRE_LOGGER_LOG_ADDRESS], sizeof(buf)) == 0);
+  CHECK_EQ(std.retries, 0);
+  memset(buf, 0, sizeof(buf));
+  CHECK_EQ(oneWire_logger_read_log(rom, buf, sizeof(buf), NULL, true, &od), ONE_WIRE_NO_ERROR);
+  CHECK(memcmp(buf, &logger->mem[ONE_WIRE_LOGGER_LOG_ADDRESS], sizeof(buf)) == 0);
+  CHECK_EQ(od.retries, 0);
+  CHECK_EQ(od.bytes, ONE_WIRE_LOGGER_LOG_SIZE);
+  CHECK(od.bytes_per_s > 4 * std.bytes_per_s);
+  printf("8KB log: standard %.0fms %u bytes/s, overdrive %.0fms %u bytes/s\n",
+         std.time_us / 1000.0, std.bytes_per_s, od.time_us / 1000.0, od.bytes_per_s);
+
+  // with a read password
+  const uint8_t password[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  const uint8_t wrong[8] = { 1, 2, 3, 4, 5, 6, 7, 9 };
+  logger->password_on = true;
+  memcpy(logger->password, password, 8);
+  CHECK_EQ(oneWire_logger_read_log(rom, buf, 64, password, true, &od), ONE_WIRE_NO_ERROR);
+  CHECK(memcmp(buf, &logger->mem[ONE_WIRE_LOGGER_LOG_ADDRESS], 64) == 0);
+  CHECK(oneWire_logger_read_log(rom, buf, 64, wrong, true, &od) ==
+        (oneWire_status)ONE_WIRE_READ_CRC_FAILURE);
+  CHECK_EQ(od.retries, ONE_WIRE_EEPROM_RETRIES + 1);
+  // the failed read leaves the bus at standard speed
+  CHECK_EQ(oneWire_logger_read_log(rom, buf, 64, password, false, &std), ONE_WIRE_NO_ERROR);
+
+  // so does a recovery in overdrive
+  oneWire_set_overdrive(true);
+  oneWire_recover(NULL);
+  CHECK_EQ(oneWire_logger_read_log(rom, buf, 64, password, false, &std), ONE_WIRE_NO_ERROR);
+  CHECK_EQ(std.retries, 0);
+
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(bus->violations[1], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+}
+
+int main() {
+  sim_reset();
+  sim_srand(60);
+  test_timing();
+  test_logger();
+  return test_done("overdrive");
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Push latency benchmark.  Runs a scratchpad read with a warm XIP cache and then
+// with the cache flushed before every transaction, and reports the longest gap
+// between Tx FIFO pushes from oneWire_get_max_push_gap().  Built twice, as
+// test_push with the hot path in flash and test_push_ram with
+// ONE_WIRE_RAM_HOT_PATH.  Only SDK calls made from flash pay the miss in the sim,
+// so the numbers are a lower bound of what a cold cache costs on the chip.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireDrivers.h"
+#include "test.h"
+
+#define RUNS 50
+// eight XIP cache line fills of about 24 cycles at 125MHz
+#define XIP_MISS_NS 1500
+
+#ifdef ONE_WIRE_RAM_HOT_PATH
+#define BUILD "RAM"
+#else
+#define BUILD "flash"
+#endif
+
+// the worst push gap over RUNS scratchpad reads, flushing the cache first if cold
+static uint32_t worst_gap(uint64_t rom, bool cold, double *avg_us) {
+  uint8_t cmd[10];
+  int len = oneWire_match_rom_cmd(rom, cmd);
+  cmd[len++] = 0xBE;
+  uint8_t data[9];
+  uint32_t worst = 0;
+  double total = 0;
+  for (int i = 0; i < RUNS; i++) {
+    if (cold) sim_xip_flush();
+    oneWire_get_max_push_gap(true);
+    double start = sim_us();
+    CHECK_EQ(oneWire_transaction(true, cmd, len, data, 9, ONE_WIRE_CRC8), ONE_WIRE_NO_ERROR);
+    total += sim_us() - start;
+    uint32_t gap = oneWire_get_max_push_gap(true);
+    if (gap > worst) worst = gap;
+  }
+  *avg_us = total / RUNS;
+  return worst;
+}
+
+int main() {
+  sim_reset();
+  sim_set_xip_miss_ns(XIP_MISS_NS);
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t rom = sim_random_rom(0x28);
+  sim_bus_add(bus, sim_ds18b20_new(rom, 21.5));
+  init_OneWire();
+
+  double warm_us, cold_us;
+  worst_gap(rom, false, &warm_us);    // fill the cache
+  uint32_t warm = worst_gap(rom, false, &warm_us);
+  uint32_t cold = worst_gap(rom, true, &cold_us);
+  printf("push gap, hot path in %s: warm %uus (%.0fus a read), cold %uus (%.0fus a read)\n",
+         BUILD, warm, warm_us, cold, cold_us);
+
+#ifdef ONE_WIRE_RAM_HOT_PATH
+  // nothing between the pushes runs from flash so a cold cache changes nothing
+  CHECK(cold <= warm + 1);
+#else
+  // the misses cost time on every read.  Whether one lands between two pushes and
+  // shows in the gap depends on where the linker put the code, so only the read time
+  // has to grow.
+  CHECK(cold >= warm);
+  CHECK(cold_us > warm_us);
+#endif
+  CHECK_EQ(bus->violations[0], 0);
+  CHECK_EQ(sim_lock_depth(), 0);
+  return test_done("push " BUILD);
+}
@@ -0,0 +1,217 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Checks the search rom branch logic in OneWireSearch.c against a model of the
+// wired AND, including roms that share long prefixes and devices that leave the
+// bus mid search.  Then runs oneWire_search_rom_fast() over 500 random roms on the
+// simulated bus and reports the slots and time per device, and checks the
+// max_devs bound, a bus that empties mid search and the multi bus search.
+
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "OneWireSearch.h"
+#include "test.h"
+
+#define BENCH_DEVS 500
+#define SLOTS_PER_PASS (8 + 64 * 3)
+
+static int cmp_rom(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// the search rom order, lowest bit first with 0 before 1
+static int cmp_search_order(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  for (int bit = 0; bit < 64; bit++) {
+    int xb = (x >> bit) & 1, yb = (y >> bit) & 1;
+    if (xb != yb) return xb - yb;
+  }
+  return 0;
+}
+
+// runs a whole search against roms[] with the wired AND done here.  gone is removed
+// from the bus after pass leave_after.
+// returns the number found, or -1 if the branch logic reported a failure.
+static int model_search(const uint64_t roms[], int num, uint64_t found[], int max,
+                        oneWire_search_t *s, int gone, int leave_after) {
+  bool left[BENCH_DEVS] = { false };
+  int n = 0;
+  oneWire_search_init(s);
+  do {
+    if (s->passes == (uint32_t)leave_after && gone >= 0) left[gone] = true;
+    oneWire_search_start_pass(s);
+    bool in[BENCH_DEVS];
+    for (int i = 0; i < num; i++) in[i] = !left[i];
+    for (int bit = 0; bit < 64; bit++) {
+      bool id = true, cmp = true;
+      for (int i = 0; i < num; i++) {
+        if (!in[i]) continue;
+        if ((roms[i] >> bit) & 1) cmp = false;
+        else id = false;
+      }
+      int dir = oneWire_search_branch(s, id, cmp);
+      if (dir < 0) return -1;
+      for (int i = 0; i < num; i++) {
+        if (in[i] && (int)((roms[i] >> bit) & 1) != dir) in[i] = false;
+      }
+    }
+    found[n++] = s->rom;
+  } while (oneWire_search_end_pass(s) && n < max);
+  return n;
+}
+
+static void check_model(uint64_t roms[], int num) {
+  uint64_t found[BENCH_DEVS];
+  oneWire_search_t s;
+  CHECK_EQ(model_search(roms, num, found, BENCH_DEVS, &s, -1, 0), num);
+  qsort(roms, num, sizeof(uint64_t), cmp_search_order);
+  CHECK(memcmp(found, roms, num * sizeof(uint64_t)) == 0);
+  CHECK_EQ(s.passes, num);
+  CHECK_EQ(s.slots, num * SLOTS_PER_PASS);
+}
+
+static void test_branch_logic(void) {
+  uint64_t roms[BENCH_DEVS];
+  // random sets of every size up to 64
+  for (int num = 1; num <= 64; num++) {
+    for (int i = 0; i < num; i++) roms[i] = sim_random_rom(sim_rand() & 0xFF);
+    check_model(roms, num);
+  }
+  // roms that only differ in the last bits, all sharing a 56 bit prefix
+  for (int i = 0; i < 64; i++) roms[i] = 0x00ABCDEF01234528ULL | ((uint64_t)i << 58);
+  check_model(roms, 64);
+  // a discrepancy at every bit
+  for (int i = 0; i < 64; i++) roms[i] = (i == 63) ? 0 : 1ULL << i;
+  check_model(roms, 64);
+
+  uint64_t found[4];
+  oneWire_search_t s;
+  // the device the next pass was going after has gone
+  uint64_t pair[2] = { 0x0000000000000028ULL, 0x8000000000000028ULL };
+  CHECK_EQ(model_search(pair, 2, found, 4, &s, 1, 1), -1);
+  // a device found already leaves the shared prefix, the rest are still found
+  uint64_t three[3] = { 0x0000000000000028ULL, 0x8000000000000028ULL, 0x0000000000000128ULL };
+  CHECK_EQ(model_search(three, 3, found, 4, &s, 0, 1), 3);
+  CHECK_EQ(found[1], three[1]);
+  CHECK_EQ(found[2], three[2]);
+  // nobody on the bus
+  oneWire_search_init(&s);
+  oneWire_search_start_pass(&s);
+  CHECK_EQ(oneWire_search_branch(&s, true, true), -1);
+}
+
+static void test_benchmark(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  static uint64_t roms[BENCH_DEVS], found[BENCH_DEVS];
+  for (int i = 0; i < BENCH_DEVS; i++) {
+    roms[i] = sim_random_rom(0x28);
+    sim_bus_add(bus, sim_ds18b20_new(roms[i], 20));
+  }
+  oneWire_search_stats_t stats;
+  double start = sim_us();
+  uint64_t host_start = host_ns();
+  CHECK_EQ(oneWire_search_rom_fast(found, BENCH_DEVS, &stats), BENCH_DEVS);
+  double took = sim_us() - start;
+  double host_ms = (host_ns() - host_start) / 1e6;
+  qsort(roms, BENCH_DEVS, sizeof(uint64_t), cmp_rom);
+  qsort(found, BENCH_DEVS, sizeof(uint64_t), cmp_rom);
+  CHECK(memcmp(found, roms, sizeof(roms)) == 0);
+  CHECK_EQ(stats.passes, BENCH_DEVS);
+  CHECK_EQ(stats.slots, BENCH_DEVS * SLOTS_PER_PASS);
+  // the slots the bus saw are the ones counted
+  CHECK_EQ(bus->slots, stats.slots);
+  CHECK_EQ(bus->resets, stats.passes);
+  CHECK_EQ(bus->violations[0], 0);
+  printf("search of %d roms: %u passes, %u slots, %.1fms a device on the wire, %.0fms host\n",
+         BENCH_DEVS, stats.passes, stats.slots, took / 1000 / BENCH_DEVS, host_ms);
+
+  // max_devs stops the search and nothing is written past it
+  uint64_t three[4] = { 0, 0, 0, 0 };
+  CHECK_EQ(oneWire_search_rom_fast(three, 3, &stats), 3);
+  CHECK_EQ(three[3], 0);
+  CHECK_EQ(stats.passes, 3);
+  three[0] = 0;
+  CHECK_EQ(oneWire_search_rom_fast(three, 0, NULL), ONE_WIRE_ILLEGAL_DATA_SIZE_REQ);
+  CHECK_EQ(three[0], 0);
+  for (int i = 0; i < BENCH_DEVS; i++) sim_dev_free(bus->devs[i]);
+  sim_bus_free(bus);
+}
+
+// the devices go away after the first pass, the search fails rather than returning
+// the one rom it found as if that were all of them
+static void test_unplug(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  sim_dev_t *d[3];
+  for (int i = 0; i < 3; i++) {
+    d[i] = sim_ds18b20_new(sim_random_rom(0x28), 20);
+    sim_bus_add(bus, d[i]);
+  }
+  uint64_t found[3];
+  bus->unplug_at = bus->resets + 2;
+  CHECK_EQ(oneWire_search_rom_fast(found, 3, NULL), ONE_WIRE_SEARCH_ROM_FAILURE);
+  // nobody there from the start is not a failure
+  CHECK_EQ(oneWire_search_rom_fast(found, 3, NULL), 0);
+  for (int i = 0; i < 3; i++) sim_dev_free(d[i]);
+  sim_bus_free(bus);
+}
+
+static void test_multi(void) {
+  const uint pins[3] = { 2, 3, 4 };
+  const int num[3] = { 5, 0, 12 };
+  sim_bus_t *bus[3];
+  uint64_t roms[3][16], found[3][16];
+  uint64_t *devs[3] = { found[0], found[1], found[2] };
+  int total = 0;
+  for (int b = 0; b < 3; b++) {
+    bus[b] = sim_bus_new(pins[b]);
+    for (int i = 0; i < num[b]; i++) {
+      roms[b][i] = sim_random_rom(0x28);
+      sim_bus_add(bus[b], sim_ds18b20_new(roms[b][i], 20));
+    }
+    total += num[b];
+  }
+  int counts[3];
+  CHECK_EQ(oneWire_search_rom_multi(pins, 3, devs, 16, counts), total);
+  for (int b = 0; b < 3; b++) {
+    CHECK_EQ(counts[b], num[b]);
+    qsort(roms[b], num[b], sizeof(uint64_t), cmp_rom);
+    qsort(found[b], num[b], sizeof(uint64_t), cmp_rom);
+    CHECK(memcmp(found[b], roms[b], num[b] * sizeof(uint64_t)) == 0);
+    CHECK_EQ(bus[b]->violations[0], 0);
+  }
+
+  // bad pins are caught before anything is touched
+  const uint bad[2][3] = { { 2, 30, 4 }, { 2, 3, 2 } };
+  for (int i = 0; i < 2; i++) {
+    counts[0] = 99;
+    CHECK_EQ(oneWire_search_rom_multi(bad[i], 3, devs, 16, counts), ONE_WIRE_BAD_PIN);
+    CHECK_EQ(counts[0], 99);
+  }
+
+  // the devices on the first bus go away after the first pass
+  bus[0]->unplug_at = bus[0]->resets + 2;
+  CHECK_EQ(oneWire_search_rom_multi(pins, 3, devs, 16, counts), num[2]);
+  CHECK_EQ(counts[0], ONE_WIRE_SEARCH_ROM_FAILURE);
+  CHECK_EQ(counts[1], 0);
+  CHECK_EQ(counts[2], num[2]);
+  for (int b = 0; b < 3; b++) {
+    for (int i = 0; i < num[b]; i++) sim_dev_free(bus[b]->devs[i]);
+    sim_bus_free(bus[b]);
+  }
+}
+
+int main() {
+  sim_reset();
+  sim_srand(56);
+  test_branch_logic();
+  test_benchmark();
+  test_unplug();
+  test_multi();
+  return test_done("search");
+}
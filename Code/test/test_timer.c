@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) 2021 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Runs the busy wait search and the timer alarm search on the same bus with the
+// same unrelated interrupt load and compares CPU occupancy and the spread of the
+// low pulse lengths on the wire.  Also checks that the timer engine stops on an
+// empty bus, on a bus that empties mid search and at max_devs, that both engines find the same roms and that the end
+// of the search wakes a caller that was about to sleep.
+
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "OneWire.h"
+#include "test.h"
+
+#define NUM_DEVS 8
+#define LOAD_PERIOD_US 200
+#define LOAD_COST_NS 1000
+
+// alarm interrupt entry and the SDK alarm dispatch, 0.5 to 1.5us
+static uint64_t alarm_latency(void) {
+  return 500000 + sim_rand() % 1000000;
+}
+
+static int cmp_rom(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// shortest and longest low pulse between from_us and to_us long
+static void pulse_range(sim_bus_t *bus, int from_us, int to_us, double *min_us, double *max_us) {
+  *min_us = *max_us = 0;
+  for (int i = from_us * 10; i < to_us * 10 && i < SIM_LOW_HIST; i++) {
+    if (bus->low_hist[i] == 0) continue;
+    if (*min_us == 0) *min_us = i / 10.0;
+    *max_us = (i + 1) / 10.0;
+  }
+}
+
+static void report(const char *name, sim_bus_t *bus, double total_us, double cpu_us) {
+  double short_min, short_max, long_min, long_max;
+  pulse_range(bus, 1, 15, &short_min, &short_max);
+  pulse_range(bus, 15, 120, &long_min, &long_max);
+  printf("%s: %.0fus, CPU %.0f%%, write 1/read low %.1f-%.1fus, write 0 low %.1f-%.1fus\n",
+         name, total_us, 100 * cpu_us / total_us, short_min, short_max, long_min, long_max);
+}
+
+static void test_compare(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t roms[NUM_DEVS];
+  for (int i = 0; i < NUM_DEVS; i++) {
+    roms[i] = sim_random_rom(0x28);
+    sim_bus_add(bus, sim_ds18b20_new(roms[i], 20));
+  }
+  qsort(roms, NUM_DEVS, sizeof(uint64_t), cmp_rom);
+  sim_set_irq_load(LOAD_PERIOD_US, LOAD_COST_NS);
+  sim_set_irq_latency(alarm_latency);
+
+  // the busy wait search has the CPU the whole time
+  uint64_t busy[NUM_DEVS + 1];
+  double start = sim_us();
+  CHECK_EQ(oneWire_search_rom(busy), NUM_DEVS);
+  report("busy wait search", bus, sim_us() - start, sim_us() - start);
+  qsort(busy, NUM_DEVS, sizeof(uint64_t), cmp_rom);
+  CHECK(memcmp(busy, roms, sizeof(roms)) == 0);
+  CHECK_EQ(bus->violations[0], 0);
+
+  sim_bus_clear_stats(bus);
+  uint64_t irq_start = sim_irq_busy_ps();
+  uint64_t timed[NUM_DEVS];
+  CHECK_EQ(oneWire_search_rom_timer(ONE_WIRE_GPIO, timed, NUM_DEVS), NUM_DEVS);
+  oneWire_timer_stats_t stats;
+  oneWire_get_timer_stats(&stats);
+  double isr_us = (sim_irq_busy_ps() - irq_start) / (double)SIM_PS_PER_US;
+  report("timer search", bus, stats.total_us, isr_us);
+  printf("timer search: %u edges, %.2fus a callback (isr_us %u), edge late by %.1fus on average, %uus at worst\n",
+         stats.edges, isr_us / stats.edges, stats.isr_us, stats.late_us_total / (double)stats.edges,
+         stats.max_late_us);
+  uint64_t order[2] = { timed[0], timed[1] };
+  qsort(timed, NUM_DEVS, sizeof(uint64_t), cmp_rom);
+  CHECK(memcmp(timed, roms, sizeof(roms)) == 0);
+  CHECK_EQ(bus->violations[0], 0);
+  // one interrupt per edge leaves most of the CPU free
+  CHECK(isr_us * 4 < stats.total_us);
+  // lateness comes from the latency and the other interrupt, it does not build up
+  CHECK(stats.max_late_us <= 3);
+
+  // at most max_devs are stored, the search order is the same every time
+  uint64_t two[3] = { 0, 0, 0 };
+  CHECK_EQ(oneWire_search_rom_timer(ONE_WIRE_GPIO, two, 2), 2);
+  CHECK(memcmp(two, order, sizeof(order)) == 0);
+  CHECK_EQ(two[2], 0);
+  sim_set_irq_load(0, 0);
+  sim_set_irq_latency(NULL);
+  for (int i = 0; i < NUM_DEVS; i++) sim_dev_free(bus->devs[i]);
+  sim_bus_free(bus);
+}
+
+static void test_empty_bus(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  uint64_t devs[1];
+  CHECK_EQ(oneWire_search_rom_timer(ONE_WIRE_GPIO, devs, 1), 0);
+  oneWire_timer_stats_t stats;
+  oneWire_get_timer_stats(&stats);
+  CHECK_EQ(stats.edges, 4);   // three edges of the reset and the one that ends it
+
+  // devices that leave after the first pass are a failure, not a short list
+  sim_dev_t *d[2];
+  for (int i = 0; i < 2; i++) {
+    d[i] = sim_ds18b20_new(sim_random_rom(0x28), 20);
+    sim_bus_add(bus, d[i]);
+  }
+  uint64_t two[2];
+  bus->unplug_at = bus->resets + 2;
+  CHECK_EQ(oneWire_search_rom_timer(ONE_WIRE_GPIO, two, 2), ONE_WIRE_SEARCH_ROM_FAILURE);
+  for (int i = 0; i < 2; i++) sim_dev_free(d[i]);
+  sim_bus_free(bus);
+}
+
+// the search ends after the caller saw it busy but before it went to sleep.  The
+// event from the last edge is latched so the sleep returns, a __wfi() there would
+// wait for an interrupt that never comes.
+static void test_late_wakeup(void) {
+  sim_bus_t *bus = sim_bus_new(ONE_WIRE_GPIO);
+  sim_dev_t *d = sim_ds18b20_new(sim_random_rom(0x28), 20);
+  sim_bus_add(bus, d);
+  uint64_t devs[1];
+  int result;
+  CHECK(oneWire_timer_search_start(ONE_WIRE_GPIO, devs, 1) == ONE_WIRE_NO_ERROR);
+  CHECK(!oneWire_timer_search_done(&result));
+  sleep_ms(20);
+  __wfe();
+  CHECK(oneWire_timer_search_done(&result));
+  CHECK_EQ(result, 1);
+  CHECK(devs[0] == d->rom);
+
+  // nowhere to put a rom, nothing is started
+  uint32_t generation = oneWire_get_search_generation();
+  CHECK(oneWire_timer_search_start(ONE_WIRE_GPIO, devs, 0) == 
+        (oneWire_status)ONE_WIRE_ILLEGAL_DATA_SIZE_REQ);
+  CHECK_EQ(oneWire_search_rom_timer(ONE_WIRE_GPIO, devs, 0), ONE_WIRE_ILLEGAL_DATA_SIZE_REQ);
+  CHECK_EQ(oneWire_get_search_generation(), generation);
+  CHECK_EQ(bus->resets, 1);
+  sim_dev_free(d);
+  sim_bus_free(bus);
+}
+
+int main() {
+  sim_reset();
+  sim_srand(55);
+  test_compare();
+  test_empty_bus();
+  test_late_wakeup();
+  return test_done("timer");
+}